@@ -1,27 +1,68 @@
 #include "benchmark.h"
 
+#include <array>
 #include <atomic>
+#include <ctime>
 #include <fstream>
 #include <future>
 #include <iomanip>
 #include <iostream>
 #include <mutex>
+#include <optional>
 #include <thread>
 #include <vector>
 
+#include "core/sse_serializer.h"
 #include "grpc_client.h"
+#include "httplib.h"
+#include "nlohmann/json.hpp"
 #include "spdlog/spdlog.h"
 
 namespace sentiric_llm_cli {
 
-Benchmark::Benchmark(const std::string& grpc_endpoint)
+namespace {
+
+using ArenaCounters = std::array<long long, 3>;
+
+// /health -> request_arena {acquired, created, spilled_bytes}
+std::optional<ArenaCounters> read_arena_counters(
+    const std::string& http_endpoint) {
+  size_t colon = http_endpoint.find(':');
+  if (http_endpoint.empty() || colon == std::string::npos) return std::nullopt;
+  httplib::Client http(http_endpoint.substr(0, colon),
+                       std::stoi(http_endpoint.substr(colon + 1)));
+  auto res = http.Get("/health");
+  if (!res) return std::nullopt;
+  auto body = nlohmann::json::parse(res->body, nullptr, false);
+  if (!body.is_object() || !body.contains("request_arena")) return std::nullopt;
+  const auto& arena = body["request_arena"];
+  return ArenaCounters{arena.value("acquired", 0LL),
+                       arena.value("created", 0LL),
+                       arena.value("spilled_bytes", 0LL)};
+}
+
+void apply_arena_delta(BenchmarkResult& result,
+                       const std::optional<ArenaCounters>& before,
+                       const std::optional<ArenaCounters>& after) {
+  if (!before || !after) return;
+  result.arenas_acquired = (*after)[0] - (*before)[0];
+  result.arenas_created = (*after)[1] - (*before)[1];
+  result.arena_spilled_bytes = (*after)[2] - (*before)[2];
+}
+
+}  // namespace
+
+Benchmark::Benchmark(const std::string& grpc_endpoint,
+                     const std::string& http_endpoint)
     : grpc_endpoint_(grpc_endpoint),
+      http_endpoint_(http_endpoint),
       client_(std::make_unique<CLIClient>(grpc_endpoint)) {}
 
 BenchmarkResult Benchmark::run_performance_test(int iterations,
                                                 const std::string& prompt) {
   spdlog::info("🎯 Performans testi başlıyor ({} iterasyon)...", iterations);
   BenchmarkResult result;
+  auto arena_before = read_arena_counters(http_endpoint_);
   result.total_requests = iterations;
   long long total_tokens_generated = 0;
   auto total_start = std::chrono::steady_clock::now();
@@ -61,6 +102,7 @@ BenchmarkResult Benchmark::run_performance_test(int iterations,
           ? ((iterations - result.successful_requests) * 100.0) / iterations
           : 0;
   result.total_tokens_generated = total_tokens_generated;
+  apply_arena_delta(result, arena_before, read_arena_counters(http_endpoint_));
   spdlog::info("✅ Performans testi tamamlandı");
   return result;
 }
@@ -71,6 +113,7 @@ BenchmarkResult Benchmark::run_concurrent_test(int concurrent_connections,
                concurrent_connections, requests_per_connection);
   BenchmarkResult result;
   result.total_requests = concurrent_connections * requests_per_connection;
+  auto arena_before = read_arena_counters(http_endpoint_);
   std::atomic<int> success_count{0};
   std::atomic<long long> total_tokens{0};
   std::atomic<double> total_latency_sum{0.0};
@@ -124,6 +167,7 @@ BenchmarkResult Benchmark::run_concurrent_test(int concurrent_connections,
   } else {
     result.tokens_per_second = 0;
   }
+  apply_arena_delta(result, arena_before, read_arena_counters(http_endpoint_));
   spdlog::info("✅ Eşzamanlı test tamamlandı");
   return result;
 }
@@ -216,6 +260,11 @@ void Benchmark::generate_report(const BenchmarkResult& result,
   *output << "Token/Saniye (TPS): " << std::fixed << std::setprecision(2)
           << result.tokens_per_second << "\n";
   *output << "Toplam Süre: " << result.total_duration.count() << " saniye\n";
+  if (result.arenas_acquired >= 0) {
+    *output << "İstek Arena'sı: " << result.arenas_acquired << " kiralama, "
+            << result.arenas_created << " yeni ayırma, "
+            << result.arena_spilled_bytes << " byte taşma\n";
+  }
   *output << "========================\n";
   if (!result.response_times.empty()) {
     *output << "\nYanıt Süreleri (ms):\n";
@@ -228,4 +277,258 @@ void Benchmark::generate_report(const BenchmarkResult& result,
   }
 }
 
-}  // namespace sentiric_llm_cli
\ No newline at end of file
+void Benchmark::run_kv_cache_comparison(
+    const std::string& http_endpoint, const std::vector<std::string>& configs,
+    int iterations, const std::string& filename) {
+  using json = nlohmann::json;
+  size_t colon = http_endpoint.find(':');
+  httplib::Client http(http_endpoint.substr(0, colon),
+                       std::stoi(http_endpoint.substr(colon + 1)));
+  http.set_read_timeout(600, 0);
+
+  auto original_res = http.Get("/v1/hardware/config");
+  if (!original_res || original_res->status != 200) {
+    spdlog::error("❌ Donanım konfigürasyonu okunamadı.");
+    return;
+  }
+  json original = json::parse(original_res->body);
+
+  auto apply = [&](const std::string& k, const std::string& v,
+                   const std::string& fa) {
+    json body = {{"gpu_layers", original.value("gpu_layers", -1)},
+                 {"context_size", original.value("context_size", 4096)},
+                 {"kv_offload", original.value("kv_offload", true)},
+                 {"cache_type_k", k},
+                 {"cache_type_v", v},
+                 {"flash_attn", fa}};
+    auto res =
+        http.Post("/v1/hardware/config", body.dump(), "application/json");
+    if (!res || res->status != 200) {
+      spdlog::error("❌ {}/{} uygulanamadı: {}", k, v,
+                    res ? res->body : "bağlantı hatası");
+      return false;
+    }
+    for (int i = 0; i < 300; ++i) {
+      auto health = http.Get("/health");
+      if (health && health->status == 200) return true;
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    return false;
+  };
+
+  const std::vector<std::string> prompts = {
+      "Kargo siparişimin teslimat süresi hakkında bilgi verir misin?",
+      "İade sürecini üç adımda özetle.",
+      "Müşteri hizmetlerine nasıl ulaşabilirim?"};
+
+  struct Row {
+    std::string config;
+    bool ok = false;
+    double kv_mib = 0;
+    double tps = 0;
+    double avg_ms = 0;
+    double exact_pct = 0;
+    double agreement_pct = 0;
+    std::vector<std::string> outputs;
+  };
+  std::vector<Row> rows;
+  GRPCClient grpc(grpc_endpoint_);
+
+  for (const auto& config : configs) {
+    Row row;
+    row.config = config;
+    size_t slash = config.find('/');
+    std::string k = config.substr(0, slash);
+    std::string v = slash == std::string::npos ? k : config.substr(slash + 1);
+    // Quantize V cache flash attention olmadan çalışmaz.
+    std::string fa = original.value("flash_attn", "auto");
+    bool v_quantized = v != "f16" && v != "f32" && v != "bf16";
+    if (v_quantized && fa == "off") fa = "on";
+
+    spdlog::info("🗜️ KV cache {} uygulanıyor (flash_attn={})...", config, fa);
+    if (!apply(k, v, fa)) {
+      rows.push_back(row);
+      continue;
+    }
+
+    auto health = http.Get("/health");
+    if (health) {
+      json h = json::parse(health->body, nullptr, false);
+      if (h.is_object() && h.contains("capacity")) {
+        row.kv_mib =
+            h["capacity"].value("kv_bytes_per_context", 0.0) / (1024 * 1024);
+      }
+    }
+
+    long long tokens = 0;
+    double total_ms = 0;
+    int runs = 0;
+    for (int it = 0; it < iterations; ++it) {
+      for (const auto& prompt : prompts) {
+        sentiric::llm::v1::GenerateStreamRequest request;
+        request.set_user_prompt(prompt);
+        // Greedy örnekleme: konfigürasyonlar arası fark sadece KV'den gelsin.
+        request.mutable_params()->set_temperature(0.0f);
+        request.mutable_params()->set_max_new_tokens(96);
+
+        std::string output;
+        auto start = std::chrono::steady_clock::now();
+        grpc.generate_stream(request, [&](const std::string& token) {
+          output += token;
+          tokens++;
+        });
+        total_ms += std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+        runs++;
+        if (it == 0) row.outputs.push_back(output);
+      }
+    }
+    row.ok = true;
+    row.avg_ms = runs > 0 ? total_ms / runs : 0;
+    row.tps = total_ms > 0 ? tokens / (total_ms / 1000.0) : 0;
+    rows.push_back(std::move(row));
+  }
+
+  // Kalite: ilk (referans) konfigürasyonun çıktılarıyla karşılaştırma.
+  const Row* baseline = rows.empty() || !rows[0].ok ? nullptr : &rows[0];
+  for (auto& row : rows) {
+    if (!row.ok || !baseline) continue;
+    size_t n = std::min(row.outputs.size(), baseline->outputs.size());
+    double exact = 0, agreement = 0;
+    for (size_t i = 0; i < n; ++i) {
+      const auto& a = row.outputs[i];
+      const auto& b = baseline->outputs[i];
+      size_t prefix = 0;
+      while (prefix < a.size() && prefix < b.size() && a[prefix] == b[prefix])
+        prefix++;
+      size_t longest = std::max(a.size(), b.size());
+      agreement += longest > 0 ? (double)prefix / longest : 1.0;
+      if (a == b) exact++;
+    }
+    row.exact_pct = n > 0 ? exact * 100.0 / n : 0;
+    row.agreement_pct = n > 0 ? agreement * 100.0 / n : 0;
+  }
+
+  spdlog::info("↩️ Orijinal KV cache ayarı geri yükleniyor...");
+  apply(original.value("cache_type_k", "f16"),
+        original.value("cache_type_v", "f16"),
+        original.value("flash_attn", "auto"));
+
+  std::ostream* output = &std::cout;
+  std::ofstream file;
+  if (!filename.empty()) {
+    file.open(filename);
+    output = &file;
+  }
+  *output << "🗜️ KV CACHE KARŞILAŞTIRMA RAPORU\n";
+  *output << "========================\n";
+  *output << std::left << std::setw(14) << "Config" << std::setw(12)
+          << "KV MiB/ctx" << std::setw(10) << "TPS" << std::setw(12)
+          << "Avg ms" << std::setw(10) << "Exact %" << "Prefix %\n";
+  for (const auto& row : rows) {
+    *output << std::left << std::setw(14) << row.config;
+    if (!row.ok) {
+      *output << "BAŞARISIZ\n";
+      continue;
+    }
+    *output << std::fixed << std::setprecision(1) << std::setw(12)
+            << row.kv_mib << std::setw(10) << row.tps << std::setw(12)
+            << row.avg_ms << std::setw(10) << row.exact_pct
+            << row.agreement_pct << "\n";
+  }
+  *output << "========================\n";
+  if (file.is_open()) {
+    file.close();
+    spdlog::info("Rapor dosyaya kaydedildi: {}", filename);
+  }
+}
+
+void Benchmark::run_sse_serialization_bench(int iterations,
+                                            const std::string& filename) {
+  using json = nlohmann::json;
+  using Clock = std::chrono::steady_clock;
+  const std::string model_id = "sentiric/llama-3.1-8b-instruct-q4_k_m";
+  const std::vector<std::string> tokens = {
+      " Merhaba", ",", " size", " nasıl", " yardımcı", " olabilirim", "?",
+      "\n", " \"", "Kargo", "\"", " takip", " numaranız", ":", " TR",
+      "123", "45", "."};
+  const std::vector<std::string> sentences = {
+      "Siparişiniz dün kargoya verildi ve yarın öğleden sonra teslim "
+      "edilmesi bekleniyor. ",
+      "Takip numaranız \"TR12345\" olup kargo firmasının sitesinden "
+      "sorgulayabilirsiniz.\n",
+      "Başka bir konuda yardımcı olabilir miyim? "};
+  if (iterations <= 0) iterations = 200000;
+
+  struct Row {
+    std::string payload;
+    double json_ns = 0;
+    double template_ns = 0;
+  };
+  size_t sink_bytes = 0;  // Derleyici döngüyü atmasın.
+
+  auto measure = [&](const std::vector<std::string>& contents) {
+    Row row;
+    // Eski yol: her parça için json nesnesi, iki std::time, id ve dump().
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      const std::string& content = contents[i % contents.size()];
+      json chunk;
+      chunk["id"] = "chatcmpl-" + std::to_string(std::time(nullptr));
+      chunk["object"] = "chat.completion.chunk";
+      chunk["created"] = std::time(nullptr);
+      chunk["model"] = model_id;
+      chunk["choices"][0]["index"] = 0;
+      chunk["choices"][0]["delta"]["content"] = content;
+      std::string data = "data: " + chunk.dump() + "\n\n";
+      sink_bytes += data.size();
+    }
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    row.json_ns = elapsed.count() / iterations;
+
+    // Yeni yol: akış başına şablon, parça başına yalnızca kaçış.
+    std::time_t created = std::time(nullptr);
+    SseChunkSerializer serializer("chatcmpl-" + std::to_string(created),
+                                  model_id, created);
+    start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      sink_bytes += serializer.chunk(contents[i % contents.size()]).size();
+    }
+    elapsed = Clock::now() - start;
+    row.template_ns = elapsed.count() / iterations;
+    return row;
+  };
+
+  std::vector<Row> rows;
+  rows.push_back(measure(tokens));
+  rows.back().payload = "token";
+  rows.push_back(measure(sentences));
+  rows.back().payload = "sentence";
+
+  std::ostream* output = &std::cout;
+  std::ofstream file;
+  if (!filename.empty()) {
+    file.open(filename);
+    output = &file;
+  }
+  *output << "🧾 SSE SERİLEŞTİRME RAPORU (" << iterations << " çerçeve)\n";
+  *output << "========================\n";
+  *output << std::left << std::setw(12) << "İçerik" << std::setw(16)
+          << "json ns/chunk" << std::setw(20) << "template ns/chunk"
+          << "Hızlanma\n";
+  for (const auto& row : rows) {
+    double speedup = row.template_ns > 0 ? row.json_ns / row.template_ns : 0;
+    *output << std::left << std::setw(12) << row.payload << std::fixed
+            << std::setprecision(1) << std::setw(16) << row.json_ns
+            << std::setw(20) << row.template_ns << speedup << "x\n";
+  }
+  *output << "========================\n";
+  spdlog::debug("SSE bench output bytes: {}", sink_bytes);
+  if (file.is_open()) {
+    file.close();
+    spdlog::info("Rapor dosyaya kaydedildi: {}", filename);
+  }
+}
+
+}  // namespace sentiric_llm_cli
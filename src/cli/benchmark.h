@@ -17,11 +17,18 @@ struct BenchmarkResult {
   long long total_tokens_generated;
   std::chrono::seconds total_duration;
   std::vector<double> response_times;
+  // Test süresince sunucunun istek arena sayaçlarındaki artış (/health).
+  // -1: HTTP uç noktası verilmedi veya okunamadı.
+  long long arenas_acquired = -1;
+  long long arenas_created = -1;
+  long long arena_spilled_bytes = -1;
 };
 
 class Benchmark {
  public:
-  Benchmark(const std::string& grpc_endpoint);
+  // http_endpoint verilirse raporlara sunucu tarafı arena sayaçları eklenir.
+  Benchmark(const std::string& grpc_endpoint,
+            const std::string& http_endpoint = "");
 
   BenchmarkResult run_performance_test(
       int iterations = 10, const std::string& prompt = "Test prompt");
@@ -35,8 +42,24 @@ class Benchmark {
   void generate_report(const BenchmarkResult& result,
                        const std::string& filename = "");
 
+  // KV cache konfigürasyonlarını ("k/v", örn. "q8_0/q8_0") sırayla
+  // /v1/hardware/config ile uygular; context başına KV belleği, hız ve ilk
+  // konfigürasyona göre çıktı uyumunu raporlar. Sonunda eski ayar geri
+  // yüklenir.
+  void run_kv_cache_comparison(const std::string& http_endpoint,
+                               const std::vector<std::string>& configs,
+                               int iterations,
+                               const std::string& filename = "");
+
+  // SSE çerçeve serileştirme mikro benchmark'ı (sunucu gerekmez): token
+  // başına json nesnesi + dump() yolu ile SseChunkSerializer şablonunun
+  // çerçeve başına maliyetini (ns) token ve cümle boyu içerikte karşılaştırır.
+  static void run_sse_serialization_bench(int iterations,
+                                          const std::string& filename = "");
+
  private:
   std::string grpc_endpoint_;
+  std::string http_endpoint_;
   std::unique_ptr<CLIClient> client_;
 };
 
@@ -34,7 +34,8 @@ bool CLIClient::generate_stream(
 
 bool CLIClient::health_check() {
   auto status = http_client_->check_health();
-  return status.status == "healthy" && status.model_ready;
+  return (status.status == "ready" || status.status == "degraded") &&
+         status.model_ready;
 }
 
 std::string CLIClient::get_health_status() {
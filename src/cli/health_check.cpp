@@ -18,7 +18,7 @@ HealthChecker::SystemStatus HealthChecker::check_system() {
 
   // HTTP health check
   auto http_status = client_->get_health_status();
-  status.http_healthy = (http_status == "healthy");
+  status.http_healthy = (http_status == "ready" || http_status == "degraded");
 
   // GRPC health check (basit bir test)
   status.grpc_healthy = client_->is_connected();
@@ -7,6 +7,7 @@
 #include "benchmark.h"
 #include "grpc_client.h"
 #include "health_check.h"
+#include "model_manager.h"
 #include "nlohmann/json.hpp"
 #include "spdlog/spdlog.h"
 
@@ -23,6 +24,12 @@ Komutlar:
   wait-for-ready           - Servis hazır olana kadar bekler.
   benchmark                - Performans testi çalıştırır.
   interrupt-test           - Voice Gateway söz kesme senaryosunu simüle eder.
+  kv-bench [k/v ...]       - KV cache tiplerini karşılaştırır
+                             (varsayılan: f16/f16 q8_0/q8_0 q4_0/q4_0).
+  download <url> <dosya>   - Model dosyasını paralel indirir ve SHA-256 ile
+                             doğrular (yarım kalan indirme devam eder).
+  sse-bench                - SSE çerçeve serileştirme maliyetini ölçer
+                             (sunucu gerekmez; --iterations çerçeve sayısı).
 
 Seçenekler:
   --grpc-endpoint <addr>   - GRPC endpoint (varsayılan: llm-llama-service:16071).
@@ -31,6 +38,8 @@ Seçenekler:
   --concurrent <n>         - Eşzamanlı bağlantı sayısı.
   --requests <n>           - Bağlantı başına istek sayısı.
   --output <file>          - Raporu dosyaya kaydeder (opsiyonel).
+  --connections <n>        - download: paralel bağlantı sayısı (varsayılan 4).
+  --sha256 <hex>           - download: beklenen hash (varsayılan: sunucu ETag).
 )";
 }
 
@@ -102,7 +111,7 @@ int main(int argc, char** argv) {
       int reqs = options.count("requests") ? std::stoi(options["requests"]) : 1;
       std::string outfile = options.count("output") ? options["output"] : "";
 
-      sentiric_llm_cli::Benchmark benchmark(grpc_endpoint);
+      sentiric_llm_cli::Benchmark benchmark(grpc_endpoint, http_endpoint);
       sentiric_llm_cli::BenchmarkResult result;
 
       if (concurrent > 1) {
@@ -116,6 +125,44 @@ int main(int argc, char** argv) {
       // [FIX] Raporu mutlaka üret
       benchmark.generate_report(result, outfile);
 
+    } else if (command == "kv-bench") {
+      int iter =
+          options.count("iterations") ? std::stoi(options["iterations"]) : 1;
+      std::string outfile = options.count("output") ? options["output"] : "";
+      std::vector<std::string> configs = command_args;
+      if (configs.empty()) configs = {"f16/f16", "q8_0/q8_0", "q4_0/q4_0"};
+
+      sentiric_llm_cli::Benchmark benchmark(grpc_endpoint);
+      benchmark.run_kv_cache_comparison(http_endpoint, configs, iter, outfile);
+    } else if (command == "sse-bench") {
+      int iter = options.count("iterations")
+                     ? std::stoi(options["iterations"])
+                     : 200000;
+      std::string outfile = options.count("output") ? options["output"] : "";
+      sentiric_llm_cli::Benchmark::run_sse_serialization_bench(iter, outfile);
+    } else if (command == "download") {
+      if (command_args.size() < 2) {
+        spdlog::error("download komutu için <url> <dosya> gereklidir.");
+        return 1;
+      }
+      ModelManager::DownloadOptions download_options;
+      if (options.count("connections"))
+        download_options.connections = std::stoi(options["connections"]);
+      if (options.count("sha256"))
+        download_options.expected_sha256 = options["sha256"];
+
+      int last_percent = -1;
+      ModelManager::download_file(
+          command_args[0], command_args[1], download_options,
+          [&last_percent](double total, double now) {
+            int percent = static_cast<int>(100.0 * now / total);
+            if (percent != last_percent) {
+              std::cout << "\r⬇️  %" << percent << std::flush;
+              last_percent = percent;
+            }
+          });
+      std::cout << std::endl;
+      spdlog::info("✅ İndirildi: {}", command_args[1]);
     } else if (command == "interrupt-test") {
       sentiric_llm_cli::Benchmark benchmark(grpc_endpoint);
       std::string initial =
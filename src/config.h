@@ -4,6 +4,7 @@
 #include <cstdlib>
 #include <filesystem>
 #include <fstream>
+#include <set>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -12,6 +13,55 @@
 #include "nlohmann/json.hpp"
 #include "spdlog/spdlog.h"
 
+// ==================================================================================
+// 🧭 NUMA STRATEGY HELPERS
+// ==================================================================================
+inline ggml_numa_strategy parse_numa_strategy(const std::string& name) {
+  if (name == "distribute") return GGML_NUMA_STRATEGY_DISTRIBUTE;
+  if (name == "isolate") return GGML_NUMA_STRATEGY_ISOLATE;
+  if (name == "numactl") return GGML_NUMA_STRATEGY_NUMACTL;
+  if (name == "mirror") return GGML_NUMA_STRATEGY_MIRROR;
+  return GGML_NUMA_STRATEGY_DISABLED;
+}
+
+inline const char* numa_strategy_name(ggml_numa_strategy strategy) {
+  switch (strategy) {
+    case GGML_NUMA_STRATEGY_DISTRIBUTE:
+      return "distribute";
+    case GGML_NUMA_STRATEGY_ISOLATE:
+      return "isolate";
+    case GGML_NUMA_STRATEGY_NUMACTL:
+      return "numactl";
+    case GGML_NUMA_STRATEGY_MIRROR:
+      return "mirror";
+    default:
+      return "disabled";
+  }
+}
+
+// ==================================================================================
+// 🗜️ KV CACHE HELPERS
+// ==================================================================================
+// Desteklenmeyen isimlerde GGML_TYPE_COUNT döner.
+inline ggml_type parse_cache_type(const std::string& name) {
+  if (name == "f32") return GGML_TYPE_F32;
+  if (name == "f16") return GGML_TYPE_F16;
+  if (name == "bf16") return GGML_TYPE_BF16;
+  if (name == "q8_0") return GGML_TYPE_Q8_0;
+  if (name == "q4_0") return GGML_TYPE_Q4_0;
+  if (name == "q4_1") return GGML_TYPE_Q4_1;
+  if (name == "q5_0") return GGML_TYPE_Q5_0;
+  if (name == "q5_1") return GGML_TYPE_Q5_1;
+  return GGML_TYPE_COUNT;
+}
+
+// "on" | "off" | "auto" (llama.cpp backend'e göre karar verir)
+inline llama_flash_attn_type parse_flash_attn(const std::string& name) {
+  if (name == "on" || name == "true") return LLAMA_FLASH_ATTN_TYPE_ENABLED;
+  if (name == "off" || name == "false") return LLAMA_FLASH_ATTN_TYPE_DISABLED;
+  return LLAMA_FLASH_ATTN_TYPE_AUTO;
+}
+
 // ==================================================================================
 // ⚙️ GLOBAL SETTINGS STRUCTURE
 // ==================================================================================
@@ -21,7 +71,31 @@ struct Settings {
   int http_port = 16070;
   int grpc_port = 16071;
   int metrics_port = 16072;
+  // /health ve /v1/cache/probe için ayrı dinleyici; SSE akışları ana
+  // havuzu doldursa bile yanıt verir.
+  int health_port = 16073;
   int http_threads = 50;
+  // Açık SSE akışları thread tutar; havuz bu sınıra kadar büyür (boşta
+  // kalan ek thread'ler kapanır).
+  int http_max_threads = 512;
+  // SIGTERM sonrası kabul edilmiş isteklerin bitmesi için azami süre;
+  // aşılırsa kalan üretimler kesilir.
+  int drain_timeout_s = 30;
+  // İstek başına token tamponu (üretim ile ağ yazıcısı arasında) ve
+  // tampon dolduğunda ne yapılacağı: "pause" (üretim bekler), "coalesce"
+  // (token'lar birleştirilip üretim sürer) veya "abort" (istek kesilir).
+  size_t stream_buffer_tokens = 1024;
+  size_t stream_buffer_kb = 64;
+  std::string stream_overflow_policy = "pause";
+  // pause: istemci bu süre boyunca hiç okumazsa istek kesilir (0 = sınırsız).
+  int stream_stall_timeout_ms = 30000;
+  // Akış birleştirme varsayılanı (istek bazında değiştirilebilir): ilk
+  // token hemen, sonrakiler en az bu kadar bayt birikince veya en eski
+  // token bu kadar beklediğinde tek mesajda gider. 0 = token başına mesaj.
+  size_t stream_min_chunk_bytes = 0;
+  int stream_max_flush_interval_ms = 50;
+  // /v1/batches: iş başına azami istek satırı (işler bellekte tutulur).
+  size_t batch_max_requests = 50000;
 
   // --- MODEL IDENTIFICATION ---
   std::string profile_name = "default";
@@ -33,6 +107,9 @@ struct Settings {
   std::string legacy_model_path = "";
   std::string model_url_template =
       "https://huggingface.co/{model_id}/resolve/main/{filename}";
+  // Boşsa Hugging Face'in bildirdiği LFS hash'i (X-Linked-Etag) kullanılır.
+  std::string model_sha256 = "";
+  int download_connections = 4;  // Paralel Range bağlantısı
 
   // --- TEMPLATE CONFIGURATION (TURKISH DEFAULT / ADAPTIVE) ---
   // [ADAPTIVE] Türkçe varsayılan, İngilizce algılandığında geçiş yapan akıllı
@@ -77,14 +154,57 @@ struct Settings {
   // Batching & Memory
   uint32_t physical_batch_size = 512;
   ggml_numa_strategy numa_strategy = GGML_NUMA_STRATEGY_DISABLED;
+  // Context başına çekirdek kümeleri: "" (kapalı), "auto" veya "0-3;4-7"
+  std::string cpu_affinity = "";
+  // ggml threadpool paylaşımı: "per_context" | "shared" | "partitioned".
+  // 0 = n_threads / n_threads_batch kullanılır.
+  std::string threadpool_mode = "per_context";
+  uint32_t pool_decode_threads = 0;
+  uint32_t pool_prefill_threads = 0;
   bool use_mmap = true;
+  // use_mmap ile ağırlıkları yüklemeden önce paralel okuyup page cache'e al
+  // (0 thread = otomatik). use_mlock sayfaları RAM'e kilitler.
+  bool prefetch_weights = true;
+  int prefetch_threads = 0;
+  bool use_mlock = false;
   bool kv_offload = true;
 
+  // KV cache tipleri (f16, q8_0, q4_0 ...) ve flash attention (on/off/auto).
+  // Quantize V cache llama.cpp'de flash attention gerektirir.
+  std::string cache_type_k = "f16";
+  std::string cache_type_v = "f16";
+  std::string flash_attn = "auto";
+
   // Dynamic Batching (Request Queue)
   bool enable_dynamic_batching = true;
   size_t max_batch_size = 1;  // Default: 1 (Strict Memory Limit)
+  // Elastik havuz: 0 = max_batch_size context'in hepsi açılışta ayrılır.
+  size_t min_pool_size = 0;
+  int pool_grow_after_ms = 200;      // Boş context beklerken büyüme eşiği
+  int context_idle_ttl_s = 0;        // 0 = boştaki context'ler bırakılmaz
+  size_t pool_memory_budget_mb = 0;  // 0 = sınırsız (sadece slot sınırı)
+  // Unified KV: tek context, max_batch_size sequence. Hücreler gerçek
+  // kullanıma göre paylaşılır (0 = context_size x max_batch_size).
+  bool kv_unified = false;
+  uint32_t kv_unified_cells = 0;
+  // OpenAI 'n': istek başına azami seçenek. 1'den büyükse ayrık context'ler
+  // bu kadar sequence ile (kv_unified) açılır; prompt bir kez işlenip KV'si
+  // seçeneklere kopyalanır. KV düzenini değiştirdiği için isteğe bağlıdır.
+  uint32_t max_choices = 1;
   int batch_timeout_ms = 5;
   bool enable_warm_up = true;
+  // Model değişiminde yeni modeli eskisinin yanında yükle (bellek yetiyorsa).
+  bool hot_swap = true;
+  // Aktif profile ek olarak bellekte tutulacak profiller ("a,b"). İstekler
+  // HTTP 'model'/'profile' veya gRPC 'x-model-profile' ile seçer.
+  std::string resident_profiles = "";
+  // Yüklü modellerin (ağırlık + KV) toplam bütçesi; aşılırsa en uzun süredir
+  // boşta olan ek model bırakılır. 0 = sınırsız.
+  size_t model_memory_budget_mb = 0;
+
+  // Scheduling ("fifo" | "sjf": tahmini kalan işe göre sıralama)
+  std::string scheduling_policy = "fifo";
+  int sjf_max_wait_ms = 2000;  // Anti-starvation sınırı
 
   // --- LOGGING & SECURITY ---
   std::string log_level = "info";
@@ -104,11 +224,26 @@ struct Settings {
   std::string worker_group = "default-group";
   std::string gateway_address = "";
 
+  // KV cache ayarları geçerliyse boş, değilse hata mesajı döner.
+  std::string kv_cache_error() const {
+    if (parse_cache_type(cache_type_k) == GGML_TYPE_COUNT)
+      return "Unsupported cache_type_k: " + cache_type_k;
+    ggml_type v = parse_cache_type(cache_type_v);
+    if (v == GGML_TYPE_COUNT)
+      return "Unsupported cache_type_v: " + cache_type_v;
+    if (ggml_is_quantized(v) &&
+        parse_flash_attn(flash_attn) == LLAMA_FLASH_ATTN_TYPE_DISABLED)
+      return "Quantized cache_type_v requires flash_attn (on/auto).";
+    return "";
+  }
+
   // JSON Serialization (FULL OBSERVABILITY RECTIFIED)
   nlohmann::json to_json() const {
     return {// Kimlik
             {"profile_name", profile_name},
             {"model_id", model_id},
+            {"model_sha256", model_sha256},
+            {"download_connections", download_connections},
 
             // Donanım Kaynakları
             {"gpu_layers", n_gpu_layers},
@@ -116,12 +251,34 @@ struct Settings {
             {"threads", n_threads},
             {"threads_batch", n_threads_batch},            // [RESTORED]
             {"physical_batch_size", physical_batch_size},  // [RESTORED]
+            {"numa_strategy", numa_strategy_name(numa_strategy)},
+            {"cpu_affinity", cpu_affinity},
+            {"threadpool_mode", threadpool_mode},
+            {"pool_decode_threads", pool_decode_threads},
+            {"pool_prefill_threads", pool_prefill_threads},
 
             // Eşzamanlılık & Bellek
             {"max_batch_size_slots", max_batch_size},
+            {"min_pool_size", min_pool_size},
+            {"pool_grow_after_ms", pool_grow_after_ms},
+            {"context_idle_ttl_s", context_idle_ttl_s},
+            {"pool_memory_budget_mb", pool_memory_budget_mb},
+            {"kv_unified", kv_unified},
+            {"kv_unified_cells", kv_unified_cells},
             {"kv_offload", kv_offload},
+            {"cache_type_k", cache_type_k},
+            {"cache_type_v", cache_type_v},
+            {"flash_attn", flash_attn},
             {"use_mmap", use_mmap},                                // [RESTORED]
+            {"prefetch_weights", prefetch_weights},
+            {"prefetch_threads", prefetch_threads},
+            {"use_mlock", use_mlock},
             {"enable_dynamic_batching", enable_dynamic_batching},  // [RESTORED]
+            {"hot_swap", hot_swap},
+            {"resident_profiles", resident_profiles},
+            {"model_memory_budget_mb", model_memory_budget_mb},
+            {"scheduling_policy", scheduling_policy},
+            {"sjf_max_wait_ms", sjf_max_wait_ms},
 
             // Promptlar
             {"template_system_prompt", template_system_prompt}};
@@ -131,20 +288,41 @@ struct Settings {
 // ==================================================================================
 // 🛠️ HELPER: PROFILE LOADER
 // ==================================================================================
+// profiles.json yolunu bulur (çalışma dizini, sonra model_dir); yoksa boş.
+inline std::filesystem::path find_profiles_file(const Settings& s) {
+  namespace fs = std::filesystem;
+  fs::path profile_path = "profiles.json";
+  if (fs::exists(profile_path)) return profile_path;
+  profile_path = fs::path(s.model_dir) / "profiles.json";
+  if (fs::exists(profile_path)) return profile_path;
+  return {};
+}
+
+// profiles.json'daki profil isimleri; dosya yoksa veya bozuksa boş.
+inline std::set<std::string> read_profile_names(
+    const std::filesystem::path& profile_path) {
+  std::set<std::string> names;
+  if (profile_path.empty()) return names;
+  try {
+    std::ifstream f(profile_path);
+    auto j = nlohmann::json::parse(f);
+    if (!j.contains("profiles") || !j["profiles"].is_object()) return names;
+    for (const auto& [name, _] : j["profiles"].items()) names.insert(name);
+  } catch (const std::exception&) {
+    names.clear();
+  }
+  return names;
+}
+
 inline bool apply_profile(Settings& s,
                           const std::string& profile_name_override) {
   namespace fs = std::filesystem;
   using json = nlohmann::json;
 
-  fs::path profile_path = "profiles.json";
-
-  // Fallback paths
-  if (!fs::exists(profile_path)) {
-    profile_path = fs::path(s.model_dir) / "profiles.json";
-    if (!fs::exists(profile_path)) {
-      spdlog::debug("Profiles file not found. Using defaults/env only.");
-      return false;
-    }
+  fs::path profile_path = find_profiles_file(s);
+  if (profile_path.empty()) {
+    spdlog::debug("Profiles file not found. Using defaults/env only.");
+    return false;
   }
 
   try {
@@ -165,6 +343,7 @@ inline bool apply_profile(Settings& s,
       // --- Model Identity ---
       if (p.contains("model_id")) s.model_id = p["model_id"];
       if (p.contains("filename")) s.model_filename = p["filename"];
+      s.model_sha256 = p.value("sha256", std::string());
 
       // --- Hardware & Performance ---
       if (p.contains("context_size")) s.context_size = p["context_size"];
@@ -174,12 +353,54 @@ inline bool apply_profile(Settings& s,
       if (p.contains("physical_batch_size"))
         s.physical_batch_size = p["physical_batch_size"];
       if (p.contains("max_batch_size")) s.max_batch_size = p["max_batch_size"];
+      if (p.contains("min_pool_size")) s.min_pool_size = p["min_pool_size"];
+      if (p.contains("pool_grow_after_ms"))
+        s.pool_grow_after_ms = p["pool_grow_after_ms"];
+      if (p.contains("context_idle_ttl_s"))
+        s.context_idle_ttl_s = p["context_idle_ttl_s"];
+      if (p.contains("pool_memory_budget_mb"))
+        s.pool_memory_budget_mb = p["pool_memory_budget_mb"];
+      if (p.contains("kv_unified")) s.kv_unified = p["kv_unified"];
+      if (p.contains("kv_unified_cells"))
+        s.kv_unified_cells = p["kv_unified_cells"];
+      if (p.contains("numa_strategy"))
+        s.numa_strategy = parse_numa_strategy(p["numa_strategy"]);
+      if (p.contains("cpu_affinity")) s.cpu_affinity = p["cpu_affinity"];
+      if (p.contains("threadpool_mode"))
+        s.threadpool_mode = p["threadpool_mode"];
+      if (p.contains("pool_decode_threads"))
+        s.pool_decode_threads = p["pool_decode_threads"];
+      if (p.contains("pool_prefill_threads"))
+        s.pool_prefill_threads = p["pool_prefill_threads"];
 
       // --- Flags ---
       if (p.contains("use_mmap")) s.use_mmap = p["use_mmap"];
+      if (p.contains("prefetch_weights"))
+        s.prefetch_weights = p["prefetch_weights"];
+      if (p.contains("prefetch_threads"))
+        s.prefetch_threads = p["prefetch_threads"];
+      if (p.contains("use_mlock")) s.use_mlock = p["use_mlock"];
+      if (p.contains("hot_swap")) s.hot_swap = p["hot_swap"];
+      if (p.contains("resident_profiles"))
+        s.resident_profiles = p["resident_profiles"];
+      if (p.contains("model_memory_budget_mb"))
+        s.model_memory_budget_mb = p["model_memory_budget_mb"];
       if (p.contains("kv_offload")) s.kv_offload = p["kv_offload"];
+      if (p.contains("cache_type_k")) s.cache_type_k = p["cache_type_k"];
+      if (p.contains("cache_type_v")) s.cache_type_v = p["cache_type_v"];
+      if (p.contains("flash_attn")) {
+        const auto& fa = p["flash_attn"];
+        if (fa.is_boolean())
+          s.flash_attn = fa.get<bool>() ? "on" : "off";
+        else
+          s.flash_attn = fa;
+      }
       if (p.contains("enable_batching"))
         s.enable_dynamic_batching = p["enable_batching"];
+      if (p.contains("scheduling_policy"))
+        s.scheduling_policy = p["scheduling_policy"];
+      if (p.contains("sjf_max_wait_ms"))
+        s.sjf_max_wait_ms = p["sjf_max_wait_ms"];
 
       // --- Sampling Defaults ---
       if (p.contains("temperature")) s.default_temperature = p["temperature"];
@@ -298,12 +519,30 @@ inline Settings load_settings() {
   override_int("LLM_LLAMA_SERVICE_HTTP_PORT", s.http_port);
   override_int("LLM_LLAMA_SERVICE_GRPC_PORT", s.grpc_port);
   override_int("LLM_LLAMA_SERVICE_METRICS_PORT", s.metrics_port);
+  override_int("LLM_LLAMA_SERVICE_HEALTH_PORT", s.health_port);
   override_int("LLM_LLAMA_SERVICE_HTTP_THREADS", s.http_threads);
+  override_int("LLM_LLAMA_SERVICE_HTTP_MAX_THREADS", s.http_max_threads);
+  override_int("LLM_LLAMA_SERVICE_DRAIN_TIMEOUT_S", s.drain_timeout_s);
+  override_size("LLM_LLAMA_SERVICE_STREAM_BUFFER_TOKENS",
+                s.stream_buffer_tokens);
+  override_size("LLM_LLAMA_SERVICE_STREAM_BUFFER_KB", s.stream_buffer_kb);
+  override_string("LLM_LLAMA_SERVICE_STREAM_OVERFLOW_POLICY",
+                  s.stream_overflow_policy);
+  override_int("LLM_LLAMA_SERVICE_STREAM_STALL_TIMEOUT_MS",
+               s.stream_stall_timeout_ms);
+  override_size("LLM_LLAMA_SERVICE_STREAM_MIN_CHUNK_BYTES",
+                s.stream_min_chunk_bytes);
+  override_int("LLM_LLAMA_SERVICE_STREAM_MAX_FLUSH_INTERVAL_MS",
+               s.stream_max_flush_interval_ms);
+  override_size("LLM_LLAMA_SERVICE_BATCH_MAX_REQUESTS", s.batch_max_requests);
 
   // Model & Paths
   override_string("LLM_LLAMA_SERVICE_LORA_DIR", s.lora_dir);
   override_string("LLM_LLAMA_SERVICE_MODEL_ID", s.model_id);
   override_string("LLM_LLAMA_SERVICE_MODEL_FILENAME", s.model_filename);
+  override_string("LLM_LLAMA_SERVICE_MODEL_SHA256", s.model_sha256);
+  override_int("LLM_LLAMA_SERVICE_DOWNLOAD_CONNECTIONS",
+               s.download_connections);
 
   // Hardware & Performance
   override_int("LLM_LLAMA_SERVICE_GPU_LAYERS", s.n_gpu_layers);
@@ -311,13 +550,44 @@ inline Settings load_settings() {
   override_uint("LLM_LLAMA_SERVICE_THREADS", s.n_threads);
   override_uint("LLM_LLAMA_SERVICE_THREADS_BATCH", s.n_threads_batch);
   override_bool("LLM_LLAMA_SERVICE_USE_MMAP", s.use_mmap);
+  override_bool("LLM_LLAMA_SERVICE_PREFETCH_WEIGHTS", s.prefetch_weights);
+  override_int("LLM_LLAMA_SERVICE_PREFETCH_THREADS", s.prefetch_threads);
+  override_bool("LLM_LLAMA_SERVICE_USE_MLOCK", s.use_mlock);
   override_bool("LLM_LLAMA_SERVICE_KV_OFFLOAD", s.kv_offload);
+  override_string("LLM_LLAMA_SERVICE_CACHE_TYPE_K", s.cache_type_k);
+  override_string("LLM_LLAMA_SERVICE_CACHE_TYPE_V", s.cache_type_v);
+  override_string("LLM_LLAMA_SERVICE_FLASH_ATTN", s.flash_attn);
+  override_string("LLM_LLAMA_SERVICE_CPU_AFFINITY", s.cpu_affinity);
+  override_string("LLM_LLAMA_SERVICE_THREADPOOL_MODE", s.threadpool_mode);
+  override_uint("LLM_LLAMA_SERVICE_POOL_DECODE_THREADS",
+                s.pool_decode_threads);
+  override_uint("LLM_LLAMA_SERVICE_POOL_PREFILL_THREADS",
+                s.pool_prefill_threads);
+  if (const char* numa = std::getenv("LLM_LLAMA_SERVICE_NUMA_STRATEGY")) {
+    s.numa_strategy = parse_numa_strategy(numa);
+    spdlog::info("🔧 [Env Override] LLM_LLAMA_SERVICE_NUMA_STRATEGY = {}",
+                 numa_strategy_name(s.numa_strategy));
+  }
 
   // Batching & Concurrency
   override_bool("LLM_LLAMA_SERVICE_ENABLE_BATCHING", s.enable_dynamic_batching);
+  override_bool("LLM_LLAMA_SERVICE_HOT_SWAP", s.hot_swap);
+  override_string("LLM_LLAMA_SERVICE_RESIDENT_PROFILES", s.resident_profiles);
+  override_size("LLM_LLAMA_SERVICE_MODEL_MEMORY_BUDGET_MB",
+                s.model_memory_budget_mb);
   override_size("LLM_LLAMA_SERVICE_MAX_BATCH_SIZE", s.max_batch_size);
+  override_size("LLM_LLAMA_SERVICE_MIN_POOL_SIZE", s.min_pool_size);
+  override_int("LLM_LLAMA_SERVICE_POOL_GROW_AFTER_MS", s.pool_grow_after_ms);
+  override_int("LLM_LLAMA_SERVICE_CONTEXT_IDLE_TTL_S", s.context_idle_ttl_s);
+  override_size("LLM_LLAMA_SERVICE_POOL_MEMORY_BUDGET_MB",
+                s.pool_memory_budget_mb);
+  override_bool("LLM_LLAMA_SERVICE_KV_UNIFIED", s.kv_unified);
+  override_uint("LLM_LLAMA_SERVICE_KV_UNIFIED_CELLS", s.kv_unified_cells);
+  override_uint("LLM_LLAMA_SERVICE_MAX_CHOICES", s.max_choices);
   override_int("LLM_LLAMA_SERVICE_BATCH_TIMEOUT_MS", s.batch_timeout_ms);
   override_uint("LLM_LLAMA_SERVICE_PHYSICAL_BATCH_SIZE", s.physical_batch_size);
+  override_string("LLM_LLAMA_SERVICE_SCHEDULING_POLICY", s.scheduling_policy);
+  override_int("LLM_LLAMA_SERVICE_SJF_MAX_WAIT_MS", s.sjf_max_wait_ms);
 
   // Logging & Security
   override_string("LLM_LLAMA_SERVICE_LOG_LEVEL", s.log_level);
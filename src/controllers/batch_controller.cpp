@@ -0,0 +1,435 @@
+#include "controllers/batch_controller.h"
+
+#include <algorithm>
+#include <ctime>
+#include <future>
+#include <numeric>
+#include <sstream>
+
+#include "suts_logger.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// Sistem mesajı, RAG bağlamı ve hedef model prompt'un başını belirler.
+std::string prefix_key(const json& body) {
+  std::string key = body.value("profile", std::string()) + '\x1f' +
+                    body.value("model", std::string()) + '\x1f' +
+                    body.value("system_prompt", std::string());
+  if (body.contains("messages") && body["messages"].is_array()) {
+    for (const auto& msg : body["messages"]) {
+      if (msg.value("role", "") == "system") {
+        key += '\x1f';
+        key += msg.value("content", "");
+      }
+    }
+  }
+  key += '\x1f';
+  key += body.value("rag_context", std::string());
+  return key;
+}
+
+bool is_finished(const std::string& status) {
+  return status == "completed" || status == "cancelled";
+}
+
+void reject(httplib::Response& res, int status, const std::string& message,
+            const std::string& type = "invalid_request_error") {
+  res.status = status;
+  res.set_content(
+      json({{"error", {{"message", message}, {"type", type}}}}).dump(),
+      "application/json");
+}
+
+}  // namespace
+
+BatchController::BatchController(std::shared_ptr<LLMEngine> engine,
+                                 ChatController& chat)
+    : engine_(std::move(engine)), chat_(chat) {
+  dispatcher_ = std::thread(&BatchController::dispatcher_loop, this);
+}
+
+BatchController::~BatchController() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+    for (auto& [id, job] : jobs_) job->cancel_requested = true;
+  }
+  cv_.notify_all();
+  results_cv_.notify_all();
+  if (dispatcher_.joinable()) dispatcher_.join();
+}
+
+void BatchController::dispatcher_loop() {
+  for (;;) {
+    std::shared_ptr<Job> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+      if (stopping_) return;
+      job = pending_.front();
+      pending_.pop_front();
+      job->status = "in_progress";
+    }
+
+    run_job(job);
+
+    size_t completed, failed;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      job->status = job->cancel_requested ? "cancelled" : "completed";
+      job->completed_at = std::time(nullptr);
+      completed = job->completed;
+      failed = job->failed;
+    }
+    results_cv_.notify_all();
+    SUTS_INFO("BATCH_JOB_FINISHED", job->trace_id, "unknown", job->tenant_id,
+              "📦 Batch {} finished: {}/{} completed, {} failed.", job->id,
+              completed, job->items.size(), failed);
+  }
+}
+
+void BatchController::run_job(const std::shared_ptr<Job>& job) {
+  // Ortak önekli istekler art arda gider; önceki isteğin prompt'u context
+  // önbelleğinde durduğu için yalnızca farklı kısım işlenir.
+  std::vector<size_t> order(job->items.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&job](size_t a, size_t b) {
+    return job->items[a].prefix_key < job->items[b].prefix_key;
+  });
+  std::deque<size_t> todo(order.begin(), order.end());
+
+  struct Running {
+    size_t item;
+    std::string model_name;
+    std::shared_ptr<BatchedRequest> request;
+    std::shared_ptr<std::vector<std::string>> outputs;
+    std::future<void> done;
+  };
+  std::vector<Running> running;
+  // Tüm worker'lar dolu tutulur; gerçek zamanlı istekler yine önce alınır.
+  auto* batcher = engine_->get_batcher();
+  size_t window = std::max<size_t>(batcher->get_worker_count(), 1);
+
+  auto fail = [this, &job](size_t index, const std::string& code,
+                           const std::string& message) {
+    record_result(*job,
+                  {{"id", job->id + "_req_" + std::to_string(index)},
+                   {"custom_id", job->items[index].custom_id},
+                   {"response", nullptr},
+                   {"error", {{"code", code}, {"message", message}}}},
+                  false);
+  };
+
+  while (!todo.empty() || !running.empty()) {
+    if (job->cancel_requested) todo.clear();
+
+    while (!todo.empty() && running.size() < window &&
+           engine_->is_accepting()) {
+      size_t index = todo.front();
+      todo.pop_front();
+      const Item& item = job->items[index];
+
+      Running run{index, "", nullptr, nullptr, {}};
+      try {
+        run.request = chat_.prepare_request(item.body, run.model_name);
+      } catch (const ChatController::RequestError& e) {
+        if (e.code == "model_loading") {
+          // Profil arka planda yükleniyor; sonra yeniden denenir.
+          todo.push_front(index);
+          break;
+        }
+        fail(index, e.code.empty() ? "invalid_request" : e.code, e.what());
+        continue;
+      } catch (const std::exception& e) {
+        fail(index, "invalid_request", e.what());
+        continue;
+      }
+      run.request->background = true;
+      run.request->trace_id = job->trace_id;
+      run.request->span_id = item.custom_id;
+      run.request->tenant_id = job->tenant_id;
+      run.outputs =
+          std::make_shared<std::vector<std::string>>(run.request->n_choices);
+      // Okuyan bağlantı yok: kanal üretici thread'inde boşaltılır.
+      BatchedRequest* raw = run.request.get();
+      auto outputs = run.outputs;
+      run.request->on_tokens_ready = [raw, outputs]() {
+        raw->tokens.drain([&outputs](const TokenChannel::Token& t) {
+          (*outputs)[t.choice].append(t.text);
+        });
+      };
+      std::weak_ptr<Job> weak_job = job;
+      run.request->should_stop_callback = [weak_job]() {
+        auto j = weak_job.lock();
+        return !j || j->cancel_requested;
+      };
+      run.done = batcher->add_request(run.request);
+      running.push_back(std::move(run));
+    }
+
+    if (running.empty()) {
+      // Drain veya model yükleniyor: kabul açılana ya da iş iptal edilene
+      // kadar beklenir.
+      if (!todo.empty()) std::this_thread::sleep_for(std::chrono::seconds(1));
+      continue;
+    }
+
+    running.front().done.wait_for(std::chrono::milliseconds(20));
+    for (auto it = running.begin(); it != running.end();) {
+      if (it->done.wait_for(std::chrono::seconds(0)) !=
+          std::future_status::ready) {
+        ++it;
+        continue;
+      }
+      Running run = std::move(*it);
+      it = running.erase(it);
+      try {
+        run.done.get();
+      } catch (const std::exception& e) {
+        fail(run.item, "internal_error", e.what());
+        continue;
+      }
+
+      const std::string& reason = run.request->finish_reason;
+      if (reason == "preempted" || reason == "draining" ||
+          reason == "aborted" || reason == "model_loading") {
+        // Gerçek zamanlı trafiğe yer açıldı: baştan denenir. Prompt'un KV'si
+        // büyük olasılıkla hâlâ önbellekte.
+        if (!job->cancel_requested) todo.push_front(run.item);
+        continue;
+      }
+      if (reason == "cancelled") {
+        fail(run.item, "batch_cancelled", "Batch was cancelled");
+        continue;
+      }
+      if (reason == "model_unavailable" || reason == "error" ||
+          reason == "internal_error" || reason == "length_error") {
+        fail(run.item, reason, "Request failed: " + reason);
+        continue;
+      }
+      record_result(
+          *job,
+          {{"id", job->id + "_req_" + std::to_string(run.item)},
+           {"custom_id", job->items[run.item].custom_id},
+           {"response",
+            {{"status_code", 200},
+             {"body", chat_.build_completion(*run.request, *run.outputs,
+                                             run.model_name)}}},
+           {"error", nullptr}},
+          true);
+    }
+  }
+}
+
+void BatchController::record_result(Job& job, const json& line, bool ok) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job.results.push_back(line.dump());
+    if (ok) {
+      job.completed++;
+    } else {
+      job.failed++;
+    }
+  }
+  results_cv_.notify_all();
+}
+
+json BatchController::describe_locked(const Job& job) const {
+  return {{"id", job.id},
+          {"object", "batch"},
+          {"endpoint", "/v1/chat/completions"},
+          {"status", job.status},
+          {"created_at", job.created_at},
+          {"completed_at",
+           job.completed_at ? json(job.completed_at) : json(nullptr)},
+          {"request_counts",
+           {{"total", job.items.size()},
+            {"completed", job.completed},
+            {"failed", job.failed}}}};
+}
+
+void BatchController::evict_finished_locked() {
+  int64_t cutoff = std::time(nullptr) -
+                   std::chrono::seconds(kFinishedJobTtl).count();
+  for (auto it = jobs_.begin(); it != jobs_.end();) {
+    const Job& job = *it->second;
+    if (is_finished(job.status) && job.completed_at < cutoff) {
+      it = jobs_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::shared_ptr<BatchController::Job> BatchController::find_job(
+    const httplib::Request& req, httplib::Response& res) {
+  std::string id = req.matches[1];
+  std::string tenant_id = req.get_header_value("x-tenant-id");
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = jobs_.find(id);
+  // Başka kiracının işi yokmuş gibi davranır.
+  if (it == jobs_.end() || it->second->tenant_id != tenant_id) {
+    reject(res, 404, "Unknown batch: " + id);
+    return nullptr;
+  }
+  return it->second;
+}
+
+void BatchController::handle_create(const httplib::Request& req,
+                                    httplib::Response& res) {
+  res.set_header("Access-Control-Allow-Origin", "*");
+  std::string tenant_id = req.get_header_value("x-tenant-id");
+  std::string trace_id = req.get_header_value("x-trace-id");
+  if (trace_id.empty()) trace_id = "unknown";
+  if (tenant_id.empty() || tenant_id == "unknown") {
+    SUTS_ERROR("MISSING_TENANT_ID", trace_id, "unknown", "unknown",
+               "Tenant ID is missing in HTTP headers. Request rejected.");
+    reject(res, 400, "tenant_id header is strictly required");
+    return;
+  }
+  if (!engine_->is_accepting()) {
+    res.set_header("Retry-After", "1");
+    reject(res, 503, "Model is loading or the server is shutting down",
+           "server_error");
+    return;
+  }
+
+  auto job = std::make_shared<Job>();
+  job->tenant_id = tenant_id;
+  job->trace_id = trace_id;
+  job->created_at = std::time(nullptr);
+
+  size_t max_requests = engine_->get_settings().batch_max_requests;
+  std::istringstream lines(req.body);
+  std::string line;
+  size_t line_no = 0;
+  while (std::getline(lines, line)) {
+    ++line_no;
+    if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+    try {
+      json entry = json::parse(line);
+      if (!entry.contains("body") || !entry["body"].is_object()) {
+        throw std::invalid_argument("'body' object is required");
+      }
+      if (entry.value("url", "/v1/chat/completions") !=
+          "/v1/chat/completions") {
+        throw std::invalid_argument(
+            "only /v1/chat/completions is supported");
+      }
+      Item item;
+      item.custom_id = entry.value("custom_id", std::to_string(line_no));
+      item.prefix_key = prefix_key(entry["body"]);
+      item.body = std::move(entry["body"]);
+      job->items.push_back(std::move(item));
+    } catch (const std::exception& e) {
+      reject(res, 400,
+             "Line " + std::to_string(line_no) + ": " + e.what());
+      return;
+    }
+    if (job->items.size() > max_requests) {
+      reject(res, 400,
+             "Batch exceeds " + std::to_string(max_requests) + " requests");
+      return;
+    }
+  }
+  if (job->items.empty()) {
+    reject(res, 400, "Batch body must be JSONL with at least one request");
+    return;
+  }
+
+  json description;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    evict_finished_locked();
+    job->id = "batch_" + std::to_string(job->created_at) + "_" +
+              std::to_string(next_id_++);
+    jobs_[job->id] = job;
+    pending_.push_back(job);
+    description = describe_locked(*job);
+  }
+  cv_.notify_one();
+
+  SUTS_INFO("BATCH_JOB_CREATED", trace_id, "unknown", tenant_id,
+            "📦 Batch {} queued with {} requests.", job->id,
+            job->items.size());
+  res.set_content(description.dump(), "application/json");
+}
+
+void BatchController::handle_get(const httplib::Request& req,
+                                 httplib::Response& res) {
+  res.set_header("Access-Control-Allow-Origin", "*");
+  auto job = find_job(req, res);
+  if (!job) return;
+  std::lock_guard<std::mutex> lock(mutex_);
+  res.set_content(describe_locked(*job).dump(), "application/json");
+}
+
+void BatchController::handle_results(const httplib::Request& req,
+                                     httplib::Response& res) {
+  res.set_header("Access-Control-Allow-Origin", "*");
+  auto job = find_job(req, res);
+  if (!job) return;
+
+  if (req.get_param_value("stream") != "true") {
+    std::string body;
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& result : job->results) {
+      body += result;
+      body += '\n';
+    }
+    res.set_content(body, "application/x-ndjson");
+    return;
+  }
+
+  res.set_chunked_content_provider(
+      "application/x-ndjson",
+      [this, job, sent = size_t(0)](size_t,
+                                    httplib::DataSink& sink) mutable {
+        if (!sink.is_writable()) return false;
+        std::string chunk;
+        bool done;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          results_cv_.wait_for(lock, std::chrono::seconds(1), [&] {
+            return stopping_ || is_finished(job->status) ||
+                   job->results.size() > sent;
+          });
+          for (; sent < job->results.size(); ++sent) {
+            chunk += job->results[sent];
+            chunk += '\n';
+          }
+          done = stopping_ || is_finished(job->status);
+        }
+        if (!chunk.empty() && !sink.write(chunk.data(), chunk.size())) {
+          return false;
+        }
+        if (done) sink.done();
+        return true;
+      });
+}
+
+void BatchController::handle_cancel(const httplib::Request& req,
+                                    httplib::Response& res) {
+  res.set_header("Access-Control-Allow-Origin", "*");
+  auto job = find_job(req, res);
+  if (!job) return;
+  json description;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job->cancel_requested = true;
+    if (job->status == "queued") {
+      pending_.erase(std::remove(pending_.begin(), pending_.end(), job),
+                     pending_.end());
+      job->status = "cancelled";
+      job->completed_at = std::time(nullptr);
+    } else if (job->status == "in_progress") {
+      // Çalışan istekler bir sonraki token'da durur.
+      job->status = "cancelling";
+    }
+    description = describe_locked(*job);
+  }
+  results_cv_.notify_all();
+  res.set_content(description.dump(), "application/json");
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "controllers/chat_controller.h"
+#include "httplib.h"
+#include "llm_engine.h"
+#include "nlohmann/json.hpp"
+
+// Çevrimdışı batch işleri (OpenAI /v1/batches benzeri). Gövde JSONL'dir;
+// her satır {"custom_id": "...", "body": {chat completions gövdesi}}.
+// İşler bellekte tutulur ve tek dispatcher thread'inde sırayla çalışır.
+// İstekler arka plan önceliğiyle kuyruğa girer: worker'lar ancak gerçek
+// zamanlı istek yokken alır, gerçek zamanlı istek gelince token sınırında
+// bırakılıp yeniden denenir (bkz. BatchedRequest::background).
+class BatchController {
+ public:
+  BatchController(std::shared_ptr<LLMEngine> engine, ChatController& chat);
+  ~BatchController();
+
+  void handle_create(const httplib::Request& req, httplib::Response& res);
+  void handle_get(const httplib::Request& req, httplib::Response& res);
+  // Tamamlanan sonuçlar (JSONL). ?stream=true: iş bitene kadar sonuçlar
+  // geldikçe yazılır.
+  void handle_results(const httplib::Request& req, httplib::Response& res);
+  void handle_cancel(const httplib::Request& req, httplib::Response& res);
+
+ private:
+  struct Item {
+    std::string custom_id;
+    nlohmann::json body;
+    // Prompt'un başını belirleyen alanlar; aynı anahtarlı istekler art
+    // arda çalışır ve context havuzunun önek önbelleğini paylaşır.
+    std::string prefix_key;
+  };
+
+  struct Job {
+    std::string id;
+    std::string tenant_id;
+    std::string trace_id;
+    int64_t created_at = 0;
+    std::vector<Item> items;
+    std::atomic<bool> cancel_requested{false};
+    // Aşağıdakiler mutex_ altında.
+    std::string status = "queued";
+    int64_t completed_at = 0;
+    size_t completed = 0;
+    size_t failed = 0;
+    std::vector<std::string> results;  // Tamamlanma sırasıyla JSONL satırı
+  };
+
+  void dispatcher_loop();
+  void run_job(const std::shared_ptr<Job>& job);
+  void record_result(Job& job, const nlohmann::json& line, bool ok);
+  nlohmann::json describe_locked(const Job& job) const;
+  // İstek yolundaki id'ye ve kiracıya göre iş; yoksa 404 yazar.
+  std::shared_ptr<Job> find_job(const httplib::Request& req,
+                                httplib::Response& res);
+  // Bitmiş ve saklama süresini aşmış işleri atar (mutex_ altında).
+  void evict_finished_locked();
+
+  static constexpr std::chrono::hours kFinishedJobTtl{24};
+
+  std::shared_ptr<LLMEngine> engine_;
+  ChatController& chat_;
+
+  std::mutex mutex_;
+  std::condition_variable cv_;          // Yeni iş veya kapanış
+  std::condition_variable results_cv_;  // Yeni sonuç (akış okuyucuları)
+  std::map<std::string, std::shared_ptr<Job>> jobs_;
+  std::deque<std::shared_ptr<Job>> pending_;
+  uint64_t next_id_ = 0;
+  bool stopping_ = false;
+  std::thread dispatcher_;
+};
@@ -5,6 +5,9 @@
 #include <chrono>
 #include <vector>
 
+#include "core/sentence_chunker.h"
+#include "core/sse_serializer.h"
+#include "core/stream_coalescer.h"
 #include "suts_logger.h"
 
 using json = nlohmann::json;
@@ -34,15 +37,12 @@ bool ChatController::has_incomplete_utf8_suffix(const std::string& str) {
   return false;
 }
 
-std::string ChatController::sanitize_token(const std::string& input) {
-  std::string clean = input;
-  clean.erase(std::remove_if(
-                  clean.begin(), clean.end(),
-                  [](unsigned char c) {
-                    return (c < 32 && c != 9 && c != 10 && c != 13) || c == 127;
-                  }),
-              clean.end());
-  return clean;
+void ChatController::append_sanitized(std::string& out,
+                                      std::string_view token) {
+  for (unsigned char c : token) {
+    if ((c < 32 && c != 9 && c != 10 && c != 13) || c == 127) continue;
+    out.push_back(static_cast<char>(c));
+  }
 }
 
 std::string ChatController::get_reasoning_instruction(
@@ -56,12 +56,42 @@ std::string ChatController::get_reasoning_instruction(
   return "";
 }
 
-sentiric::llm::v1::GenerateStreamRequest ChatController::build_grpc_request(
-    const json& body, const std::string& reasoning_prompt) {
-  sentiric::llm::v1::GenerateStreamRequest grpc_request;
+void ChatController::reject_unavailable(httplib::Response& res,
+                                        const std::string& message) {
+  res.status = 503;
+  res.set_header("Retry-After", "1");
+  res.set_content(
+      json({{"error", {{"message", message}, {"type", "server_error"}}}})
+          .dump(),
+      "application/json");
+}
+
+std::optional<std::string> ChatController::resolve_model_profile(
+    const json& body) {
+  if (body.contains("profile") && body["profile"].is_string()) {
+    std::string profile = body["profile"].get<std::string>();
+    if (!engine_->has_profile(profile)) return std::nullopt;
+    return profile;
+  }
+  if (body.contains("model") && body["model"].is_string()) {
+    // OpenAI istemcileri rastgele model isimleri gönderebilir; tanınmayan
+    // isim varsayılan modele düşer.
+    std::string model = body["model"].get<std::string>();
+    if (engine_->has_profile(model)) return model;
+    return engine_->find_profile_by_model_id(model);
+  }
+  return std::string();
+}
+
+void ChatController::build_grpc_request(
+    const json& body, const std::string& reasoning_prompt,
+    const std::string& model_profile,
+    sentiric::llm::v1::GenerateStreamRequest& grpc_request) {
   const auto& settings = engine_->get_settings();
 
-  std::string system_prompt = settings.template_system_prompt;
+  // Başka bir profile yönlenen istekte o profilin kendi şablonu kullanılır.
+  std::string system_prompt =
+      model_profile.empty() ? settings.template_system_prompt : "";
 
   if (body.contains("system_prompt") && body["system_prompt"].is_string()) {
     system_prompt = body["system_prompt"].get<std::string>();
@@ -113,15 +143,16 @@ sentiric::llm::v1::GenerateStreamRequest ChatController::build_grpc_request(
     params->set_temperature(body["temperature"]);
   if (body.contains("top_p")) params->set_top_p(body["top_p"]);
   if (body.contains("top_k")) params->set_top_k(body["top_k"]);
-
-  return grpc_request;
 }
 
 void ChatController::handle_streaming_response(
-    std::shared_ptr<BatchedRequest> batched_request, httplib::Response& res) {
+    std::shared_ptr<BatchedRequest> batched_request,
+    const std::string& model_name, httplib::Response& res) {
+  open_streams_++;
   res.set_chunked_content_provider(
       "text/event-stream",
-      [this, batched_request, pending_data = std::string("")](
+      [this, batched_request, model_id = model_name,
+       pending_data = std::string("")](
           size_t, httplib::DataSink& sink) mutable {
         // [ARCH-COMPLIANCE FIX]: HTTP İstemcisi bağlantıyı kestiğinde LLM
         // motorunu durdur.
@@ -129,54 +160,141 @@ void ChatController::handle_streaming_response(
           return !sink.is_writable();
         };
 
-        while (!batched_request->is_finished ||
-               !batched_request->token_queue.empty()) {
-          std::string token;
-          if (batched_request->token_queue.wait_and_pop(token, 50)) {
-            if (!batched_request->first_token_emitted.exchange(true)) {
-              auto now = std::chrono::steady_clock::now();
-              std::chrono::duration<double, std::milli> ttft =
-                  now - batched_request->creation_time;
-              batched_request->ttft_ms = ttft.count();
-              SUTS_DEBUG("HTTP_TTFT_COMPUTED", batched_request->trace_id,
-                         batched_request->span_id, batched_request->tenant_id,
-                         "⚡ HTTP TTFT: {:.2f} ms",
-                         batched_request->ttft_ms.load());
-            }
-
-            std::string clean_token = sanitize_token(token);
-            if (clean_token.empty()) continue;
+        // Cümle modunda her çerçeve bir cümle/yan cümledir ve 'final'
+        // bayrağı taşır; son çerçeve (boş olsa da) final=true'dur.
+        bool sentences = batched_request->sentence_chunks;
+        SentenceChunker chunker;
+        // Çerçeve şablonu akış başına bir kez kurulur; id ve created sabit.
+        std::time_t created = std::time(nullptr);
+        SseChunkSerializer serializer("chatcmpl-" + std::to_string(created),
+                                      model_id, created, sentences);
+        auto write_chunk = [&](std::string_view content, bool final,
+                               uint32_t index = 0) {
+          const std::string& data = serializer.chunk(content, final, index);
+          return sink.write(data.data(), data.size());
+        };
+        auto record_ttft = [&batched_request]() {
+          if (batched_request->first_token_emitted.exchange(true)) return;
+          auto now = std::chrono::steady_clock::now();
+          std::chrono::duration<double, std::milli> ttft =
+              now - batched_request->creation_time;
+          batched_request->ttft_ms = ttft.count();
+          SUTS_DEBUG("HTTP_TTFT_COMPUTED", batched_request->trace_id,
+                     batched_request->span_id, batched_request->tenant_id,
+                     "⚡ HTTP TTFT: {:.2f} ms", batched_request->ttft_ms.load());
+        };
 
-            pending_data += clean_token;
+        auto& channel = batched_request->tokens;
+        if (batched_request->n_choices > 1) {
+          // n > 1: her drain'de bekleyen her seçenek için bir çerçeve
+          // (choices[0].index = seçenek). Kanal kapanınca aşağıdaki tek
+          // seçenek döngüsü çalışmaz.
+          std::vector<std::string> pending(batched_request->n_choices);
+          while (!channel.finished()) {
+            channel.wait(std::chrono::milliseconds(50));
+            size_t drained = channel.drain([&](const TokenChannel::Token& t) {
+              append_sanitized(pending[t.choice], t.text);
+            });
+            if (drained > 0) record_ttft();
+            for (uint32_t i = 0; i < pending.size(); ++i) {
+              if (pending[i].empty() || has_incomplete_utf8_suffix(pending[i]))
+                continue;
+              if (!write_chunk(pending[i], false, i)) return false;
+              pending[i].clear();
+            }
+          }
+          for (uint32_t i = 0; i < pending.size(); ++i) {
+            if (!pending[i].empty()) write_chunk(pending[i], false, i);
+          }
+        }
+        StreamCoalescer coalescer(
+            sentences ? 0 : batched_request->min_chunk_bytes,
+            batched_request->max_flush_interval);
+        while (!channel.finished()) {
+          // Futex ile uyanır; o an hazır olan tüm token'lar tek SSE
+          // çerçevesinde gider. Birleştirme açıksa bekleme, bekleyen
+          // çerçevenin son tarihinde biter.
+          channel.wait(coalescer.wait_budget(std::chrono::milliseconds(50)));
+          size_t drained = channel.drain([&](const TokenChannel::Token& t) {
+            append_sanitized(pending_data, t.text);
+          });
+          if (drained == 0 && !coalescer.has_pending()) continue;
+
+          if (drained > 0) record_ttft();
+
+          if (pending_data.empty()) continue;
+          coalescer.on_append();
+
+          if (has_incomplete_utf8_suffix(pending_data)) {
+            continue;
+          }
 
-            if (has_incomplete_utf8_suffix(pending_data)) {
-              continue;
+          if (sentences) {
+            chunker.append(pending_data);
+            pending_data.clear();
+            coalescer.on_flush();
+            std::string sentence;
+            while (chunker.next(sentence)) {
+              if (!write_chunk(sentence, false)) return false;
             }
+            continue;
+          }
 
-            json chunk;
-            chunk["id"] = "chatcmpl-" + std::to_string(std::time(nullptr));
-            chunk["object"] = "chat.completion.chunk";
-            chunk["created"] = std::time(nullptr);
-            chunk["model"] = engine_->get_settings().model_id;
-            chunk["choices"][0]["index"] = 0;
-            chunk["choices"][0]["delta"]["content"] = pending_data;
+          if (!coalescer.should_flush(pending_data.size(), false)) continue;
+          if (!write_chunk(pending_data, false)) return false;
+          pending_data.clear();
+          coalescer.on_flush();
+        }
 
-            std::string data = "data: " + chunk.dump() + "\n\n";
-            if (!sink.write(data.c_str(), data.length())) return false;
+        if (sentences) {
+          write_chunk(chunker.flush() + pending_data, true);
+        } else if (!pending_data.empty()) {
+          write_chunk(pending_data, false);
+        }
 
-            pending_data.clear();
-          }
+        // İstemci tamponu taşırdı (abort politikası veya okumayı bıraktı).
+        if (batched_request->finish_reason == "overflow") {
+          std::string data =
+              "data: " +
+              json({{"error",
+                     {{"message", "Client is not reading the stream fast "
+                                  "enough"},
+                      {"type", "server_error"},
+                      {"code", "stream_overflow"}}}})
+                  .dump() +
+              "\n\n";
+          sink.write(data.c_str(), data.length());
+        }
+        // Kabulden sonra profil bellekten atıldı (yükleme arka planda) ya
+        // da model yayından kalktı (başarısız soğuk değişim).
+        const std::string& reason = batched_request->finish_reason;
+        if (reason == "model_loading" || reason == "model_unavailable") {
+          std::string message =
+              reason == "model_loading" ? "Model '" + model_id + "' is loading"
+                                        : "Model '" + model_id +
+                                              "' is not available";
+          std::string data = "data: " +
+                             json({{"error",
+                                    {{"message", message},
+                                     {"type", "server_error"},
+                                     {"code", reason}}}})
+                                 .dump() +
+                             "\n\n";
+          sink.write(data.c_str(), data.length());
         }
 
-        if (!pending_data.empty()) {
-          json chunk;
-          chunk["id"] = "chatcmpl-" + std::to_string(std::time(nullptr));
-          chunk["object"] = "chat.completion.chunk";
-          chunk["created"] = std::time(nullptr);
-          chunk["model"] = engine_->get_settings().model_id;
-          chunk["choices"][0]["index"] = 0;
-          chunk["choices"][0]["delta"]["content"] = pending_data;
-          std::string data = "data: " + chunk.dump() + "\n\n";
+        if (batched_request->stream_cache_info &&
+            !batched_request->cache_fingerprint.empty()) {
+          std::string data =
+              "data: " +
+              json({{"id", "chatcmpl-" + std::to_string(created)},
+                    {"object", "chat.completion.chunk"},
+                    {"created", created},
+                    {"model", model_id},
+                    {"choices", json::array()},
+                    {"cache", cache_info(*batched_request)}})
+                  .dump() +
+              "\n\n";
           sink.write(data.c_str(), data.length());
         }
 
@@ -191,34 +309,82 @@ void ChatController::handle_streaming_response(
                   batched_request->ttft_ms.load());
 
         return true;
-      });
+      },
+      [this](bool) { open_streams_--; });
 }
 
-void ChatController::handle_unary_response(
-    std::shared_ptr<BatchedRequest> batched_request,
-    std::future<void>& completion_future, httplib::Response& res) {
-  completion_future.wait();
-  std::string full_response;
-  while (!batched_request->token_queue.empty()) {
-    std::string t;
-    if (batched_request->token_queue.wait_and_pop(t, 0)) full_response += t;
-  }
-
+json ChatController::build_completion(const BatchedRequest& request,
+                                      std::vector<std::string>& outputs,
+                                      const std::string& model_name) {
   json response_json;
   response_json["id"] = "chatcmpl-" + std::to_string(std::time(nullptr));
   response_json["object"] = "chat.completion";
   response_json["created"] = std::time(nullptr);
-  response_json["model"] = engine_->get_settings().model_id;
-  response_json["choices"][0]["index"] = 0;
-  response_json["choices"][0]["message"]["role"] = "assistant";
-  response_json["choices"][0]["message"]["content"] = full_response;
-  response_json["choices"][0]["finish_reason"] = batched_request->finish_reason;
-  response_json["usage"]["prompt_tokens"] = batched_request->prompt_tokens;
-  response_json["usage"]["completion_tokens"] =
-      batched_request->completion_tokens;
+  response_json["model"] = model_name;
+  const auto& reasons = request.choice_finish_reasons;
+  for (size_t i = 0; i < outputs.size(); ++i) {
+    auto& choice = response_json["choices"][i];
+    choice["index"] = i;
+    choice["message"]["role"] = "assistant";
+    choice["message"]["content"] = std::move(outputs[i]);
+    choice["finish_reason"] =
+        i < reasons.size() ? reasons[i] : request.finish_reason;
+  }
+  response_json["usage"]["prompt_tokens"] = request.prompt_tokens;
+  response_json["usage"]["completion_tokens"] = request.completion_tokens;
   response_json["usage"]["total_tokens"] =
-      batched_request->prompt_tokens + batched_request->completion_tokens;
-  res.set_content(response_json.dump(), "application/json");
+      request.prompt_tokens + request.completion_tokens;
+  if (!request.cache_fingerprint.empty()) {
+    response_json["cache"] = cache_info(request);
+  }
+  return response_json;
+}
+
+json ChatController::cache_info(const BatchedRequest& request) {
+  return {{"fingerprint", request.cache_fingerprint},
+          {"prefix_tokens", request.cache_prefix_tokens}};
+}
+
+void ChatController::handle_unary_response(
+    std::shared_ptr<BatchedRequest> batched_request,
+    std::future<void>& completion_future, const std::string& model_name,
+    httplib::Response& res) {
+  // Kanal sınırlı: üretim sürerken okunmalı ki uzun yanıtlar takılmasın.
+  std::vector<std::string> outputs(batched_request->n_choices);
+  auto& channel = batched_request->tokens;
+  while (!channel.finished()) {
+    channel.wait(std::chrono::milliseconds(50));
+    channel.drain([&outputs](const TokenChannel::Token& t) {
+      outputs[t.choice].append(t.text);
+    });
+  }
+  completion_future.wait();
+
+  if (batched_request->finish_reason == "aborted") {
+    reject_unavailable(res, "Server shut down before the request completed");
+    return;
+  }
+  if (batched_request->finish_reason == "model_loading") {
+    reject_unavailable(res, "Model '" + model_name + "' is loading");
+    return;
+  }
+  if (batched_request->finish_reason == "model_unavailable") {
+    res.status = 503;
+    res.set_content(
+        json({{"error",
+               {{"message", "Model '" + model_name + "' could not be loaded"},
+                {"type", "server_error"}}}})
+            .dump(),
+        "application/json");
+    return;
+  }
+
+  if (!batched_request->cache_fingerprint.empty()) {
+    res.set_header("x-cache-fingerprint", batched_request->cache_fingerprint);
+  }
+  res.set_content(
+      build_completion(*batched_request, outputs, model_name).dump(),
+      "application/json");
 
   SUTS_INFO("HTTP_UNARY_COMPLETE", batched_request->trace_id,
             batched_request->span_id, batched_request->tenant_id,
@@ -226,6 +392,106 @@ void ChatController::handle_unary_response(
             batched_request->completion_tokens);
 }
 
+std::shared_ptr<BatchedRequest> ChatController::prepare_request(
+    const json& body, std::string& model_name) {
+  std::string reasoning_level = body.value("reasoning_effort", "none");
+  std::string reasoning_prompt = get_reasoning_instruction(reasoning_level);
+
+  auto model_profile = resolve_model_profile(body);
+  if (!model_profile) {
+    throw RequestError(
+        404, "Unknown model profile: " + body.value("profile", std::string()),
+        "model_not_found");
+  }
+  if (!model_profile->empty()) {
+    // Bellekte olmayan profil arka planda yüklenir; istemci yeniden dener.
+    auto state = engine_->prepare_profile(*model_profile);
+    if (state == LLMEngine::ProfileState::kLoading) {
+      throw RequestError(503, "Model '" + *model_profile + "' is loading",
+                         "model_loading");
+    }
+    if (state == LLMEngine::ProfileState::kUnavailable) {
+      throw RequestError(
+          503, "Model '" + *model_profile + "' could not be loaded",
+          "model_unavailable");
+    }
+  }
+  model_name.clear();
+  if (body.contains("model") && body["model"].is_string()) {
+    model_name = body["model"].get<std::string>();
+  }
+  if (model_name.empty()) {
+    model_name = model_profile->empty() ? engine_->get_settings().model_id
+                                        : *model_profile;
+  }
+
+  // OpenAI 'n': aynı prompt'tan bağımsız seçenekler (prompt bir kez
+  // işlenir).
+  int n_choices = body.value("n", 1);
+  uint32_t max_choices = engine_->get_settings().max_choices;
+  if (n_choices < 1 || static_cast<uint32_t>(n_choices) > max_choices) {
+    throw RequestError(
+        400, "n must be between 1 and " + std::to_string(max_choices));
+  }
+  if (!engine_->choices_fit(*model_profile, n_choices,
+                            body.value("max_tokens", int64_t{0}))) {
+    throw RequestError(400, "n x max_tokens exceeds the context size");
+  }
+
+  // İstek bazında birleştirme: {"stream_options": {"min_chunk_bytes": 64,
+  // "max_flush_interval_ms": 80}} ya da TTS için cümle başına çerçeve:
+  // {"stream_options": {"chunking": "sentence"}}. "include_cache": true
+  // akış sonuna önek parmak izi çerçevesi ekler.
+  const json* stream_options = nullptr;
+  if (body.contains("stream_options") && body["stream_options"].is_object())
+    stream_options = &body["stream_options"];
+
+  // Mesaj doğrudan istek arena'sında kurulur; kopya yapılmaz.
+  auto batched_request = engine_->new_request();
+  build_grpc_request(body, reasoning_prompt, *model_profile,
+                     *batched_request->create_request());
+  batched_request->model_profile = *model_profile;
+  if (stream_options) {
+    batched_request->sentence_chunks =
+        stream_options->value("chunking", "") == "sentence";
+    batched_request->min_chunk_bytes = stream_options->value(
+        "min_chunk_bytes", batched_request->min_chunk_bytes);
+    int interval_ms = stream_options->value(
+        "max_flush_interval_ms",
+        static_cast<int>(batched_request->max_flush_interval.count()));
+    batched_request->max_flush_interval =
+        std::chrono::milliseconds(std::max(interval_ms, 1));
+    batched_request->stream_cache_info =
+        stream_options->value("include_cache", false);
+  }
+  batched_request->n_choices = n_choices;
+  if (n_choices > 1) {
+    // Seçenekler tek kanalda karışık gelir; birleştirme ve cümle modu
+    // tek seçenekli akışlar içindir.
+    batched_request->sentence_chunks = false;
+    batched_request->min_chunk_bytes = 0;
+  }
+
+  if (body.contains("response_format") &&
+      body["response_format"].value("type", "") == "json_object") {
+    batched_request->grammar = R"(
+root   ::= object
+value  ::= object | array | string | number | ("true" | "false" | "null")
+object ::= "{" ws ( members )? "}"
+members ::= pair ( "," ws pair )*
+pair   ::= string ":" ws value
+array  ::= "[" ws ( elements )? "]"
+elements ::= value ( "," ws value )*
+string ::= "\"" ([^"\\] | "\\" .)* "\"" ws
+number ::= ("-"? ([0-9] | [1-9] [0-9]*)) ("." [0-9]+)? ([eE] [-+]? [0-9]+)? ws
+ws     ::= [ \t\n\r]*
+)";
+  } else if (body.contains("grammar")) {
+    batched_request->grammar = body["grammar"].get<std::string>();
+  }
+  return batched_request;
+}
+
 void ChatController::handle_chat_completions(const httplib::Request& req,
                                              httplib::Response& res) {
   res.set_header("Access-Control-Allow-Origin", "*");
@@ -252,58 +518,49 @@ void ChatController::handle_chat_completions(const httplib::Request& req,
   }
 
   try {
-    if (!engine_->is_model_loaded()) {
-      res.status = 503;
-      res.set_content(json({{"error",
-                             {{"message", "Model is loading or not ready"},
-                              {"type", "server_error"}}}})
-                          .dump(),
-                      "application/json");
+    if (!engine_->is_accepting()) {
+      bool draining = engine_->get_state() == EngineState::kDraining;
+      reject_unavailable(res, draining ? "Server is shutting down"
+                                       : "Model is loading or not ready");
       return;
     }
 
     json body = json::parse(req.body);
-    std::string reasoning_level = body.value("reasoning_effort", "none");
-    std::string reasoning_prompt = get_reasoning_instruction(reasoning_level);
-
-    auto grpc_request = build_grpc_request(body, reasoning_prompt);
     bool stream = body.value("stream", false);
-
-    auto batched_request = std::make_shared<BatchedRequest>();
-    batched_request->request = grpc_request;
+    std::string model_name;
+    auto batched_request = prepare_request(body, model_name);
     batched_request->trace_id = trace_id;
     batched_request->span_id = span_id;
     batched_request->tenant_id = tenant_id;
 
     SUTS_INFO("HTTP_CHAT_REQUEST", trace_id, span_id, tenant_id,
-              "New HTTP Chat Completion Request");
-
-    if (body.contains("response_format") &&
-        body["response_format"].value("type", "") == "json_object") {
-      batched_request->grammar = R"(
-root   ::= object
-value  ::= object | array | string | number | ("true" | "false" | "null")
-object ::= "{" ws ( members )? "}"
-members ::= pair ( "," ws pair )*
-pair   ::= string ":" ws value
-array  ::= "[" ws ( elements )? "]"
-elements ::= value ( "," ws value )*
-string ::= "\"" ([^"\\] | "\\" .)* "\"" ws
-number ::= ("-"? ([0-9] | [1-9] [0-9]*)) ("." [0-9]+)? ([eE] [-+]? [0-9]+)? ws
-ws     ::= [ \t\n\r]*
-)";
-    } else if (body.contains("grammar")) {
-      batched_request->grammar = body["grammar"].get<std::string>();
-    }
+              "New HTTP Chat Completion Request (profile: '{}')",
+              batched_request->model_profile.empty()
+                  ? "default"
+                  : batched_request->model_profile);
 
     auto completion_future =
         engine_->get_batcher()->add_request(batched_request);
+    // Kabul kontrolü ile kuyruğa ekleme arasında drain başlamış olabilir.
+    if (batched_request->finish_reason == "draining") {
+      reject_unavailable(res, "Server is shutting down");
+      return;
+    }
 
     if (stream) {
-      handle_streaming_response(batched_request, res);
+      handle_streaming_response(batched_request, model_name, res);
     } else {
-      handle_unary_response(batched_request, completion_future, res);
+      handle_unary_response(batched_request, completion_future, model_name,
+                            res);
     }
+  } catch (const RequestError& e) {
+    res.status = e.status;
+    if (e.status == 503) res.set_header("Retry-After", "1");
+    json error = {{"message", e.what()},
+                  {"type", e.status == 503 ? "server_error"
+                                           : "invalid_request_error"}};
+    if (!e.code.empty()) error["code"] = e.code;
+    res.set_content(json({{"error", error}}).dump(), "application/json");
   } catch (const std::exception& e) {
     SUTS_ERROR("HTTP_HANDLER_ERROR", trace_id, span_id, tenant_id,
                "HTTP handler error: {}", e.what());
@@ -1,7 +1,12 @@
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include "httplib.h"
 #include "llm_engine.h"
@@ -15,20 +20,55 @@ class ChatController {
   void handle_chat_completions(const httplib::Request& req,
                                httplib::Response& res);
 
+  // Henüz kapanmamış SSE yanıtları (drain, bunlar bitene kadar bekler).
+  size_t get_open_streams() const { return open_streams_; }
+
+  // İstek gövdesi reddedildi: HTTP durumu ve (varsa) OpenAI hata kodu.
+  struct RequestError : std::runtime_error {
+    RequestError(int status, const std::string& message,
+                 std::string code = "")
+        : std::runtime_error(message), status(status), code(std::move(code)) {}
+    int status;
+    std::string code;
+  };
+
+  // Chat completions gövdesinden kuyruğa hazır istek kurar (profil, n,
+  // stream_options, grammar). İz alanlarını çağıran doldurur. Geçersiz
+  // gövdede RequestError; batch işleri de bunu kullanır.
+  std::shared_ptr<BatchedRequest> prepare_request(const nlohmann::json& body,
+                                                  std::string& model_name);
+  // chat.completion yanıt gövdesi; outputs seçenek başına metindir.
+  nlohmann::json build_completion(const BatchedRequest& request,
+                                  std::vector<std::string>& outputs,
+                                  const std::string& model_name);
+
  private:
+  // Yanıttaki "cache" nesnesi: {"fingerprint", "prefix_tokens"}.
+  static nlohmann::json cache_info(const BatchedRequest& request);
   std::shared_ptr<LLMEngine> engine_;
+  std::atomic<size_t> open_streams_{0};
 
   // Yardımcı fonksiyonlar (Private implementation details)
   bool has_incomplete_utf8_suffix(const std::string& str);
-  std::string sanitize_token(const std::string& input);
+  // Kontrol karakterlerini (tab/CR/LF hariç) atarak out'a ekler.
+  void append_sanitized(std::string& out, std::string_view token);
   std::string get_reasoning_instruction(const std::string& level);
+  // 503 + Retry-After: istemci başka bir replikada veya sonra denemeli.
+  void reject_unavailable(httplib::Response& res, const std::string& message);
+  // 'profile' veya 'model' alanından hedef profil ("" = varsayılan model).
+  // Açıkça istenen profil tanımlı değilse nullopt.
+  std::optional<std::string> resolve_model_profile(const nlohmann::json& body);
 
   // İstek işleme adımları
-  sentiric::llm::v1::GenerateStreamRequest build_grpc_request(
-      const nlohmann::json& body, const std::string& reasoning_prompt);
+  void build_grpc_request(
+      const nlohmann::json& body, const std::string& reasoning_prompt,
+      const std::string& model_profile,
+      sentiric::llm::v1::GenerateStreamRequest& grpc_request);
   void handle_streaming_response(
-      std::shared_ptr<BatchedRequest> batched_request, httplib::Response& res);
+      std::shared_ptr<BatchedRequest> batched_request,
+      const std::string& model_name, httplib::Response& res);
   void handle_unary_response(std::shared_ptr<BatchedRequest> batched_request,
                              std::future<void>& completion_future,
+                             const std::string& model_name,
                              httplib::Response& res);
 };
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "controllers/embedding_controller.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include "suts_logger.h"
+
+using json = nlohmann::json;
+
+namespace {
+
+// OpenAI sınırı.
+constexpr size_t kMaxInputs = 2048;
+
+// float32 dizisinin (little-endian) base64 hali; JSON sayı listesinin
+// yaklaşık dörtte biri boyutunda.
+std::string encode_base64(const std::vector<float>& values) {
+  static constexpr char kAlphabet[] =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  std::string bytes(values.size() * sizeof(float), '\0');
+  std::memcpy(bytes.data(), values.data(), bytes.size());
+
+  std::string out;
+  out.reserve((bytes.size() + 2) / 3 * 4);
+  size_t i = 0;
+  for (; i + 2 < bytes.size(); i += 3) {
+    uint32_t n = (static_cast<uint8_t>(bytes[i]) << 16) |
+                 (static_cast<uint8_t>(bytes[i + 1]) << 8) |
+                 static_cast<uint8_t>(bytes[i + 2]);
+    out += kAlphabet[(n >> 18) & 63];
+    out += kAlphabet[(n >> 12) & 63];
+    out += kAlphabet[(n >> 6) & 63];
+    out += kAlphabet[n & 63];
+  }
+  if (i < bytes.size()) {
+    uint32_t n = static_cast<uint8_t>(bytes[i]) << 16;
+    if (i + 1 < bytes.size()) n |= static_cast<uint8_t>(bytes[i + 1]) << 8;
+    out += kAlphabet[(n >> 18) & 63];
+    out += kAlphabet[(n >> 12) & 63];
+    out += i + 1 < bytes.size() ? kAlphabet[(n >> 6) & 63] : '=';
+    out += '=';
+  }
+  return out;
+}
+
+void reject(httplib::Response& res, int status, const std::string& message,
+            const std::string& type = "invalid_request_error") {
+  res.status = status;
+  res.set_content(
+      json({{"error", {{"message", message}, {"type", type}}}}).dump(),
+      "application/json");
+}
+
+}  // namespace
+
+EmbeddingController::EmbeddingController(std::shared_ptr<LLMEngine> engine)
+    : engine_(std::move(engine)) {}
+
+void EmbeddingController::handle_embeddings(const httplib::Request& req,
+                                            httplib::Response& res) {
+  res.set_header("Access-Control-Allow-Origin", "*");
+
+  std::string trace_id = req.get_header_value("x-trace-id");
+  std::string span_id = req.get_header_value("x-span-id");
+  std::string tenant_id = req.get_header_value("x-tenant-id");
+  if (trace_id.empty()) trace_id = "unknown";
+  if (span_id.empty()) span_id = "unknown";
+  if (tenant_id.empty() || tenant_id == "unknown") {
+    SUTS_ERROR("MISSING_TENANT_ID", trace_id, span_id, "unknown",
+               "Tenant ID is missing in HTTP headers. Request rejected.");
+    reject(res, 400, "tenant_id header is strictly required");
+    return;
+  }
+  if (!engine_->is_accepting()) {
+    res.set_header("Retry-After", "1");
+    reject(res, 503, "Model is loading or the server is shutting down",
+           "server_error");
+    return;
+  }
+
+  try {
+    json body = json::parse(req.body);
+
+    std::vector<std::string> inputs;
+    const json& input = body.at("input");
+    if (input.is_string()) {
+      inputs.push_back(input.get<std::string>());
+    } else if (input.is_array()) {
+      for (const auto& item : input) {
+        if (!item.is_string()) {
+          throw std::invalid_argument("'input' must contain only strings");
+        }
+        inputs.push_back(item.get<std::string>());
+      }
+    }
+    if (inputs.empty() || inputs.size() > kMaxInputs) {
+      throw std::invalid_argument(
+          "'input' must be a string or 1.." + std::to_string(kMaxInputs) +
+          " strings");
+    }
+
+    std::string encoding = body.value("encoding_format", "float");
+    if (encoding != "float" && encoding != "base64") {
+      throw std::invalid_argument(
+          "encoding_format must be 'float' or 'base64'");
+    }
+
+    // Chat ile aynı seçim: 'profile' açıkça, 'model' eşleşirse.
+    std::string profile;
+    std::string model_name = engine_->get_settings().model_id;
+    if (body.contains("profile") && body["profile"].is_string()) {
+      profile = body["profile"].get<std::string>();
+      if (!engine_->has_profile(profile)) {
+        reject(res, 404, "Unknown model profile: " + profile);
+        return;
+      }
+      model_name = profile;
+    } else if (body.contains("model") && body["model"].is_string()) {
+      model_name = body["model"].get<std::string>();
+      profile = engine_->has_profile(model_name)
+                    ? model_name
+                    : engine_->find_profile_by_model_id(model_name);
+    }
+
+    int32_t prompt_tokens = 0;
+    auto vectors = engine_->embed(profile, inputs, prompt_tokens);
+
+    json data = json::array();
+    for (size_t i = 0; i < vectors.size(); ++i) {
+      json item = {{"object", "embedding"}, {"index", i}};
+      if (encoding == "base64") {
+        item["embedding"] = encode_base64(vectors[i]);
+      } else {
+        item["embedding"] = std::move(vectors[i]);
+      }
+      data.push_back(std::move(item));
+    }
+    json response = {{"object", "list"},
+                     {"data", std::move(data)},
+                     {"model", model_name},
+                     {"usage",
+                      {{"prompt_tokens", prompt_tokens},
+                       {"total_tokens", prompt_tokens}}}};
+    res.set_content(response.dump(), "application/json");
+
+    SUTS_INFO("HTTP_EMBEDDINGS_COMPLETE", trace_id, span_id, tenant_id,
+              "Embeddings Complete. Inputs: {}, Tokens: {}", inputs.size(),
+              prompt_tokens);
+  } catch (const std::runtime_error& e) {
+    SUTS_ERROR("HTTP_EMBEDDINGS_ERROR", trace_id, span_id, tenant_id,
+               "Embeddings error: {}", e.what());
+    reject(res, 503, e.what(), "server_error");
+  } catch (const std::exception& e) {
+    reject(res, 400, e.what());
+  }
+}
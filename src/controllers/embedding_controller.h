@@ -0,0 +1,20 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "httplib.h"
+#include "llm_engine.h"
+#include "nlohmann/json.hpp"
+
+// OpenAI uyumlu /v1/embeddings. Vektörler yüklü modelin ayrı embeddings
+// context'inden gelir (bkz. EmbeddingContext).
+class EmbeddingController {
+ public:
+  explicit EmbeddingController(std::shared_ptr<LLMEngine> engine);
+
+  void handle_embeddings(const httplib::Request& req, httplib::Response& res);
+
+ private:
+  std::shared_ptr<LLMEngine> engine_;
+};
@@ -15,16 +15,27 @@ void ModelController::handle_get_models(const httplib::Request &,
   res.set_header("Access-Control-Allow-Origin", "*");
 
   const auto &current_settings = engine_->get_settings();
-  json response_body = {
-      {"object", "list"},
-      {"data",
-       {{{"id", current_settings.model_id.empty() ? "local-model"
-                                                  : current_settings.model_id},
-         {"object", "model"},
-         {"created", std::time(nullptr)},
-         {"owned_by", "system"},
-         {"active", true},
-         {"profile", current_settings.profile_name}}}}};
+  json data = json::array();
+  data.push_back(
+      {{"id", current_settings.model_id.empty() ? "local-model"
+                                                : current_settings.model_id},
+       {"object", "model"},
+       {"created", std::time(nullptr)},
+       {"owned_by", "system"},
+       {"active", true},
+       {"profile", current_settings.profile_name}});
+
+  // Bellekteki ek modeller; istekte 'model' veya 'profile' ile seçilir.
+  for (const auto &resident : engine_->get_resident_models()) {
+    if (resident.is_default) continue;
+    data.push_back({{"id", resident.model_id},
+                    {"object", "model"},
+                    {"created", std::time(nullptr)},
+                    {"owned_by", "system"},
+                    {"active", false},
+                    {"profile", resident.profile}});
+  }
+  json response_body = {{"object", "list"}, {"data", data}};
 
   res.set_content(response_body.dump(), "application/json");
 }
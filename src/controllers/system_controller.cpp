@@ -5,6 +5,8 @@
 #include <fstream>
 #include <sstream>
 
+#include "core/prefix_hash.h"
+#include "core/request_arena.h"
 #include "suts_logger.h"  // SUTS Logging eklendi
 
 namespace fs = std::filesystem;
@@ -17,27 +19,75 @@ void SystemController::handle_health(const httplib::Request &,
                                      httplib::Response &res) {
   res.set_header("Access-Control-Allow-Origin", "*");
 
-  bool model_ready = engine_->is_model_loaded();
+  auto instance = engine_->get_instance();
+  bool model_ready = instance != nullptr;
+  // Load balancer'lar HTTP koduna bakar: yalnızca kabul eden replika 200.
+  bool accepting = engine_->is_accepting();
   size_t active_ctx = 0;
   size_t total_ctx = 0;
+  size_t allocated_ctx = 0;
+  size_t kv_bytes = 0;
 
   if (model_ready) {
-    active_ctx = engine_->get_context_pool().get_active_count();
-    total_ctx = engine_->get_context_pool().get_total_count();
+    auto &pool = instance->context_pool();
+    active_ctx = pool.get_active_count();
+    total_ctx = pool.get_total_count();
+    allocated_ctx = pool.get_allocated_count();
+    kv_bytes = pool.get_context_bytes();
   }
 
   json response_body = {
-      {"status", model_ready ? "healthy" : "loading"},
+      {"status", engine_state_name(engine_->get_state())},
+      {"accepting", accepting},
+      {"in_flight", engine_->get_in_flight()},
       {"model_ready", model_ready},
       {"current_profile", engine_->get_settings().profile_name},
       {"capacity",
        {{"active", active_ctx},
         {"total", total_ctx},
+        {"allocated", allocated_ctx},
+        {"kv_bytes_per_context", kv_bytes},
         {"available", total_ctx - active_ctx}}},
       {"timestamp", std::time(nullptr)}};
 
+  json models = json::array();
+  for (const auto &model : engine_->get_resident_models()) {
+    models.push_back({{"profile", model.profile},
+                      {"model_id", model.model_id},
+                      {"default", model.is_default},
+                      {"memory_mb", model.bytes / (1024 * 1024)},
+                      {"active", model.active_contexts},
+                      {"total", model.total_contexts},
+                      {"idle_seconds", model.idle_seconds}});
+  }
+  response_body["models"] = models;
+
+  // HTTP isteklerinin protobuf arena havuzu (benchmark sayaçları).
+  auto arena = RequestArenaPool::instance().stats();
+  response_body["request_arena"] = {{"acquired", arena.acquired},
+                                    {"created", arena.created},
+                                    {"spilled_bytes", arena.spilled_bytes}};
+
+  // Ağırlıklar page cache'e okunurken (açılış veya model değişimi).
+  double load_progress = engine_->get_load_progress();
+  if (load_progress >= 0.0) response_body["load_progress"] = load_progress;
+
+  if (model_ready && instance->context_pool().is_unified()) {
+    auto &pool = instance->context_pool();
+    json sequences = json::array();
+    size_t used = 0;
+    for (const auto &seq : pool.get_sequence_usage()) {
+      sequences.push_back(
+          {{"seq_id", seq.seq_id}, {"busy", seq.busy}, {"cells", seq.cells}});
+      used += seq.cells;
+    }
+    response_body["kv_unified"] = {{"total_cells", pool.get_unified_cells()},
+                                   {"used_cells", used},
+                                   {"sequences", sequences}};
+  }
+
   res.set_content(response_body.dump(), "application/json");
-  res.status = model_ready ? 200 : 503;
+  res.status = accepting ? 200 : 503;
 }
 
 void SystemController::handle_get_hardware_config(const httplib::Request &,
@@ -56,8 +106,21 @@ void SystemController::handle_post_hardware_config(const httplib::Request &req,
     int ctx_size = body.value("context_size", 4096);
     bool kv_offload = body.value("kv_offload", true);
 
-    bool success =
-        engine_->update_hardware_config(gpu_layers, ctx_size, kv_offload);
+    // Belirtilmeyen KV cache alanları mevcut ayarları korur.
+    Settings candidate = engine_->get_settings();
+    candidate.cache_type_k = body.value("cache_type_k", candidate.cache_type_k);
+    candidate.cache_type_v = body.value("cache_type_v", candidate.cache_type_v);
+    candidate.flash_attn = body.value("flash_attn", candidate.flash_attn);
+    std::string kv_error = candidate.kv_cache_error();
+    if (!kv_error.empty()) {
+      res.status = 400;
+      res.set_content(json({{"error", kv_error}}).dump(), "application/json");
+      return;
+    }
+
+    bool success = engine_->update_hardware_config(
+        gpu_layers, ctx_size, kv_offload, candidate.cache_type_k,
+        candidate.cache_type_v, candidate.flash_attn);
 
     if (success) {
       res.status = 200;
@@ -125,6 +188,36 @@ void SystemController::handle_ui_layout(const httplib::Request &,
   res.set_content(layout_schema.dump(), "application/json");
 }
 
+void SystemController::handle_cache_probe(const httplib::Request &req,
+                                          httplib::Response &res) {
+  // Parmak izleri kiracıya göre tohumlanır ve yalnızca aynı kiracının
+  // önbelleği sorgulanır; kiracısız sorgu reddedilir.
+  std::string tenant_id = req.get_header_value("x-tenant-id");
+  if (tenant_id.empty()) {
+    res.status = 400;
+    res.set_content(json({{"error", "tenant_id header is strictly required"}})
+                        .dump(),
+                    "application/json");
+    return;
+  }
+  uint64_t fingerprint = 0;
+  std::string text = req.get_param_value("fingerprint");
+  if (!PrefixHasher::parse(text, fingerprint)) {
+    res.status = 400;
+    res.set_content(
+        json({{"error", "fingerprint must be 1-16 hex digits"}}).dump(),
+        "application/json");
+    return;
+  }
+  size_t prefix_tokens = engine_->probe_prefix_cache(
+      req.get_param_value("profile"), tenant_id, fingerprint);
+  res.set_content(
+      json({{"fingerprint", PrefixHasher::format(fingerprint)},
+            {"prefix_tokens", prefix_tokens}})
+          .dump(),
+      "application/json");
+}
+
 void SystemController::handle_static_context(const httplib::Request &req,
                                              httplib::Response &res) {
   std::string filename = req.matches[1];
@@ -16,6 +16,10 @@ class SystemController {
   void handle_post_hardware_config(const httplib::Request& req,
                                    httplib::Response& res);
   void handle_ui_layout(const httplib::Request& req, httplib::Response& res);
+  // Gateway yakınlık sorgusu: ?fingerprint=<hex>[&profile=<ad>] ile verilen
+  // önekten bu replikanın önbelleğinde kaç token olduğu.
+  void handle_cache_probe(const httplib::Request& req,
+                          httplib::Response& res);
   void handle_static_context(const httplib::Request& req,
                              httplib::Response& res);
 
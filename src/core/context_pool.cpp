@@ -4,12 +4,19 @@
 #include <algorithm>
 #include <stdexcept>
 
+#include "core/cpu_topology.h"
+#include "ggml.h"
 #include "spdlog/spdlog.h"
+#include "suts_logger.h"
 
 // --- ContextGuard ---
 ContextGuard::ContextGuard(LlamaContextPool* pool, llama_context* ctx, int id,
-                           size_t matched_tokens)
-    : pool_(pool), ctx_(ctx), id_(id), matched_tokens_(matched_tokens) {}
+                           llama_seq_id seq_id, size_t matched_tokens)
+    : pool_(pool),
+      ctx_(ctx),
+      id_(id),
+      seq_id_(seq_id),
+      matched_tokens_(matched_tokens) {}
 
 ContextGuard::~ContextGuard() {
   if (ctx_ && pool_) {
@@ -17,19 +24,60 @@ ContextGuard::~ContextGuard() {
   }
 }
 
-void ContextGuard::release_early(const std::vector<llama_token>& final_tokens) {
+void ContextGuard::release_early(const std::vector<llama_token>& final_tokens,
+                                 std::string_view tenant) {
   if (ctx_ && pool_) {
-    pool_->release(ctx_, id_, final_tokens);
+    pool_->release(ctx_, id_, final_tokens, tenant);
     ctx_ = nullptr;
     pool_ = nullptr;
   }
 }
 
+int ContextGuard::decode(llama_batch batch) {
+  return pool_->decode(id_, batch, &logits_);
+}
+
+void ContextGuard::clear_kv(llama_pos from) { pool_->clear_kv(id_, from); }
+
+llama_token ContextGuard::sample(llama_sampler* chain) {
+  if (logits_.empty()) return llama_sampler_sample(chain, ctx_, -1);
+
+  std::vector<llama_token_data> candidates(logits_.size());
+  for (size_t i = 0; i < logits_.size(); ++i) {
+    candidates[i] = {(llama_token)i, logits_[i], 0.0f};
+  }
+  llama_token_data_array cur_p = {candidates.data(), candidates.size(), -1,
+                                  false};
+  llama_sampler_apply(chain, &cur_p);
+  if (cur_p.selected < 0 || cur_p.selected >= (int64_t)cur_p.size) {
+    throw std::runtime_error("Sampler chain did not select a token.");
+  }
+  llama_token id = cur_p.data[cur_p.selected].id;
+  llama_sampler_accept(chain, id);
+  return id;
+}
+
+uint32_t ContextGuard::fork_capacity() const {
+  return pool_->get_fork_capacity();
+}
+
+void ContextGuard::fork_sequences(uint32_t n) {
+  auto* mem = llama_get_memory(ctx_);
+  for (uint32_t i = 1; i < n; ++i) llama_memory_seq_cp(mem, 0, i, -1, -1);
+}
+
+void ContextGuard::drop_forks(uint32_t n) {
+  auto* mem = llama_get_memory(ctx_);
+  for (uint32_t i = 1; i < n; ++i) llama_memory_seq_rm(mem, i, -1, -1);
+}
+
 ContextGuard::ContextGuard(ContextGuard&& other) noexcept
     : pool_(other.pool_),
       ctx_(other.ctx_),
       id_(other.id_),
-      matched_tokens_(other.matched_tokens_) {
+      seq_id_(other.seq_id_),
+      matched_tokens_(other.matched_tokens_),
+      logits_(std::move(other.logits_)) {
   other.pool_ = nullptr;
   other.ctx_ = nullptr;
   other.id_ = -1;
@@ -41,7 +89,9 @@ ContextGuard& ContextGuard::operator=(ContextGuard&& other) noexcept {
     pool_ = other.pool_;
     ctx_ = other.ctx_;
     id_ = other.id_;
+    seq_id_ = other.seq_id_;
     matched_tokens_ = other.matched_tokens_;
+    logits_ = std::move(other.logits_);
     other.pool_ = nullptr;
     other.ctx_ = nullptr;
     other.id_ = -1;
@@ -55,6 +105,7 @@ LlamaContextPool::LlamaContextPool(const Settings& settings, llama_model* model,
                                    prometheus::Gauge& active_contexts_gauge)
     : model_(model),
       settings_(settings),
+      prefix_hasher_(settings.model_id + "/" + settings.model_filename),
       active_contexts_gauge_(active_contexts_gauge) {
   if (settings.enable_dynamic_batching) {
     max_size_ = settings.max_batch_size;
@@ -64,42 +115,270 @@ LlamaContextPool::LlamaContextPool(const Settings& settings, llama_model* model,
 
   if (max_size_ == 0) max_size_ = 1;
 
+  // min_pool_size 0 ise havuz sabit boyutludur (eski davranış).
+  min_size_ = settings.min_pool_size == 0
+                  ? max_size_
+                  : std::min(settings.min_pool_size, max_size_);
+
+  // Unified KV: slotlar tek context'in sequence'leridir; elastik büyüme yok.
+  unified_ = settings.kv_unified;
+  if (unified_) {
+    min_size_ = max_size_;
+    unified_cells_ = settings.kv_unified_cells > 0
+                         ? settings.kv_unified_cells
+                         : (size_t)settings.context_size * max_size_;
+  }
+
   contexts_.resize(max_size_);
   is_busy_.assign(max_size_, false);
 
+  std::string kv_error = settings.kv_cache_error();
+  if (kv_error.empty()) {
+    type_k_ = parse_cache_type(settings.cache_type_k);
+    type_v_ = parse_cache_type(settings.cache_type_v);
+    flash_attn_ = parse_flash_attn(settings.flash_attn);
+  } else {
+    SUTS_WARN("KV_CACHE_CONFIG_INVALID", "", "", "",
+              "⚠️ {} Falling back to f16 KV cache.", kv_error);
+  }
+
   spdlog::info(
-      "Context Pool: Initializing {} SMART contexts (Threads per ctx: {}, "
+      "Context Pool: Initializing {}/{} SMART contexts (Threads per ctx: {}, "
       "Batch: {})...",
-      max_size_, settings.n_threads, settings.physical_batch_size);
+      min_size_, max_size_, settings.n_threads, settings.physical_batch_size);
   initialize_contexts();
-  active_contexts_gauge_.Set(0);
+
+  if (min_size_ < max_size_ && settings.context_idle_ttl_s > 0) {
+    reaper_ = std::thread(&LlamaContextPool::reaper_loop, this);
+  }
 }
 
 LlamaContextPool::~LlamaContextPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  reaper_cv_.notify_all();
+  if (reaper_.joinable()) reaper_.join();
+
   std::lock_guard<std::mutex> lock(mutex_);
+  if (unified_) {
+    // Tüm slotlar aynı context'i gösterir; tek sefer serbest bırak.
+    if (!contexts_.empty() && contexts_[0].ctx) llama_free(contexts_[0].ctx);
+    for (auto& state : contexts_) state.ctx = nullptr;
+  }
   for (auto& state : contexts_) {
     if (state.ctx) llama_free(state.ctx);
+    state.ctx = nullptr;
   }
+  threadpools_.reset();
 }
 
 void LlamaContextPool::initialize_contexts() {
   if (!model_) return;
+  threadpools_ = std::make_unique<ThreadpoolManager>(settings_,
+                                                     unified_ ? 1 : max_size_);
+  context_bytes_ = estimate_context_bytes(unified_ ? unified_cells_
+                                                   : settings_.context_size);
+
   for (size_t i = 0; i < max_size_; ++i) {
-    llama_context_params ctx_params = llama_context_default_params();
+    contexts_[i].id = (int)i;
+    contexts_[i].last_used = std::chrono::steady_clock::now();
+  }
+  if (unified_) {
+    llama_context* shared = create_context(0);
+    for (auto& state : contexts_) state.ctx = shared;
+    allocated_ = max_size_;
+    SUTS_INFO("KV_UNIFIED_READY", "", "", "",
+              "🧮 Unified KV cache: {} cells shared by {} sequences (~{} MiB).",
+              unified_cells_, max_size_, context_bytes_ / (1024 * 1024));
+  } else {
+    for (size_t i = 0; i < min_size_; ++i) {
+      contexts_[i].ctx = create_context(i);
+      allocated_++;
+    }
+  }
+
+  SUTS_INFO("KV_CACHE_CONFIG", "", "", "",
+            "🗜️ KV cache: K={} V={} flash_attn={} (~{} MiB per context).",
+            ggml_type_name(type_k_), ggml_type_name(type_v_),
+            settings_.flash_attn, context_bytes_ / (1024 * 1024));
+  SUTS_INFO("THREADPOOL_READY", "", "", "",
+            "🧵 Threadpool mode '{}': {} inference thread(s) for {} "
+            "context(s).",
+            settings_.threadpool_mode, threadpools_->get_total_threads(),
+            max_size_);
+  if (min_size_ < max_size_) {
+    SUTS_INFO("POOL_ELASTIC", "", "", "",
+              "📈 Elastic pool: {} -> {} contexts, ~{} MiB KV each, budget {} "
+              "MiB, idle TTL {}s.",
+              min_size_, max_size_, context_bytes_ / (1024 * 1024),
+              settings_.pool_memory_budget_mb, settings_.context_idle_ttl_s);
+  }
+}
+
+llama_context* LlamaContextPool::create_context(size_t slot) {
+  const auto& tp = threadpools_->binding(slot);
+  llama_context_params ctx_params = llama_context_default_params();
+
+  ctx_params.n_ctx = settings_.context_size;
+  ctx_params.n_batch = std::min((uint32_t)settings_.context_size,
+                                settings_.physical_batch_size);
+  // llama.cpp havuzu ubatch başına seçer (tek token'lık ubatch decode
+  // havuzunu kullanır). n_ubatch = n_batch ile bir llama_decode tek ubatch
+  // olur; decode_on_threadpool doğru havuzun mutex'ini batch boyutundan
+  // seçebilir.
+  ctx_params.n_ubatch = ctx_params.n_batch;
+  if (unified_) {
+    ctx_params.n_ctx = unified_cells_;
+    ctx_params.n_seq_max = max_size_;
+    ctx_params.kv_unified = true;
+  } else if (settings_.max_choices > 1) {
+    // Çatal sequence'ler aynı n_ctx hücresini paylaşır (sequence başına
+    // bölünmez); bellek tek sequence'li context ile aynıdır.
+    ctx_params.n_seq_max = settings_.max_choices;
+    ctx_params.kv_unified = true;
+  }
+
+  ctx_params.n_threads = tp.n_threads;
+  ctx_params.n_threads_batch = tp.n_threads_batch;
+  ctx_params.offload_kqv = settings_.kv_offload;
+  ctx_params.type_k = type_k_;
+  ctx_params.type_v = type_v_;
+  ctx_params.flash_attn_type = flash_attn_;
+
+  llama_context* ctx = llama_init_from_model(model_, ctx_params);
+  if (!ctx) throw std::runtime_error("Failed to create llama_context.");
+
+  if (tp.decode) {
+    llama_attach_threadpool(ctx, tp.decode, tp.prefill);
+    if (!tp.cpus.empty()) {
+      SUTS_INFO("CONTEXT_PINNED", "", "", "",
+                "📌 Context #{} pinned to CPUs [{}] (threads: {}/{})", slot,
+                CpuTopology::format_cpu_list(tp.cpus), tp.n_threads,
+                tp.n_threads_batch);
+    }
+  }
+  return ctx;
+}
+
+size_t LlamaContextPool::estimate_context_bytes(size_t n_cells) const {
+  // KV cache: n_cells x n_layer hücre, K ve V için n_embd_gqa genişlik.
+  const int64_t n_layer = llama_model_n_layer(model_);
+  const int64_t n_head = std::max<int32_t>(1, llama_model_n_head(model_));
+  const int64_t n_embd_gqa =
+      llama_model_n_embd(model_) / n_head * llama_model_n_head_kv(model_);
+  const int64_t cells = (int64_t)n_cells * n_layer;
+  return cells * (ggml_row_size(type_k_, n_embd_gqa) +
+                  ggml_row_size(type_v_, n_embd_gqa));
+}
+
+bool LlamaContextPool::can_grow_locked() const {
+  if (allocated_ >= max_size_) return false;
+  if (settings_.pool_memory_budget_mb == 0) return true;
+  size_t budget = settings_.pool_memory_budget_mb * 1024 * 1024;
+  return (allocated_ + 1) * context_bytes_ + reserved_bytes_ <= budget;
+}
+
+bool LlamaContextPool::reserve_bytes(size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (settings_.pool_memory_budget_mb > 0) {
+    size_t budget = settings_.pool_memory_budget_mb * 1024 * 1024;
+    size_t kv_contexts = unified_ ? 1 : allocated_.load();
+    if (kv_contexts * context_bytes_ + reserved_bytes_ + bytes > budget) {
+      return false;
+    }
+  }
+  reserved_bytes_ += bytes;
+  return true;
+}
+
+void LlamaContextPool::release_bytes(size_t bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  reserved_bytes_ -= std::min(bytes, reserved_bytes_);
+}
+
+void LlamaContextPool::reaper_loop() {
+  const auto ttl = std::chrono::seconds(settings_.context_idle_ttl_s);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stopping_) {
+    reaper_cv_.wait_for(lock, std::chrono::seconds(1),
+                        [this] { return stopping_; });
+    if (stopping_) break;
+
+    auto now = std::chrono::steady_clock::now();
+    std::vector<llama_context*> idle;
+    // Yüksek numaralı slotlar önce bırakılır; düşük slotlar sıcak kalır.
+    for (size_t i = max_size_; i-- > 0;) {
+      if (allocated_ - idle.size() <= min_size_) break;
+      auto& state = contexts_[i];
+      if (!state.ctx || is_busy_[i] || now - state.last_used < ttl) continue;
+      idle.push_back(state.ctx);
+      state.ctx = nullptr;
+      state.tokens.clear();
+      state.block_hashes.clear();
+    }
+    if (idle.empty()) continue;
+    allocated_ -= idle.size();
+
+    // llama_free bellek iadesi uzun sürebilir; acquire'ı bekletme.
+    lock.unlock();
+    for (auto* ctx : idle) llama_free(ctx);
+    lock.lock();
+
+    SUTS_INFO("POOL_SHRINK", "", "", "",
+              "🧹 Released {} idle context(s) after {}s. Allocated: {}/{}",
+              idle.size(), settings_.context_idle_ttl_s, allocated_.load(),
+              max_size_);
+  }
+}
 
-    ctx_params.n_ctx = settings_.context_size;
-    ctx_params.n_batch = std::min((uint32_t)settings_.context_size,
-                                  settings_.physical_batch_size);
+int LlamaContextPool::decode(int id, llama_batch batch,
+                             std::vector<float>* logits_out) {
+  llama_context* ctx = contexts_[id].ctx;
+  if (unified_) {
+    // Sequence'ler tek tek decode edilir (adımlar birleştirilmez); unified
+    // mod eşzamanlılık değil KV belleği kazandırır. Bkz. LOGIC.md §8.
+    std::lock_guard<std::mutex> lock(unified_mutex_);
+    int rc = decode_on_threadpool(0, ctx, batch);
+    bool wants_logits = false;
+    for (int32_t i = 0; i < batch.n_tokens; ++i) {
+      if (batch.logits && batch.logits[i]) wants_logits = true;
+    }
+    if (rc == 0 && logits_out && wants_logits) {
+      const float* logits = llama_get_logits_ith(ctx, -1);
+      int32_t n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model_));
+      logits_out->assign(logits, logits + n_vocab);
+    }
+    return rc;
+  }
+  return decode_on_threadpool(id, ctx, batch);
+}
 
-    ctx_params.n_threads = settings_.n_threads;
-    ctx_params.n_threads_batch = settings_.n_threads_batch;
-    ctx_params.offload_kqv = settings_.kv_offload;
+void LlamaContextPool::attach_auxiliary(llama_context* ctx) {
+  const auto& tp = threadpools_->auxiliary_binding();
+  llama_set_n_threads(ctx, tp.n_threads, tp.n_threads_batch);
+  if (tp.decode) llama_attach_threadpool(ctx, tp.decode, tp.prefill);
+}
 
-    llama_context* ctx = llama_init_from_model(model_, ctx_params);
-    if (!ctx) throw std::runtime_error("Failed to create llama_context.");
+int LlamaContextPool::decode_auxiliary(llama_context* ctx, llama_batch batch) {
+  return decode_on_threadpool(0, ctx, batch);
+}
 
-    contexts_[i] = {ctx, (int)i, {}, std::chrono::steady_clock::now()};
+int LlamaContextPool::decode_on_threadpool(size_t slot, llama_context* ctx,
+                                           llama_batch batch) {
+  const auto& tp = threadpools_->binding(slot);
+  if (!tp.decode_mutex) return llama_decode(ctx, batch);
+
+  // llama.cpp havuzu ubatch başına seçer: tek token'lık ubatch decode
+  // havuzunu, diğerleri prefill havuzunu kullanır. create_context
+  // n_ubatch = n_batch kurar; batch bölünmez, yani ubatch batch'in kendisidir.
+  if (batch.n_tokens == 1) {
+    std::lock_guard<std::mutex> lock(*tp.decode_mutex);
+    return llama_decode(ctx, batch);
   }
+  std::lock_guard<std::mutex> lock(*tp.prefill_mutex);
+  return llama_decode(ctx, batch);
 }
 
 ContextGuard LlamaContextPool::acquire() {
@@ -107,21 +386,83 @@ ContextGuard LlamaContextPool::acquire() {
   return acquire({});
 }
 
+void LlamaContextPool::clear_kv(int id, llama_pos from) {
+  llama_context* ctx = contexts_[id].ctx;
+  if (!unified_) {
+    llama_memory_seq_rm(llama_get_memory(ctx), -1, from, -1);
+    return;
+  }
+  std::lock_guard<std::mutex> lock(unified_mutex_);
+  llama_memory_seq_rm(llama_get_memory(ctx), id, from, -1);
+}
+
 ContextGuard LlamaContextPool::acquire(
-    const std::vector<llama_token>& input_tokens) {
+    const std::vector<llama_token>& input_tokens, size_t reserve_tokens) {
+  if (unified_) return acquire_unified(input_tokens, reserve_tokens);
   std::unique_lock<std::mutex> lock(mutex_);
 
-  cv_.wait(lock, [this] {
-    return std::any_of(is_busy_.begin(), is_busy_.end(),
-                       [](bool busy) { return !busy; });
-  });
+  auto has_free = [this] {
+    for (size_t i = 0; i < max_size_; ++i) {
+      if (!is_busy_[i] && contexts_[i].ctx) return true;
+    }
+    return false;
+  };
+
+  // Boş context yoksa pool_grow_after_ms kadar bekle; kuyruk sürerse ve bütçe
+  // izin veriyorsa yeni bir context oluştur.
+  auto grow_at = std::chrono::steady_clock::now() +
+                 std::chrono::milliseconds(settings_.pool_grow_after_ms);
+  while (!has_free()) {
+    if (!can_grow_locked()) {
+      cv_.wait(lock);
+      continue;
+    }
+    if (std::chrono::steady_clock::now() < grow_at) {
+      cv_.wait_until(lock, grow_at);
+      continue;
+    }
+
+    size_t slot = 0;
+    while (contexts_[slot].ctx || is_busy_[slot]) slot++;
+    is_busy_[slot] = true;
+    allocated_++;
+
+    // Oluşturma sırasında slot meşgul işaretli; kilit bırakılabilir.
+    lock.unlock();
+    llama_context* ctx = nullptr;
+    try {
+      ctx = create_context(slot);
+    } catch (const std::exception& e) {
+      SUTS_WARN("POOL_GROW_FAILED", "", "", "",
+                "⚠️ Could not grow context pool: {}", e.what());
+    }
+    lock.lock();
+
+    if (!ctx) {
+      is_busy_[slot] = false;
+      allocated_--;
+      grow_at = std::chrono::steady_clock::now() +
+                std::chrono::milliseconds(settings_.pool_grow_after_ms);
+      continue;
+    }
+
+    contexts_[slot].ctx = ctx;
+    contexts_[slot].tokens.clear();
+    contexts_[slot].block_hashes.clear();
+    contexts_[slot].last_used = std::chrono::steady_clock::now();
+    SUTS_INFO("POOL_GROW", "", "", "",
+              "📈 Context pool grew: slot #{} allocated ({}/{}).", slot,
+              allocated_.load(), max_size_);
+    active_contexts_gauge_.Increment();
+    return ContextGuard(this, ctx, (int)slot, 0, 0);
+  }
 
   int best_id = -1;
   size_t max_match = 0;
 
   // Smart Caching: Find the available context with the longest matching prefix.
   for (size_t i = 0; i < max_size_; ++i) {
-    if (is_busy_[i]) continue;
+    if (is_busy_[i] || !contexts_[i].ctx) continue;
 
     const auto& cached_tokens = contexts_[i].tokens;
     size_t match = 0;
@@ -140,7 +481,7 @@ ContextGuard LlamaContextPool::acquire(
   // Fallback: If no good match, find any free context.
   if (best_id == -1) {
     for (size_t i = 0; i < max_size_; ++i) {
-      if (!is_busy_[i]) {
+      if (!is_busy_[i] && contexts_[i].ctx) {
         best_id = i;
         break;
       }
@@ -152,7 +493,7 @@ ContextGuard LlamaContextPool::acquire(
         "Unexpected pool state: no context available after wait.");
 
   is_busy_[best_id] = true;
-  active_contexts_gauge_.Set(get_active_count());
+  active_contexts_gauge_.Increment();
 
   if (max_match > 0) {
     spdlog::info(
@@ -160,23 +501,147 @@ ContextGuard LlamaContextPool::acquire(
         best_id, max_match);
   }
 
-  return ContextGuard(this, contexts_[best_id].ctx, best_id, max_match);
+  return ContextGuard(this, contexts_[best_id].ctx, best_id, 0, max_match);
+}
+
+ContextGuard LlamaContextPool::acquire_unified(
+    const std::vector<llama_token>& input_tokens, size_t reserve_tokens) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  size_t reserve = std::min(std::max(reserve_tokens, input_tokens.size()),
+                            unified_cells_);
+
+  while (true) {
+    int best_id = -1;
+    size_t max_match = 0;
+    for (size_t i = 0; i < max_size_; ++i) {
+      if (is_busy_[i]) continue;
+      const auto& cached_tokens = contexts_[i].tokens;
+      size_t match = 0;
+      size_t limit = std::min(input_tokens.size(), cached_tokens.size());
+      while (match < limit && input_tokens[match] == cached_tokens[match]) {
+        match++;
+      }
+      if (best_id == -1 || match > max_match) {
+        max_match = match;
+        best_id = i;
+      }
+    }
+
+    if (best_id != -1) {
+      // Seçilen sequence'in eşleşen kısmı rezervasyonun içindedir, kalanı
+      // decode_prompt'ta silinir. Diğerleri gerçek kullanımlarıyla sayılır.
+      size_t used = 0;
+      for (size_t i = 0; i < max_size_; ++i) {
+        if ((int)i == best_id) continue;
+        used += is_busy_[i] ? contexts_[i].reserved
+                            : contexts_[i].tokens.size();
+      }
+
+      // Yer yoksa en uzun süredir boşta olan önbellekli sequence'leri at.
+      while (used + reserve > unified_cells_) {
+        int victim = -1;
+        for (size_t i = 0; i < max_size_; ++i) {
+          if ((int)i == best_id || is_busy_[i] || contexts_[i].tokens.empty())
+            continue;
+          if (victim == -1 ||
+              contexts_[i].last_used < contexts_[victim].last_used) {
+            victim = i;
+          }
+        }
+        if (victim == -1) break;
+        used -= contexts_[victim].tokens.size();
+        contexts_[victim].tokens.clear();
+        contexts_[victim].block_hashes.clear();
+        std::lock_guard<std::mutex> kv_lock(unified_mutex_);
+        llama_memory_seq_rm(llama_get_memory(contexts_[victim].ctx), victim, -1,
+                            -1);
+      }
+
+      if (used + reserve <= unified_cells_) {
+        is_busy_[best_id] = true;
+        contexts_[best_id].reserved = reserve;
+        active_contexts_gauge_.Increment();
+        if (max_match > 0) {
+          spdlog::info(
+              "⚡ SMART CACHE HIT! Sequence #{} reused with {} matching "
+              "tokens.",
+              best_id, max_match);
+        }
+        return ContextGuard(this, contexts_[best_id].ctx, best_id, best_id,
+                            max_match);
+      }
+    }
+
+    // Boş sequence yok ya da aktif rezervasyonlar KV'yi dolduruyor.
+    cv_.wait(lock);
+  }
 }
 
 void LlamaContextPool::release(llama_context* ctx, int id,
-                               const std::vector<llama_token>& current_tokens) {
+                               const std::vector<llama_token>& current_tokens,
+                               std::string_view tenant) {
   if (!ctx) return;
 
+  // probe_prefix kilit altında yalnızca arar; hash'ler burada, kilit
+  // dışında hesaplanır.
+  std::vector<uint64_t> hashes;
+  if (!tenant.empty()) {
+    hashes = prefix_hasher_.block_hashes(current_tokens, tenant);
+  }
+
   std::lock_guard<std::mutex> lock(mutex_);
   if (id >= 0 && id < (int)contexts_.size()) {
     // Cache the final token state for the next acquisition.
     contexts_[id].tokens = current_tokens;
+    contexts_[id].block_hashes = std::move(hashes);
+    contexts_[id].tenant = tenant;
     contexts_[id].last_used = std::chrono::steady_clock::now();
+    contexts_[id].reserved = 0;
+    if (is_busy_[id]) active_contexts_gauge_.Decrement();
     is_busy_[id] = false;
+
+    // Unified modda içeriği bilinmeyen sequence hücre tutmaya devam etmesin.
+    if (unified_ && current_tokens.empty()) {
+      std::lock_guard<std::mutex> kv_lock(unified_mutex_);
+      llama_memory_seq_rm(llama_get_memory(ctx), id, -1, -1);
+    }
   }
 
-  active_contexts_gauge_.Set(get_active_count());
-  cv_.notify_one();
+  // Unified modda boşalan hücreler birden fazla bekleyeni kabul edebilir.
+  if (unified_) {
+    cv_.notify_all();
+  } else {
+    cv_.notify_one();
+  }
+}
+
+size_t LlamaContextPool::probe_prefix(uint64_t fingerprint,
+                                      std::string_view tenant) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t best = 0;
+  for (size_t i = 0; i < contexts_.size(); ++i) {
+    if (is_busy_[i] || !contexts_[i].ctx) continue;
+    if (contexts_[i].tenant != tenant) continue;
+    const auto& hashes = contexts_[i].block_hashes;
+    auto it = std::find(hashes.begin(), hashes.end(), fingerprint);
+    if (it == hashes.end()) continue;
+    size_t covered = (it - hashes.begin() + 1) * PrefixHasher::kBlockTokens;
+    best = std::max(best, covered);
+  }
+  return best;
+}
+
+std::vector<LlamaContextPool::SequenceUsage>
+LlamaContextPool::get_sequence_usage() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::vector<SequenceUsage> usage;
+  usage.reserve(max_size_);
+  for (size_t i = 0; i < max_size_; ++i) {
+    usage.push_back({(int)i, (bool)is_busy_[i],
+                     is_busy_[i] ? contexts_[i].reserved
+                                 : contexts_[i].tokens.size()});
+  }
+  return usage;
 }
 
 size_t LlamaContextPool::get_active_count() const {
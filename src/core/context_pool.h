@@ -3,15 +3,22 @@
 
 #include <prometheus/gauge.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include "config.h"
+#include "core/prefix_hash.h"
+#include "core/threadpool_manager.h"
 #include "llama.h"
 
 class LlamaContextPool;
@@ -19,7 +26,7 @@ class LlamaContextPool;
 class ContextGuard {
  public:
   ContextGuard(LlamaContextPool* pool, llama_context* ctx, int id,
-               size_t matched_tokens);
+               llama_seq_id seq_id, size_t matched_tokens);
   ~ContextGuard();
 
   // Move semantics
@@ -30,15 +37,41 @@ class ContextGuard {
 
   llama_context* get() { return ctx_; }
   int get_id() const { return id_; }
+  // Batch'lere yazılacak sequence id (unified KV modunda slot numarası).
+  llama_seq_id get_seq_id() const { return seq_id_; }
   size_t get_matched_tokens() const { return matched_tokens_; }
 
-  void release_early(const std::vector<llama_token>& final_tokens);
+  // llama_decode yerine kullanılmalı: paylaşımlı threadpool varsa hesaplamayı
+  // ilgili havuzun kilidi altında yürütür.
+  int decode(llama_batch batch);
+
+  // Bu sequence'in KV kayıtlarını 'from' pozisyonundan itibaren siler.
+  void clear_kv(llama_pos from);
+
+  // Son decode'un logit'lerinden örnekler (llama_sampler_sample eşdeğeri).
+  // Unified modda logit'ler decode anında kopyalanır; başka bir sequence'in
+  // decode'u bunları ezemez.
+  llama_token sample(llama_sampler* chain);
+
+  // n > 1 seçenek: ayrık modda context max_choices sequence ile açılır.
+  // Prompt seq 0'da bir kez işlenir, KV'si 1..n-1'e kopyalanır (hücreler
+  // paylaşılır, veri kopyalanmaz). Unified modda 1 (çatallanamaz).
+  uint32_t fork_capacity() const;
+  void fork_sequences(uint32_t n);
+  // Çatal sequence'leri siler; önbellekte yalnızca seq 0 kalır.
+  void drop_forks(uint32_t n);
+
+  // tenant: önbellekteki önekin parmak izleri bu kiracıya göre hesaplanır.
+  void release_early(const std::vector<llama_token>& final_tokens,
+                     std::string_view tenant = {});
 
  private:
   LlamaContextPool* pool_;
   llama_context* ctx_;
   int id_;
+  llama_seq_id seq_id_;
   size_t matched_tokens_;
+  std::vector<float> logits_;
 };
 
 class LlamaContextPool {
@@ -48,37 +81,124 @@ class LlamaContextPool {
   ~LlamaContextPool();
 
   // Akıllı Önbellek ile Context Edinme (LLMEngine kullanır)
-  ContextGuard acquire(const std::vector<llama_token>& input_tokens);
+  // reserve_tokens: istek için ayrılacak KV hücresi (prompt + üretim üst
+  // sınırı). Sadece unified KV modunda kabul kararında kullanılır.
+  ContextGuard acquire(const std::vector<llama_token>& input_tokens,
+                       size_t reserve_tokens = 0);
 
   // Basit Context Edinme (Warmup gibi eski sistemler için)
   ContextGuard acquire();
 
   // Context'i havuza iade etme ve token durumunu önbelleğe alma
   void release(llama_context* ctx, int id,
-               const std::vector<llama_token>& current_tokens);
+               const std::vector<llama_token>& current_tokens,
+               std::string_view tenant = {});
+
+  // Context'in bağlı olduğu threadpool üzerinde llama_decode çalıştırır.
+  // logits_out verilirse ve unified moddaysa son logit satırı kopyalanır.
+  int decode(int id, llama_batch batch,
+             std::vector<float>* logits_out = nullptr);
+  // Havuz dışı bir context'i (embeddings) havuzun thread bütçesine katar:
+  // slot 0'ın threadpool'larına bağlar ve decode'unu onların kilidi altında
+  // yürütür. Havuz kendi threadpool'unu kurmadıysa (per_context, affinity
+  // yok) yalnızca thread sayıları eşitlenir.
+  void attach_auxiliary(llama_context* ctx);
+  int decode_auxiliary(llama_context* ctx, llama_batch batch);
+  void clear_kv(int id, llama_pos from);
+
+  struct SequenceUsage {
+    int seq_id;
+    bool busy;
+    size_t cells;  // Meşgulse rezervasyon, boştaysa önbellekteki token sayısı
+  };
+  bool is_unified() const { return unified_; }
+  uint32_t get_fork_capacity() const {
+    return unified_ ? 1 : std::max<uint32_t>(settings_.max_choices, 1);
+  }
+  size_t get_unified_cells() const { return unified_cells_; }
+  std::vector<SequenceUsage> get_sequence_usage();
+
+  const PrefixHasher& prefix_hasher() const { return prefix_hasher_; }
+  // Parmak izinin kapsadığı önek boştaki bir context'in önbelleğinde varsa
+  // token sayısı, yoksa 0. Meşgul context'ler sayılmaz (KV'leri değişiyor).
+  // Yalnızca tenant'ın bıraktığı context'lere bakılır. Blok hash'leri
+  // release() sırasında kilit dışında bir kez hesaplanır.
+  size_t probe_prefix(uint64_t fingerprint, std::string_view tenant);
 
   size_t get_active_count() const;
   size_t get_total_count() const { return max_size_; }
+  // Şu an bellekte olan (KV ayrılmış) context sayısı; <= get_total_count().
+  size_t get_allocated_count() const { return allocated_; }
+  // Tahmini context başına KV cache boyutu (seçili cache tiplerine göre).
+  size_t get_context_bytes() const { return context_bytes_; }
+  // Havuz dışında aynı modele ait bellek (ör. embeddings context'i) için
+  // bütçeden yer ayırır; sığmazsa false. Ayrılan yer release_bytes ile
+  // geri verilene kadar havuzun büyümesi kalan bütçeyle sınırlıdır.
+  bool reserve_bytes(size_t bytes);
+  void release_bytes(size_t bytes);
   llama_model* get_model() const { return model_; }
+  size_t get_total_threads() const {
+    return threadpools_ ? threadpools_->get_total_threads() : 0;
+  }
 
  private:
+  // ctx == nullptr olan slot ayrılmamıştır; yük altında tembelce oluşturulur.
   struct ContextState {
-    llama_context* ctx;
-    int id;
+    llama_context* ctx = nullptr;
+    int id = -1;
     std::vector<llama_token> tokens;
+    // tokens'ın blok parmak izleri (bkz. PrefixHasher::block_hashes).
+    std::vector<uint64_t> block_hashes;
+    std::string tenant;  // block_hashes'i üreten kiracı
     std::chrono::steady_clock::time_point last_used;
+    size_t reserved = 0;  // Unified mod: aktif isteğin KV rezervasyonu
   };
 
   void initialize_contexts();
+  llama_context* create_context(size_t slot);
+  // Yeni context bellek bütçesine ve slot sınırına sığıyor mu? (mutex_ altında)
+  bool can_grow_locked() const;
+  size_t estimate_context_bytes(size_t n_cells) const;
+  int decode_on_threadpool(size_t slot, llama_context* ctx, llama_batch batch);
+  // Tek context, N sequence: token kullanımına göre kabul (mutex_ altında
+  // çağrılmaz, kendisi kilitler).
+  ContextGuard acquire_unified(const std::vector<llama_token>& input_tokens,
+                               size_t reserve_tokens);
+  // TTL'i aşan boştaki context'leri min_size_'a kadar serbest bırakır.
+  void reaper_loop();
 
   llama_model* model_;
   const Settings& settings_;
+  PrefixHasher prefix_hasher_;
   size_t max_size_;
-
+  size_t min_size_;
+  size_t context_bytes_ = 0;
+  size_t reserved_bytes_ = 0;  // reserve_bytes() toplamı (mutex_)
+  ggml_type type_k_ = GGML_TYPE_F16;
+  ggml_type type_v_ = GGML_TYPE_F16;
+  llama_flash_attn_type flash_attn_ = LLAMA_FLASH_ATTN_TYPE_AUTO;
+  std::atomic<size_t> allocated_{0};
+
+  // Unified KV: tüm slotlar aynı context'i farklı seq_id ile paylaşır.
+  // unified_mutex_ context üzerindeki her decode/KV işlemini sıralar;
+  // kilit sırası her zaman mutex_ -> unified_mutex_.
+  bool unified_ = false;
+  size_t unified_cells_ = 0;
+  std::mutex unified_mutex_;
+
+  // Context'lerden önce yok edilmemeli; destructor context'leri önce serbest
+  // bırakır.
+  std::unique_ptr<ThreadpoolManager> threadpools_;
   std::vector<ContextState> contexts_;
   std::vector<bool> is_busy_;
 
   std::mutex mutex_;
   std::condition_variable cv_;
+  // Tüm model örneklerinin havuzları aynı gauge'u artırıp azaltır; değer
+  // süreç genelindeki aktif context toplamıdır.
   prometheus::Gauge& active_contexts_gauge_;
+
+  bool stopping_ = false;
+  std::condition_variable reaper_cv_;
+  std::thread reaper_;
 };
\ No newline at end of file
@@ -0,0 +1,163 @@
+// Dosya: src/core/cpu_topology.cpp
+#include "core/cpu_topology.h"
+
+#include <sched.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "suts_logger.h"
+
+namespace fs = std::filesystem;
+
+namespace CpuTopology {
+
+std::vector<int> parse_cpu_list(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  try {
+    while (std::getline(ss, range, ',')) {
+      range.erase(std::remove_if(range.begin(), range.end(), ::isspace),
+                  range.end());
+      if (range.empty()) continue;
+      size_t dash = range.find('-');
+      int first = std::stoi(range.substr(0, dash));
+      int last = dash == std::string::npos ? first
+                                           : std::stoi(range.substr(dash + 1));
+      if (first < 0 || last < first) return {};
+      for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+    }
+  } catch (const std::exception&) {
+    return {};
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::string format_cpu_list(const std::vector<int>& cpus) {
+  std::string out;
+  for (size_t i = 0; i < cpus.size();) {
+    size_t j = i;
+    while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+    if (!out.empty()) out += ",";
+    out += std::to_string(cpus[i]);
+    if (j > i) out += "-" + std::to_string(cpus[j]);
+    i = j + 1;
+  }
+  return out;
+}
+
+static std::vector<int> allowed_cpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+    }
+  }
+  if (cpus.empty()) {
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned cpu = 0; cpu < hw; ++cpu) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+std::vector<std::vector<int>> discover_numa_nodes() {
+  std::vector<int> allowed = allowed_cpus();
+  std::vector<std::vector<int>> nodes;
+
+  const fs::path node_root("/sys/devices/system/node");
+  std::error_code ec;
+  if (fs::exists(node_root, ec)) {
+    std::vector<fs::path> node_dirs;
+    for (const auto& entry : fs::directory_iterator(node_root, ec)) {
+      std::string name = entry.path().filename().string();
+      if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+          std::all_of(name.begin() + 4, name.end(), ::isdigit)) {
+        node_dirs.push_back(entry.path());
+      }
+    }
+    std::sort(node_dirs.begin(), node_dirs.end());
+
+    for (const auto& dir : node_dirs) {
+      std::ifstream f(dir / "cpulist");
+      std::string list;
+      if (!f.is_open() || !std::getline(f, list)) continue;
+      std::vector<int> node_cpus;
+      for (int cpu : parse_cpu_list(list)) {
+        if (std::binary_search(allowed.begin(), allowed.end(), cpu)) {
+          node_cpus.push_back(cpu);
+        }
+      }
+      if (!node_cpus.empty()) nodes.push_back(std::move(node_cpus));
+    }
+  }
+
+  if (nodes.empty()) nodes.push_back(std::move(allowed));
+  return nodes;
+}
+
+std::vector<std::vector<int>> plan_context_cpusets(const Settings& settings,
+                                                   size_t n_contexts) {
+  std::vector<std::vector<int>> plan(n_contexts);
+  const std::string& spec = settings.cpu_affinity;
+  if (spec.empty() || n_contexts == 0) return plan;
+
+  if (spec != "auto") {
+    std::vector<std::string> lists;
+    std::stringstream ss(spec);
+    std::string item;
+    while (std::getline(ss, item, ';')) lists.push_back(item);
+
+    for (size_t i = 0; i < n_contexts && !lists.empty(); ++i) {
+      // Liste sayısı context sayısından azsa döngüsel olarak tekrar kullanılır.
+      const std::string& list = lists[i % lists.size()];
+      plan[i] = parse_cpu_list(list);
+      if (plan[i].empty()) {
+        SUTS_WARN("CPU_AFFINITY_INVALID", "", "", "",
+                  "⚠️ Invalid cpu list '{}' for context #{}. Not pinning.",
+                  list, i);
+      }
+    }
+    return plan;
+  }
+
+  // AUTO: context'leri düğümlere dağıt, her düğümün çekirdeklerini o düğüme
+  // düşen context'ler arasında ardışık bloklar halinde paylaştır.
+  auto nodes = discover_numa_nodes();
+  std::vector<std::vector<size_t>> contexts_per_node(nodes.size());
+  for (size_t i = 0; i < n_contexts; ++i) {
+    contexts_per_node[i % nodes.size()].push_back(i);
+  }
+
+  size_t want = std::max<size_t>(1, settings.n_threads);
+  for (size_t n = 0; n < nodes.size(); ++n) {
+    const auto& cpus = nodes[n];
+    const auto& ctx_ids = contexts_per_node[n];
+    if (ctx_ids.empty()) continue;
+
+    size_t share = std::max<size_t>(1, cpus.size() / ctx_ids.size());
+    size_t block = std::min(want, share);
+    for (size_t k = 0; k < ctx_ids.size(); ++k) {
+      // Çekirdek yetmezse bloklar düğüm içinde sarar (paylaşımlı çekirdek).
+      for (size_t c = 0; c < block; ++c) {
+        plan[ctx_ids[k]].push_back(cpus[(k * share + c) % cpus.size()]);
+      }
+      std::sort(plan[ctx_ids[k]].begin(), plan[ctx_ids[k]].end());
+    }
+  }
+
+  SUTS_INFO("CPU_AFFINITY_PLANNED", "", "", "",
+            "🧩 CPU affinity (auto): {} NUMA node(s), {} context(s).",
+            nodes.size(), n_contexts);
+  return plan;
+}
+
+}  // namespace CpuTopology
@@ -0,0 +1,30 @@
+// Dosya: src/core/cpu_topology.h
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+
+namespace CpuTopology {
+
+// Linux cpulist formatını çözer ("0-3,8,10-11"). Hatalı girdide boş döner.
+std::vector<int> parse_cpu_list(const std::string& list);
+
+// Log/JSON için tersine çevirme ({0,1,2,3,8} -> "0-3,8").
+std::string format_cpu_list(const std::vector<int>& cpus);
+
+// Süreç için izin verilen (cgroup/cpuset) çekirdekleri NUMA düğümlerine göre
+// gruplar. /sys okunamazsa tek düğüm varsayılır.
+std::vector<std::vector<int>> discover_numa_nodes();
+
+// Her context için sabitlenecek çekirdek kümesi.
+// settings.cpu_affinity:
+//   ""      -> sabitleme yok (boş kümeler)
+//   "auto"  -> context'ler NUMA düğümlerine round-robin dağıtılır, her biri
+//              kendi düğümünden n_threads çekirdek alır
+//   "0-3;4-7" -> context başına açık çekirdek listeleri (';' ile ayrılır)
+std::vector<std::vector<int>> plan_context_cpusets(const Settings& settings,
+                                                   size_t n_contexts);
+
+}  // namespace CpuTopology
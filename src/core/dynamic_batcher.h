@@ -1,68 +1,114 @@
 // Dosya: src/core/dynamic_batcher.h
 #pragma once
 
+#include <prometheus/gauge.h>
+
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <functional>
 #include <future>
+#include <iterator>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <string>
 #include <thread>
 #include <vector>
 
 #include "config.h"
+#include "core/request_arena.h"
+#include "core/token_channel.h"
+#include "core/work_estimator.h"
 #include "llama.h"
 #include "sentiric/llm/v1/llama.pb.h"
 #include "spdlog/spdlog.h"
 
-template <typename T>
-class ThreadSafeQueue {
- public:
-  void push(T value) {
-    std::lock_guard<std::mutex> lock(mutex_);
-    queue_.push(std::move(value));
-    cond_.notify_one();
-  }
+// Token kanalı dolduğunda (istemci yavaş okuyor) üreticinin davranışı.
+// Pause: üretim yer açılana kadar bekler. Coalesce: sığmayan token'lar
+// üretici tarafında birleştirilir ve üretim sürer; birikim kanal bayt
+// kapasitesinin yarısını aşarsa Pause'a düşer. Abort: istek "overflow"
+// ile kesilir.
+enum class OverflowPolicy { Pause, Coalesce, Abort };
 
-  bool wait_and_pop(T& value, int timeout_ms = 100) {
-    std::unique_lock<std::mutex> lock(mutex_);
-    if (!cond_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
-                        [this] { return !queue_.empty(); })) {
-      return false;
-    }
-    value = std::move(queue_.front());
-    queue_.pop();
-    return true;
-  }
+inline OverflowPolicy parse_overflow_policy(const std::string& name) {
+  if (name == "coalesce") return OverflowPolicy::Coalesce;
+  if (name == "abort") return OverflowPolicy::Abort;
+  return OverflowPolicy::Pause;
+}
 
-  bool empty() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    return queue_.empty();
-  }
+struct BatchedRequest {
+  BatchedRequest() = default;
+  BatchedRequest(size_t max_tokens, size_t max_bytes)
+      : tokens(max_tokens, max_bytes) {}
 
- private:
-  std::queue<T> queue_;
-  std::mutex mutex_;
-  std::condition_variable cond_;
-};
+  // İstek mesajı kopyalanmaz. gRPC yolunda çağrı boyunca yaşayan mesajı
+  // gösterir (handler tamamlanmayı bekler); HTTP yolunda mesaj
+  // create_request() ile istek arena'sı üzerinde kurulur.
+  const sentiric::llm::v1::GenerateStreamRequest* request = nullptr;
+  RequestArenaPool::Lease arena{nullptr, {&RequestArenaPool::instance()}};
 
-struct BatchedRequest {
-  sentiric::llm::v1::GenerateStreamRequest request;
+  sentiric::llm::v1::GenerateStreamRequest* create_request() {
+    arena = RequestArenaPool::instance().acquire();
+    auto* message = create_on_arena<sentiric::llm::v1::GenerateStreamRequest>(
+        arena->arena.get());
+    request = message;
+    return message;
+  }
 
   std::function<bool(const std::string&)> on_token_callback;
   std::function<bool()> should_stop_callback;
 
-  ThreadSafeQueue<std::string> token_queue;
-  std::atomic<bool> is_finished{false};
+  // on_token_callback yoksa üretilen token'lar buraya yazılır. İstek
+  // bitince (başarı, hata veya red) worker kanalı finish() ile kapatır.
+  TokenChannel tokens;
+  // Kanala token yazıldığında ve kanal kapandığında üretici thread'inden
+  // çağrılır (ör. gRPC reactor'ünün yazmayı tetiklemesi). Bloklamamalı.
+  std::function<void()> on_tokens_ready;
+
+  OverflowPolicy overflow_policy = OverflowPolicy::Pause;
+  // Pause: tek token bu süre içinde yazılamazsa istek kesilir (0 = sınırsız).
+  std::chrono::milliseconds stall_timeout{0};
+  // Coalesce: kanala henüz sığmamış birleşik metin ve son token'ı. Yalnızca
+  // üretici thread'i kullanır.
+  std::string overflow_text;
+  llama_token overflow_id = 0;
+
+  // Yazıcı tarafında token birleştirme (bkz. StreamCoalescer).
+  size_t min_chunk_bytes = 0;
+  std::chrono::milliseconds max_flush_interval{50};
+  // TTS tüketicileri için cümle/yan cümle başına mesaj (SentenceChunker).
+  bool sentence_chunks = false;
+  // OpenAI 'n': aynı prompt'tan bağımsız örneklenen seçenek sayısı.
+  // Token'lar kanalda seçenek numarasıyla gelir; completion_tokens
+  // seçeneklerin toplamıdır.
+  uint32_t n_choices = 1;
+  std::vector<std::string> choice_finish_reasons;
+  // Çevrimdışı batch işi (/v1/batches): kuyrukta gerçek zamanlı istek yokken
+  // alınır; gerçek zamanlı istek boş worker bulamazsa bir sonraki token'da
+  // "preempted" ile bırakılır ve iş tarafından yeniden kuyruğa alınır.
+  bool background = false;
+
+  void finish() {
+    tokens.close();
+    if (on_tokens_ready) on_tokens_ready();
+  }
 
   std::promise<void> completion_promise;
   int32_t prompt_tokens = 0;
   int32_t completion_tokens = 0;
   std::string finish_reason = "stop";
+  // Prompt önek parmak izi (bkz. PrefixHasher); prompt bir bloktan kısaysa
+  // boş. Gateway bunu replika yakınlığı için kullanır.
+  std::string cache_fingerprint;
+  size_t cache_prefix_tokens = 0;
+  // SSE: [DONE]'dan önce parmak izini taşıyan ek çerçeve gönderilir.
+  bool stream_cache_info = false;
 
   std::string grammar;
+  // Hedef profil (boş = varsayılan model). Engine bunu yüklü modele eşler.
+  std::string model_profile;
 
   //[ARCH-COMPLIANCE] İz sürme verileri eklendi
   std::string trace_id = "unknown";
@@ -74,83 +120,238 @@ struct BatchedRequest {
       std::chrono::steady_clock::now();
   std::atomic<double> ttft_ms{0.0};
   std::atomic<bool> first_token_emitted{false};
+
+  // --- SCHEDULING ---
+  std::chrono::steady_clock::time_point enqueue_time;
+  double estimated_cost = 0.0;
 };
 
+enum class SchedulingPolicy { FIFO, SJF };
+
+inline SchedulingPolicy parse_scheduling_policy(const std::string& name) {
+  return name == "sjf" ? SchedulingPolicy::SJF : SchedulingPolicy::FIFO;
+}
+
+// Kalıcı inference worker havuzu: context başına bir worker.
+// Her worker kuyruktan politikaya göre tek istek çeker ve bitirir bitirmez
+// sıradakine geçer; yavaş bir istek diğer slotların dolmasını engellemez.
+// Worker thread'leri CPU'ya sabitlenmez: bir worker sabit bir slota bağlı
+// değildir (context'i önek eşleşmesine göre alır) ve ağır hesap, cpu_affinity
+// ile sabitlenen ggml threadpool'larında (ThreadpoolManager) yürür.
 class DynamicBatcher {
  public:
-  DynamicBatcher(size_t max_batch_size, std::chrono::milliseconds max_wait_time)
-      : max_batch_size_(max_batch_size),
-        max_wait_time_(max_wait_time),
-        running_(true),
-        processing_thread_(&DynamicBatcher::processing_loop, this) {}
+  using RequestCallback = std::function<void(std::shared_ptr<BatchedRequest>)>;
+
+  DynamicBatcher(size_t num_workers, std::chrono::milliseconds max_wait_time,
+                 RequestCallback request_processing_callback,
+                 SchedulingPolicy policy = SchedulingPolicy::FIFO,
+                 std::chrono::milliseconds starvation_bound =
+                     std::chrono::milliseconds(2000),
+                 prometheus::Gauge* in_flight_gauge = nullptr)
+      : max_wait_time_(max_wait_time),
+        request_processing_callback_(std::move(request_processing_callback)),
+        policy_(policy),
+        starvation_bound_(starvation_bound),
+        in_flight_gauge_(in_flight_gauge),
+        running_(true) {
+    if (num_workers == 0) num_workers = 1;
+    workers_.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; ++i) {
+      workers_.emplace_back(&DynamicBatcher::worker_loop, this, i);
+    }
+  }
 
   ~DynamicBatcher() { stop(); }
 
+  // Kabul kapalıysa (drain) istek kuyruğa girmez; finish_reason "draining"
+  // ile hemen tamamlanır.
   std::future<void> add_request(std::shared_ptr<BatchedRequest> request) {
     auto future = request->completion_promise.get_future();
+    request->enqueue_time = std::chrono::steady_clock::now();
+    if (policy_ == SchedulingPolicy::SJF) {
+      request->estimated_cost =
+          estimator_.estimate(*request->request, request->tenant_id,
+                              request->model_profile);
+    }
     {
+      // Kabul kontrolü ve in_flight artışı close() ile aynı kilit altında:
+      // drain 0 okuduktan sonra kuyruğa istek giremez.
       std::lock_guard<std::mutex> lock(queue_mutex_);
-      request_queue_.push(std::move(request));
+      if (accepting_) {
+        in_flight_++;
+        if (in_flight_gauge_) in_flight_gauge_->Increment();
+        if (!request->background) realtime_queued_++;
+        request_queue_.push_back(std::move(request));
+      }
+    }
+    if (request) {
+      request->finish_reason = "draining";
+      request->finish();
+      request->completion_promise.set_value();
+      return future;
     }
     queue_cv_.notify_one();
     return future;
   }
 
+  // Kuyruğa girmeden işlenen işler (embeddings) için in_flight sayacı:
+  // drain onları da bekler. Kabul kapalıysa false; true dönerse iş
+  // bitince end_external() çağrılmalıdır.
+  bool begin_external() {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    if (!accepting_) return false;
+    in_flight_++;
+    if (in_flight_gauge_) in_flight_gauge_->Increment();
+    return true;
+  }
+  void end_external() {
+    in_flight_--;
+    if (in_flight_gauge_) in_flight_gauge_->Decrement();
+  }
+
+  // Yeni istek kabulünü kapatır; kuyruktaki gerçek zamanlı istekler
+  // işlenmeye devam eder. Arka plan istekleri drain'i bekletmesin diye
+  // kuyruktan "draining" ile çıkarılır, çalışanlar bir sonraki token'da
+  // bırakır (bkz. try_preempt).
+  void close() {
+    std::vector<std::shared_ptr<BatchedRequest>> dropped;
+    {
+      std::lock_guard<std::mutex> lock(queue_mutex_);
+      accepting_ = false;
+      auto background = std::stable_partition(
+          request_queue_.begin(), request_queue_.end(),
+          [](const auto& r) { return !r->background; });
+      dropped.assign(std::make_move_iterator(background),
+                     std::make_move_iterator(request_queue_.end()));
+      request_queue_.erase(background, request_queue_.end());
+    }
+    for (auto& req : dropped) {
+      req->finish_reason = "draining";
+      req->finish();
+      req->completion_promise.set_value();
+      in_flight_--;
+      if (in_flight_gauge_) in_flight_gauge_->Decrement();
+    }
+  }
+
   void stop() {
     running_ = false;
     queue_cv_.notify_all();
-    if (processing_thread_.joinable()) {
-      processing_thread_.join();
+    for (auto& worker : workers_) {
+      if (worker.joinable()) worker.join();
     }
   }
 
-  std::function<void(std::vector<std::shared_ptr<BatchedRequest>>&)>
-      batch_processing_callback;
+  WorkEstimator& estimator() { return estimator_; }
+  size_t get_worker_count() const { return workers_.size(); }
+  // Kuyrukta bekleyen + işlenmekte olan istek sayısı.
+  size_t get_in_flight() const { return in_flight_; }
+  // Arka plan isteği her token'da sorar: true ise bırakmalıdır. Boş worker
+  // bulamayan gerçek zamanlı istek başına yalnızca bir arka plan isteği
+  // bırakır (bütçe, bırakan worker tekrar boşa çıkınca iade edilir). Drain
+  // başladıysa tüm arka plan istekleri bırakır.
+  bool try_preempt() {
+    if (!accepting_) {
+      yielding_++;
+      return true;
+    }
+    size_t yielding = yielding_;
+    while (realtime_queued_ > idle_workers_ + yielding) {
+      if (yielding_.compare_exchange_weak(yielding, yielding + 1)) {
+        return true;
+      }
+    }
+    return false;
+  }
 
  private:
-  void processing_loop() {
-    while (running_) {
-      std::vector<std::shared_ptr<BatchedRequest>> batch;
+  // Sıradaki isteği politikaya göre seçer. queue_mutex_ tutulurken çağrılır.
+  std::shared_ptr<BatchedRequest> pop_next_locked() {
+    // Gerçek zamanlı istekler her zaman önce; arka plan istekleri yalnızca
+    // kuyrukta başka istek yokken, geliş sırasıyla alınır.
+    auto pick = std::find_if(request_queue_.begin(), request_queue_.end(),
+                             [](const auto& r) { return !r->background; });
+    if (pick == request_queue_.end()) {
+      pick = request_queue_.begin();
+    } else if (policy_ == SchedulingPolicy::SJF) {
+      // Anti-starvation: sınırı aşan en eski istek her zaman önce alınır.
+      auto waited = std::chrono::steady_clock::now() - (*pick)->enqueue_time;
+      if (waited < starvation_bound_) {
+        for (auto it = pick; it != request_queue_.end(); ++it) {
+          if (!(*it)->background &&
+              (*it)->estimated_cost < (*pick)->estimated_cost)
+            pick = it;
+        }
+      }
+    }
+    auto req = std::move(*pick);
+    request_queue_.erase(pick);
+    if (!req->background) realtime_queued_--;
+    return req;
+  }
+
+  void worker_loop(size_t worker_id) {
+    spdlog::debug("Inference worker #{} started.", worker_id);
+    bool yielded = false;
+    while (true) {
+      std::shared_ptr<BatchedRequest> req;
       {
         std::unique_lock<std::mutex> lock(queue_mutex_);
+        idle_workers_++;
+        // Bırakılan slot artık boş worker olarak sayılıyor.
+        if (yielded) yielding_--;
+        yielded = false;
         queue_cv_.wait_for(lock, max_wait_time_, [this]() {
           return !request_queue_.empty() || !running_;
         });
+        idle_workers_--;
         if (!running_ && request_queue_.empty()) return;
-        while (!request_queue_.empty() && batch.size() < max_batch_size_) {
-          batch.push_back(std::move(request_queue_.front()));
-          request_queue_.pop();
-        }
+        if (request_queue_.empty()) continue;
+        req = pop_next_locked();
       }
 
-      if (!batch.empty() && batch_processing_callback) {
+      try {
+        request_processing_callback_(req);
+        yielded = req->finish_reason == "preempted";
+        if (!req->background && (req->finish_reason == "stop" ||
+                                 req->finish_reason == "length")) {
+          estimator_.observe(req->tenant_id, req->model_profile,
+                             static_cast<double>(req->completion_tokens) /
+                                 std::max<uint32_t>(req->n_choices, 1));
+        }
+        req->finish();
+        try {
+          req->completion_promise.set_value();
+        } catch (...) {
+        }
+      } catch (...) {
+        req->finish_reason = "error";
+        req->finish();
         try {
-          batch_processing_callback(batch);
-          for (auto& req : batch) {
-            req->is_finished = true;
-            try {
-              req->completion_promise.set_value();
-            } catch (...) {
-            }
-          }
+          req->completion_promise.set_exception(std::current_exception());
         } catch (...) {
-          for (auto& req : batch) {
-            req->is_finished = true;
-            try {
-              req->completion_promise.set_exception(std::current_exception());
-            } catch (...) {
-            }
-          }
         }
       }
+      in_flight_--;
+      if (in_flight_gauge_) in_flight_gauge_->Decrement();
     }
   }
 
-  size_t max_batch_size_;
   std::chrono::milliseconds max_wait_time_;
+  RequestCallback request_processing_callback_;
+  SchedulingPolicy policy_;
+  std::chrono::milliseconds starvation_bound_;
+  WorkEstimator estimator_;
+  prometheus::Gauge* in_flight_gauge_;
   std::atomic<bool> running_;
-  std::queue<std::shared_ptr<BatchedRequest>> request_queue_;
+  std::atomic<bool> accepting_{true};
+  std::atomic<size_t> in_flight_{0};
+  std::atomic<size_t> realtime_queued_{0};
+  std::atomic<size_t> idle_workers_{0};
+  // try_preempt ile bırakmış, henüz boşa çıkmamış arka plan istekleri.
+  std::atomic<size_t> yielding_{0};
+  std::deque<std::shared_ptr<BatchedRequest>> request_queue_;
   std::mutex queue_mutex_;
   std::condition_variable queue_cv_;
-  std::thread processing_thread_;
+  std::vector<std::thread> workers_;
 };
\ No newline at end of file
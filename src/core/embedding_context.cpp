@@ -0,0 +1,118 @@
+// Dosya: src/core/embedding_context.cpp
+#include "core/embedding_context.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "common.h"
+#include "core/context_pool.h"
+#include "spdlog/spdlog.h"
+
+EmbeddingContext::EmbeddingContext(llama_model* model,
+                                   const Settings& settings,
+                                   LlamaContextPool& pool)
+    : pool_(pool) {
+  llama_context_params params = llama_context_default_params();
+  params.embeddings = true;
+  params.n_ctx = settings.context_size;
+  // Çift yönlü (encoder) modellerde bir sequence tek ubatch'e sığmalı.
+  params.n_batch = settings.context_size;
+  params.n_ubatch = settings.context_size;
+  params.n_seq_max = kMaxSequences;
+  params.kv_unified = true;
+  params.offload_kqv = settings.kv_offload;
+  params.pooling_type = LLAMA_POOLING_TYPE_UNSPECIFIED;
+
+  ctx_ = llama_init_from_model(model, params);
+  if (ctx_ && llama_pooling_type(ctx_) == LLAMA_POOLING_TYPE_NONE) {
+    // Üretken modellerin GGUF'unda pooling yok; token vektörlerinin
+    // ortalaması alınır.
+    llama_free(ctx_);
+    params.pooling_type = LLAMA_POOLING_TYPE_MEAN;
+    ctx_ = llama_init_from_model(model, params);
+  }
+  if (!ctx_) throw std::runtime_error("Failed to create embeddings context.");
+
+  pool_.attach_auxiliary(ctx_);
+  pooling_ = llama_pooling_type(ctx_);
+  if (pooling_ == LLAMA_POOLING_TYPE_RANK) {
+    llama_free(ctx_);
+    throw std::runtime_error("Reranker models cannot produce embeddings.");
+  }
+  n_batch_ = llama_n_batch(ctx_);
+  n_embd_ = llama_model_n_embd(model);
+  spdlog::info("🧭 Embeddings context ready (dim: {}, pooling: {}).", n_embd_,
+               static_cast<int>(pooling_));
+}
+
+size_t EmbeddingContext::estimate_bytes(const llama_model* model,
+                                        const Settings& settings) {
+  const size_t n_cells = settings.context_size;
+  const size_t n_layer = llama_model_n_layer(model);
+  const size_t n_embd = llama_model_n_embd(model);
+  const size_t n_head = std::max<int32_t>(1, llama_model_n_head(model));
+  const size_t n_embd_gqa = n_embd / n_head * llama_model_n_head_kv(model);
+  // kv_unified: n_seq_max sequence aynı context_size hücreyi paylaşır.
+  size_t kv = n_cells * n_layer * n_embd_gqa * 2 * sizeof(uint16_t);
+  size_t outputs = n_cells * n_embd * sizeof(float);
+  return kv + outputs;
+}
+
+EmbeddingContext::~EmbeddingContext() {
+  if (ctx_) llama_free(ctx_);
+}
+
+std::vector<std::vector<float>> EmbeddingContext::embed(
+    const std::vector<std::vector<llama_token>>& inputs) {
+  std::vector<std::vector<float>> vectors(inputs.size());
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  llama_batch batch = llama_batch_init(n_batch_, 0, 1);
+  try {
+    size_t next = 0;
+    while (next < inputs.size()) {
+      // Sığdığı kadar girdi, her biri kendi sequence'inde.
+      size_t first = next;
+      batch.n_tokens = 0;
+      while (next < inputs.size() &&
+             next - first < static_cast<size_t>(kMaxSequences) &&
+             batch.n_tokens + inputs[next].size() <= n_batch_) {
+        llama_seq_id seq = static_cast<llama_seq_id>(next - first);
+        const auto& tokens = inputs[next];
+        for (size_t pos = 0; pos < tokens.size(); ++pos) {
+          common_batch_add(batch, tokens[pos], pos, {seq}, true);
+        }
+        ++next;
+      }
+      if (next == first) {
+        throw std::invalid_argument("Input exceeds the embeddings context.");
+      }
+
+      // Encoder modellerinde KV yoktur.
+      if (llama_memory_t mem = llama_get_memory(ctx_)) {
+        llama_memory_clear(mem, true);
+      }
+      if (pool_.decode_auxiliary(ctx_, batch) != 0) {
+        throw std::runtime_error("Embeddings decode failed.");
+      }
+
+      for (size_t i = first; i < next; ++i) {
+        const float* embd = llama_get_embeddings_seq(
+            ctx_, static_cast<llama_seq_id>(i - first));
+        if (!embd) throw std::runtime_error("Missing pooled embedding.");
+        double norm = 0.0;
+        for (int32_t d = 0; d < n_embd_; ++d) norm += embd[d] * embd[d];
+        float scale = norm > 0.0 ? static_cast<float>(1.0 / std::sqrt(norm))
+                                 : 0.0f;
+        vectors[i].resize(n_embd_);
+        for (int32_t d = 0; d < n_embd_; ++d) vectors[i][d] = embd[d] * scale;
+      }
+    }
+  } catch (...) {
+    llama_batch_free(batch);
+    throw;
+  }
+  llama_batch_free(batch);
+  return vectors;
+}
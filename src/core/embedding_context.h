@@ -0,0 +1,55 @@
+// Dosya: src/core/embedding_context.h
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "config.h"
+#include "llama.h"
+
+class LlamaContextPool;
+
+// /v1/embeddings için modelin üretim havuzundan ayrı context'i
+// (embeddings = true). Pooling tipi GGUF'tan okunur; üretken modellerde
+// tanımlı değilse ortalama kullanılır. Bir istekteki girdiler ayrı
+// sequence'ler olarak tek llama_batch'e paketlenir: bir decode, n_batch
+// token'a ve kMaxSequences girdiye kadar işler. Çağrılar sıralanır.
+// Hesaplama üretim havuzunun threadpool'unda, onun kilidi altında yürür
+// (bkz. LlamaContextPool::attach_auxiliary); ayrı thread açılmaz.
+class EmbeddingContext {
+ public:
+  static constexpr int32_t kMaxSequences = 64;
+
+  // Context oluşturulamazsa exception fırlatır. pool context'ten uzun
+  // yaşamalıdır.
+  EmbeddingContext(llama_model* model, const Settings& settings,
+                   LlamaContextPool& pool);
+
+  // Oluşturulacak context'in tahmini belleği: context_size hücrelik F16 KV
+  // ve n_batch token'lık float çıktı tamponu (hesap tamponları hariç).
+  static size_t estimate_bytes(const llama_model* model,
+                               const Settings& settings);
+  ~EmbeddingContext();
+
+  EmbeddingContext(const EmbeddingContext&) = delete;
+  EmbeddingContext& operator=(const EmbeddingContext&) = delete;
+
+  int32_t dimensions() const { return n_embd_; }
+  // Tek girdinin azami token sayısı.
+  uint32_t max_input_tokens() const { return n_batch_; }
+  enum llama_pooling_type pooling() const { return pooling_; }
+
+  // Girdi başına L2-normalize vektör (girdi sırasıyla).
+  std::vector<std::vector<float>> embed(
+      const std::vector<std::vector<llama_token>>& inputs);
+
+ private:
+  LlamaContextPool& pool_;
+  llama_context* ctx_ = nullptr;
+  uint32_t n_batch_ = 0;
+  int32_t n_embd_ = 0;
+  enum llama_pooling_type pooling_ = LLAMA_POOLING_TYPE_NONE;
+  std::mutex mutex_;
+};
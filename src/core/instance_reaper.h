@@ -0,0 +1,107 @@
+// Dosya: src/core/instance_reaper.h
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+
+#include "core/model_instance.h"
+
+// Model örneklerini ayrı bir thread'de siler. adopt() ile yayınlanan
+// örneğin son sahibi (çoğunlukla bir worker) bıraktığında örnek kuyruğa
+// girer; ağırlık ve KV belleğinin iadesi isteği yürüten thread'i ve model
+// değişimini yapan HTTP thread'ini bekletmez. Soğuk değişim belleğin
+// iadesini wait_released() ile bekler (use_count yoklaması yok).
+class InstanceReaper : public std::enable_shared_from_this<InstanceReaper> {
+ public:
+  static std::shared_ptr<InstanceReaper> create() {
+    std::shared_ptr<InstanceReaper> reaper(new InstanceReaper());
+    reaper->thread_ = std::thread(&InstanceReaper::loop, reaper.get());
+    return reaper;
+  }
+
+  ~InstanceReaper() { stop(); }
+
+  InstanceReaper(const InstanceReaper&) = delete;
+  InstanceReaper& operator=(const InstanceReaper&) = delete;
+
+  std::shared_ptr<ModelInstance> adopt(std::unique_ptr<ModelInstance> owned) {
+    ModelInstance* raw = owned.release();
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      live_.insert(raw);
+    }
+    // Deleter reaper'ı canlı tutar; reaper durduysa örnek yerinde silinir.
+    auto self = shared_from_this();
+    return std::shared_ptr<ModelInstance>(
+        raw, [self](ModelInstance* instance) { self->enqueue(instance); });
+  }
+
+  // Örnek silinene kadar (en fazla timeout) bekler; silindiyse true.
+  bool wait_released(const ModelInstance* instance,
+                     std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    return released_cv_.wait_for(lock, timeout, [this, instance] {
+      return live_.count(instance) == 0;
+    });
+  }
+
+  // Kuyruktakileri silip thread'i durdurur; sonrakiler yerinde silinir.
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    if (thread_.joinable()) thread_.join();
+  }
+
+ private:
+  InstanceReaper() = default;
+
+  void enqueue(ModelInstance* instance) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!stopping_) {
+        queue_.push_back(instance);
+        cv_.notify_one();
+        return;
+      }
+    }
+    destroy(instance);
+  }
+
+  void destroy(ModelInstance* instance) {
+    delete instance;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      live_.erase(instance);
+    }
+    released_cv_.notify_all();
+  }
+
+  void loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+      if (queue_.empty()) return;
+      ModelInstance* instance = queue_.front();
+      queue_.pop_front();
+      lock.unlock();
+      destroy(instance);
+      lock.lock();
+    }
+  }
+
+  std::mutex mutex_;
+  std::condition_variable cv_;           // Silinecek örnek veya kapanış
+  std::condition_variable released_cv_;  // Bir örnek silindi
+  std::deque<ModelInstance*> queue_;
+  std::set<const ModelInstance*> live_;
+  bool stopping_ = false;
+  std::thread thread_;
+};
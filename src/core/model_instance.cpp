@@ -0,0 +1,155 @@
+// Dosya: src/core/model_instance.cpp
+#include "core/model_instance.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+#include "core/model_prefetcher.h"
+#include "spdlog/spdlog.h"
+
+ModelInstance::ModelInstance(const Settings& settings,
+                             prometheus::Gauge& active_contexts_gauge,
+                             std::atomic<double>* load_progress)
+    : settings_(settings) {
+  // mmap'li ağırlıklar ilk isteklerde sayfalanıp TTFT'yi bozmasın; örnek
+  // yayına alınmadan önce page cache'te olsunlar. mmap kapalıyken llama.cpp
+  // dosyayı zaten tamamen okur.
+  if (settings_.use_mmap && settings_.prefetch_weights) {
+    ModelPrefetcher::prefetch(settings_.model_path, settings_.prefetch_threads,
+                              load_progress);
+  }
+
+  llama_model_params model_params = llama_model_default_params();
+  model_params.n_gpu_layers = settings_.n_gpu_layers;
+  model_params.use_mmap = settings_.use_mmap;
+  model_params.use_mlock = settings_.use_mlock;
+
+  spdlog::info("⚙️ Loading model from: {}", settings_.model_path);
+  model_ =
+      llama_model_load_from_file(settings_.model_path.c_str(), model_params);
+  if (!model_) throw std::runtime_error("Failed to load model file.");
+
+  try {
+    context_pool_ = std::make_unique<LlamaContextPool>(settings_, model_,
+                                                       active_contexts_gauge);
+  } catch (...) {
+    llama_model_free(model_);
+    throw;
+  }
+  formatter_ = create_formatter(settings_.model_id);
+}
+
+ModelInstance::~ModelInstance() {
+  embeddings_.reset();
+  context_pool_.reset();
+  clear_adapter_cache();
+  if (model_) llama_model_free(model_);
+  spdlog::info("🗑️ Model instance '{}' released.", settings_.profile_name);
+}
+
+EmbeddingContext& ModelInstance::embeddings() {
+  std::lock_guard<std::mutex> lock(embeddings_mutex_);
+  if (!embeddings_) {
+    size_t bytes = EmbeddingContext::estimate_bytes(model_, settings_);
+    if (!context_pool_->reserve_bytes(bytes)) {
+      throw std::runtime_error(
+          "Embeddings context (~" + std::to_string(bytes / (1024 * 1024)) +
+          " MB) does not fit the pool memory budget.");
+    }
+    try {
+      embeddings_ = std::make_unique<EmbeddingContext>(model_, settings_,
+                                                       *context_pool_);
+    } catch (...) {
+      context_pool_->release_bytes(bytes);
+      throw;
+    }
+    embeddings_bytes_ = bytes;
+  }
+  return *embeddings_;
+}
+
+// --- LORA MANAGEMENT (LRU HARDENING) ---
+
+void ModelInstance::evict_oldest_lora() {
+  if (lora_lru_list_.empty()) return;
+  std::string oldest_id = lora_lru_list_.back();
+  lora_lru_list_.pop_back();
+
+  auto it = lora_cache_.find(oldest_id);
+  if (it != lora_cache_.end()) {
+    spdlog::info("♻️ Evicting LoRA adapter from cache: {}", oldest_id);
+    llama_adapter_lora_free(it->second);
+    lora_cache_.erase(it);
+  }
+}
+
+struct llama_adapter_lora* ModelInstance::get_or_load_adapter(
+    const std::string& lora_id) {
+  std::lock_guard<std::mutex> lock(lora_mutex_);
+
+  // Check Cache
+  auto it = lora_cache_.find(lora_id);
+  if (it != lora_cache_.end()) {
+    // Update LRU: move to front
+    lora_lru_list_.remove(lora_id);
+    lora_lru_list_.push_front(lora_id);
+    return it->second;
+  }
+
+  // Security & Path Check
+  std::string sanitized_id = lora_id;
+  sanitized_id.erase(std::remove(sanitized_id.begin(), sanitized_id.end(), '/'),
+                     sanitized_id.end());
+  sanitized_id.erase(
+      std::remove(sanitized_id.begin(), sanitized_id.end(), '\\'),
+      sanitized_id.end());
+
+  namespace fs = std::filesystem;
+  fs::path lora_path = fs::path(settings_.lora_dir) / (sanitized_id + ".gguf");
+  if (!fs::exists(lora_path)) {
+    lora_path = fs::path(settings_.lora_dir) / (sanitized_id + ".bin");
+  }
+
+  if (!fs::exists(lora_path)) {
+    spdlog::error("❌ LoRA adapter not found: {}", lora_path.string());
+    return nullptr;
+  }
+
+  // Capacity Control
+  if (lora_cache_.size() >= MAX_LORA_CACHE_SIZE) {
+    evict_oldest_lora();
+  }
+
+  spdlog::info("💾 Loading LoRA adapter: {}", sanitized_id);
+  struct llama_adapter_lora* adapter =
+      llama_adapter_lora_init(model_, lora_path.c_str());
+
+  if (adapter) {
+    lora_cache_[sanitized_id] = adapter;
+    lora_lru_list_.push_front(sanitized_id);
+    return adapter;
+  }
+  return nullptr;
+}
+
+bool ModelInstance::apply_lora_to_context(llama_context* ctx,
+                                          const std::string& lora_adapter_id) {
+  if (lora_adapter_id.empty()) return true;
+  auto* adapter = get_or_load_adapter(lora_adapter_id);
+  if (!adapter) return false;
+  return llama_set_adapter_lora(ctx, adapter, 1.0f) == 0;
+}
+
+void ModelInstance::clear_lora_from_context(llama_context* ctx) {
+  llama_clear_adapter_lora(ctx);
+}
+
+void ModelInstance::clear_adapter_cache() {
+  std::lock_guard<std::mutex> lock(lora_mutex_);
+  for (auto& [id, adapter] : lora_cache_) {
+    if (adapter) llama_adapter_lora_free(adapter);
+  }
+  lora_cache_.clear();
+  lora_lru_list_.clear();
+}
@@ -0,0 +1,75 @@
+// Dosya: src/core/model_instance.h
+#pragma once
+
+#include <prometheus/gauge.h>
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "config.h"
+#include "core/context_pool.h"
+#include "core/embedding_context.h"
+#include "core/prompt_formatter.h"
+#include "llama.h"
+
+// Yüklü bir modelin çalışması için gereken her şey: ağırlıklar, context
+// havuzu, formatlayıcı, LoRA önbelleği ve bunları üreten ayarlar.
+// Engine bunu shared_ptr ile yayınlar; istekler işlem boyunca kendi
+// kopyalarını tutar, böylece model değişiminde eski örnek son istek bitene
+// kadar yaşar.
+class ModelInstance {
+ public:
+  // Modeli yükler ve havuzu kurar; başarısızlıkta exception fırlatır.
+  // load_progress verilirse ağırlık ön okuması boyunca 0..1 güncellenir.
+  ModelInstance(const Settings& settings,
+                prometheus::Gauge& active_contexts_gauge,
+                std::atomic<double>* load_progress = nullptr);
+  ~ModelInstance();
+
+  ModelInstance(const ModelInstance&) = delete;
+  ModelInstance& operator=(const ModelInstance&) = delete;
+
+  const Settings& settings() const { return settings_; }
+  llama_model* model() const { return model_; }
+  LlamaContextPool& context_pool() { return *context_pool_; }
+  PromptFormatter& formatter() { return *formatter_; }
+
+  // LoRA adaptörünü Context seviyesinde uygular
+  bool apply_lora_to_context(llama_context* ctx,
+                             const std::string& lora_adapter_id);
+
+  // Context üzerindeki tüm adaptörleri temizler
+  void clear_lora_from_context(llama_context* ctx);
+
+  // /v1/embeddings context'i; ilk çağrıda oluşturulur. Tahmini boyutu
+  // havuzun bellek bütçesinden ayrılır; sığmazsa veya oluşturulamazsa
+  // std::runtime_error fırlatır.
+  EmbeddingContext& embeddings();
+  // Oluşturulmuş embeddings context'inin tahmini boyutu; yoksa 0.
+  size_t embeddings_bytes() const { return embeddings_bytes_; }
+
+ private:
+  // LoRA Adapter Cache Yönetimi (Hardened with capacity limit)
+  struct llama_adapter_lora* get_or_load_adapter(const std::string& lora_id);
+  void clear_adapter_cache();
+  void evict_oldest_lora();
+
+  const Settings settings_;
+  llama_model* model_ = nullptr;
+  std::unique_ptr<LlamaContextPool> context_pool_;
+  std::unique_ptr<PromptFormatter> formatter_;
+  std::unique_ptr<EmbeddingContext> embeddings_;
+  std::atomic<size_t> embeddings_bytes_{0};
+  std::mutex embeddings_mutex_;
+
+  // LoRA Cache (ID -> Pointer + LRU Tracker)
+  std::map<std::string, struct llama_adapter_lora*> lora_cache_;
+  std::list<std::string> lora_lru_list_;
+  const size_t MAX_LORA_CACHE_SIZE =
+      8;  // Max 8 unique LoRA at the same time to save VRAM
+  std::mutex lora_mutex_;
+};
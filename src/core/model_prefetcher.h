@@ -0,0 +1,23 @@
+// Dosya: src/core/model_prefetcher.h
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+namespace ModelPrefetcher {
+
+struct Result {
+  size_t bytes = 0;
+  double seconds = 0.0;
+  bool ok = false;
+};
+
+// GGUF dosyasının tensör verisini paralel pread ile page cache'e okur.
+// use_mmap ile yüklenen ağırlıklar ilk isteklerde tembelce sayfalanmak
+// yerine yükleme aşamasında diskten gelir. progress (verilirse) 0..1
+// arasında güncellenir. n_threads <= 0 ise çekirdek sayısına göre seçilir.
+Result prefetch(const std::string& path, int n_threads,
+                std::atomic<double>* progress = nullptr);
+
+}  // namespace ModelPrefetcher
@@ -24,7 +24,6 @@ class ModelWarmup {
         try {
           // Context'i al
           ContextGuard guard = pool.acquire();
-          llama_context* ctx = guard.get();
 
           // GÜVENLİ WARM-UP - sampling hatasını önle
           const char* warmup_prompt = "Hello";
@@ -43,12 +42,13 @@ class ModelWarmup {
             // Batch oluştur ve decode et
             llama_batch batch = llama_batch_init(n_tokens, 0, 1);
             for (int j = 0; j < n_tokens; ++j) {
-              common_batch_add(batch, tokens[j], j, {0}, false);
+              common_batch_add(batch, tokens[j], j, {guard.get_seq_id()},
+                               false);
             }
             batch.logits[batch.n_tokens - 1] = true;
 
             // İlk decode (warm-up için kritik)
-            if (llama_decode(ctx, batch) == 0) {
+            if (guard.decode(batch) == 0) {
               // GÜVENLİ SAMPLING - basit yaklaşım
               // Sadece 1 token decode et, sampling yapma
               llama_batch_free(batch);
@@ -56,8 +56,9 @@ class ModelWarmup {
 
               // Basit bir token seç (genellikle space token'ı)
               llama_token safe_token = 13;  // Genellikle space/newline
-              common_batch_add(batch, safe_token, n_tokens, {0}, true);
-              llama_decode(ctx, batch);
+              common_batch_add(batch, safe_token, n_tokens,
+                               {guard.get_seq_id()}, true);
+              guard.decode(batch);
             }
 
             llama_batch_free(batch);
@@ -93,9 +94,8 @@ class ModelWarmup {
     for (size_t i = 0; i < num_contexts; ++i) {
       try {
         ContextGuard guard = pool.acquire();
-        llama_context* ctx = guard.get();
 
-        llama_memory_seq_rm(llama_get_memory(ctx), -1, 0, -1);
+        guard.clear_kv(0);
 
         // DÜZELTME: Biraz daha uzun bir prompt
         const char* quick_prompt = "System initialization sequence: Active.";
@@ -112,19 +112,20 @@ class ModelWarmup {
           // Batch boyutu artırıldı
           llama_batch batch = llama_batch_init(n_tokens, 0, 1);
           for (int j = 0; j < n_tokens; ++j) {
-            common_batch_add(batch, tokens[j], j, {0}, false);
+            common_batch_add(batch, tokens[j], j, {guard.get_seq_id()},
+                             false);
           }
 
           // Logit hesaplamasını zorla (GPU hesaplama yapsın)
           batch.logits[batch.n_tokens - 1] = true;
 
-          if (llama_decode(ctx, batch) != 0) {
+          if (guard.decode(batch) != 0) {
             spdlog::warn("Warmup decode returned non-zero for context {}", i);
           }
           llama_batch_free(batch);
         }
 
-        llama_memory_seq_rm(llama_get_memory(ctx), -1, 0, -1);
+        guard.clear_kv(0);
 
         spdlog::debug("⚡ Context {} warm-up done", i);
 
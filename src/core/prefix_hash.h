@@ -0,0 +1,109 @@
+// Dosya: src/core/prefix_hash.h
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "llama.h"
+
+// Önek parmak izi: prompt token'ları kBlockTokens'lık bloklar halinde
+// zincirlenerek hash'lenir; k. bloğun değeri ilk k+1 bloğun tamamını temsil
+// eder. Aynı model dosyasıyla çalışan replikalar aynı değeri üretir;
+// gateway bunu yanıttan alıp /v1/cache/probe ile replikalara sorar. Kiracı
+// tohuma katılır: bir kiracı tahmin ettiği prompt'un parmak iziyle başka
+// kiracının önbelleğini sorgulayamaz.
+class PrefixHasher {
+ public:
+  static constexpr size_t kBlockTokens = 64;
+
+  struct Fingerprint {
+    uint64_t hash = 0;
+    size_t tokens = 0;  // Kapsanan token (kBlockTokens'ın katı; 0 = yok)
+  };
+
+  // model_key farklı modellerin aynı token dizilerini ayırır.
+  explicit PrefixHasher(std::string_view model_key) {
+    for (unsigned char c : model_key) seed_ = (seed_ ^ c) * kFnvPrime;
+  }
+
+  // Her tam blok sonunda fn(hash, kapsanan_token) çağrılır; fn false
+  // dönerse durur.
+  template <typename Fn>
+  void for_each_block(const std::vector<llama_token>& tokens,
+                      std::string_view tenant, Fn&& fn) const {
+    uint64_t h = seed_;
+    for (unsigned char c : tenant) h = (h ^ c) * kFnvPrime;
+    h = (h ^ 0xffu) * kFnvPrime;  // Kiracı ile token'lar arasında ayraç
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      h = (h ^ static_cast<uint32_t>(tokens[i])) * kFnvPrime;
+      if ((i + 1) % kBlockTokens == 0 && !fn(finalize(h), i + 1)) return;
+    }
+  }
+
+  // Tüm tam blokları kapsayan parmak izi.
+  Fingerprint fingerprint(const std::vector<llama_token>& tokens,
+                          std::string_view tenant) const {
+    Fingerprint last;
+    for_each_block(tokens, tenant, [&last](uint64_t hash, size_t covered) {
+      last = {hash, covered};
+      return true;
+    });
+    return last;
+  }
+
+  // Blok başına hash (i. değer ilk (i+1) * kBlockTokens token'ı kapsar).
+  std::vector<uint64_t> block_hashes(const std::vector<llama_token>& tokens,
+                                     std::string_view tenant) const {
+    std::vector<uint64_t> hashes;
+    hashes.reserve(tokens.size() / kBlockTokens);
+    for_each_block(tokens, tenant, [&hashes](uint64_t hash, size_t) {
+      hashes.push_back(hash);
+      return true;
+    });
+    return hashes;
+  }
+
+  static std::string format(uint64_t hash) {
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx",
+                  static_cast<unsigned long long>(hash));
+    return buf;
+  }
+
+  static bool parse(const std::string& text, uint64_t& hash) {
+    if (text.empty() || text.size() > 16) return false;
+    hash = 0;
+    for (char c : text) {
+      int digit;
+      if (c >= '0' && c <= '9') {
+        digit = c - '0';
+      } else if (c >= 'a' && c <= 'f') {
+        digit = c - 'a' + 10;
+      } else if (c >= 'A' && c <= 'F') {
+        digit = c - 'A' + 10;
+      } else {
+        return false;
+      }
+      hash = (hash << 4) | static_cast<uint64_t>(digit);
+    }
+    return true;
+  }
+
+ private:
+  static constexpr uint64_t kFnvPrime = 0x100000001b3ULL;
+
+  // FNV'nin zayıf alt bitlerini dağıtır (splitmix64 sonu).
+  static uint64_t finalize(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+  }
+
+  uint64_t seed_ = 0xcbf29ce484222325ULL;
+};
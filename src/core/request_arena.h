@@ -0,0 +1,101 @@
+// Dosya: src/core/request_arena.h
+#pragma once
+
+#include <google/protobuf/arena.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Mesajı arena üzerinde kurar. protobuf < 22'de Arena::Create mesajı
+// arena'ya bağlamaz (alt alanlar heap'e gider); orada CreateMessage gerekir.
+template <typename T>
+T* create_on_arena(google::protobuf::Arena* arena) {
+#if GOOGLE_PROTOBUF_VERSION < 4022000
+  return google::protobuf::Arena::CreateMessage<T>(arena);
+#else
+  return google::protobuf::Arena::Create<T>(arena);
+#endif
+}
+
+// İstek başına protobuf arena'ları için geri dönüşümlü havuz.
+// Her arena sabit bir başlangıç bloğu üzerinde kurulur; Reset() bu bloğu
+// korur. Havuzdan alınan arena, history ve RAG içeriği bloğa sığdığı sürece
+// istek boyunca hiç heap ayırmaz; tüm mesaj ağacı tek seferde bırakılır.
+class RequestArenaPool {
+ public:
+  static constexpr size_t kInitialBlockBytes = 64 * 1024;
+  static constexpr size_t kMaxPooled = 64;
+
+  struct Slot {
+    std::unique_ptr<char[]> block;
+    std::unique_ptr<google::protobuf::Arena> arena;
+  };
+
+  struct Releaser {
+    RequestArenaPool* pool;
+    void operator()(Slot* slot) const { pool->release(slot); }
+  };
+  using Lease = std::unique_ptr<Slot, Releaser>;
+
+  struct Stats {
+    uint64_t acquired = 0;       // Toplam kiralama
+    uint64_t created = 0;        // Havuz boşken yeni arena + blok ayırma
+    uint64_t spilled_bytes = 0;  // Başlangıç bloğuna sığmayıp heap'e taşan
+  };
+
+  static RequestArenaPool& instance() {
+    static RequestArenaPool pool;
+    return pool;
+  }
+
+  Lease acquire() {
+    acquired_++;
+    Slot* slot = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!free_.empty()) {
+        slot = free_.back().release();
+        free_.pop_back();
+      }
+    }
+    if (!slot) {
+      created_++;
+      slot = new Slot;
+      slot->block = std::make_unique<char[]>(kInitialBlockBytes);
+      slot->arena = std::make_unique<google::protobuf::Arena>(
+          slot->block.get(), kInitialBlockBytes);
+    }
+    return Lease(slot, Releaser{this});
+  }
+
+  Stats stats() const {
+    Stats s;
+    s.acquired = acquired_;
+    s.created = created_;
+    s.spilled_bytes = spilled_bytes_;
+    return s;
+  }
+
+ private:
+  RequestArenaPool() = default;
+
+  void release(Slot* slot) {
+    std::unique_ptr<Slot> owned(slot);
+    uint64_t allocated = owned->arena->SpaceAllocated();
+    if (allocated > kInitialBlockBytes) {
+      spilled_bytes_ += allocated - kInitialBlockBytes;
+    }
+    owned->arena->Reset();
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_.size() < kMaxPooled) free_.push_back(std::move(owned));
+  }
+
+  std::mutex mutex_;
+  std::vector<std::unique_ptr<Slot>> free_;
+  std::atomic<uint64_t> acquired_{0};
+  std::atomic<uint64_t> created_{0};
+  std::atomic<uint64_t> spilled_bytes_{0};
+};
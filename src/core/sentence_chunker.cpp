@@ -0,0 +1,161 @@
+// Dosya: src/core/sentence_chunker.cpp
+#include "core/sentence_chunker.h"
+
+#include <utility>
+
+namespace {
+
+// Sonrasında nokta cümleyi bitirmeyen kısaltmalar (büyük/küçük harf
+// karşılaştırması UTF-8'de pahalı olduğundan yaygın yazımlar ayrı ayrı).
+constexpr std::string_view kAbbreviations[] = {
+    "Dr",  "Prof", "Doç", "Yrd", "Öğr", "Gör", "Uzm", "Op",  "Av",
+    "Sn",  "Müh",  "Mim", "Ecz", "Hz",  "Alb", "Gen", "Org", "Bnb",
+    "Mr",  "Mrs",  "Ms",  "St",  "vb",  "vs",  "vd",  "bkz", "Bkz",
+    "örn", "Örn",  "krş", "yy",  "sf",  "no",  "No",  "Tel", "tel",
+    "Cad", "cad",  "Sok", "sok", "Mah", "mah", "Apt", "apt", "Blv",
+    "Ltd", "Şti",  "Tic", "A.Ş", "T.C"};
+
+constexpr std::string_view kLowercaseTurkish[] = {"ç", "ğ", "ı",
+                                                  "ö", "ş", "ü"};
+
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Cümle sonu işaretinin bayt uzunluğu; değilse 0.
+size_t terminator_len(std::string_view s, size_t i) {
+  char c = s[i];
+  if (c == '.' || c == '!' || c == '?') return 1;
+  if (s.compare(i, 3, "…") == 0) return 3;
+  return 0;
+}
+
+// Cümle sonu işaretinden sonra gelebilen kapanış işaretleri.
+size_t closer_len(std::string_view s, size_t i) {
+  char c = s[i];
+  if (c == '"' || c == '\'' || c == ')' || c == ']') return 1;
+  if (s.compare(i, 2, "»") == 0) return 2;
+  if (s.compare(i, 3, "”") == 0 || s.compare(i, 3, "’") == 0) return 3;
+  return 0;
+}
+
+bool starts_lowercase(std::string_view s) {
+  if (s.empty()) return false;
+  if (s[0] >= 'a' && s[0] <= 'z') return true;
+  for (auto lower : kLowercaseTurkish) {
+    if (s.substr(0, lower.size()) == lower) return true;
+  }
+  return false;
+}
+
+size_t utf8_char_len(unsigned char lead) {
+  if (lead < 0x80) return 1;
+  if ((lead & 0xE0) == 0xC0) return 2;
+  if ((lead & 0xF0) == 0xE0) return 3;
+  return 4;
+}
+
+// s[dot]'taki noktadan önceki kelime kısaltma ya da baş harf mi?
+bool is_abbreviation(std::string_view s, size_t dot) {
+  if (dot == 0) return false;
+  size_t start = s.find_last_of(" \t\r\n(\"'", dot - 1);
+  start = start == std::string_view::npos ? 0 : start + 1;
+  std::string_view word = s.substr(start, dot - start);
+  if (word.empty()) return false;
+  // Baş harf ("M. Kemal"); tek rakam ise sayı olabilir, sayılmaz.
+  bool digit = word[0] >= '0' && word[0] <= '9';
+  if (!digit && word.size() == utf8_char_len(word[0])) return true;
+  for (auto abbreviation : kAbbreviations) {
+    if (word == abbreviation) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+SentenceChunker::SentenceChunker(size_t min_clause_bytes,
+                                 size_t max_chunk_bytes)
+    : min_clause_bytes_(min_clause_bytes), max_chunk_bytes_(max_chunk_bytes) {}
+
+bool SentenceChunker::next(std::string& out) {
+  size_t end = find_boundary();
+  if (end == 0) return false;
+  out.assign(buffer_, 0, end);
+  buffer_.erase(0, end);
+  scan_pos_ = 0;
+  return true;
+}
+
+std::string SentenceChunker::flush() {
+  std::string rest = std::move(buffer_);
+  buffer_.clear();
+  scan_pos_ = 0;
+  return rest;
+}
+
+size_t SentenceChunker::find_boundary() {
+  std::string_view s = buffer_;
+  size_t i = scan_pos_;
+  while (i < s.size()) {
+    if (i >= max_chunk_bytes_) {
+      // Sınır yok: son boşlukta, o da yoksa karakter sınırında böl.
+      size_t space = s.find_last_of(" \t", i - 1);
+      if (space != std::string_view::npos && space > 0) return space + 1;
+      while (i > 0 && (static_cast<unsigned char>(s[i]) & 0xC0) == 0x80) --i;
+      return i;
+    }
+
+    char c = s[i];
+    // Yarım gelmiş çok baytlı karakter (ör. "…"): devamı beklenir.
+    if (i + utf8_char_len(c) > s.size()) break;
+    if (c == '\n') {
+      // Yalnızca boş satırlardan oluşan parça verilmez.
+      if (s.find_first_not_of(" \t\r\n") < i) return i + 1;
+      ++i;
+      continue;
+    }
+
+    if ((c == ',' || c == ';' || c == ':') && i + 2 >= min_clause_bytes_) {
+      if (i + 1 == s.size()) break;
+      if (is_space(s[i + 1])) return i + 2;
+    }
+
+    size_t t = terminator_len(s, i);
+    if (t == 0) {
+      ++i;
+      continue;
+    }
+    // "...", "?!" gibi art arda işaretler ve kapanışlar tek sınırdır.
+    size_t j = i + t;
+    while (j < s.size()) {
+      if (j + utf8_char_len(s[j]) > s.size()) break;
+      size_t n = terminator_len(s, j);
+      if (n == 0) n = closer_len(s, j);
+      if (n == 0) break;
+      j += n;
+    }
+    if (j == s.size() || j + utf8_char_len(s[j]) > s.size()) break;
+    if (!is_space(s[j])) {
+      // "3.5", "www.site.com" gibi.
+      i = j;
+      continue;
+    }
+    if (s[j] == '\n') return j + 1;
+    size_t k = s.find_first_not_of(" \t\r", j);
+    if (k == std::string_view::npos ||
+        k + utf8_char_len(s[k]) > s.size()) {
+      break;
+    }
+    // Türkçede cümle büyük harfle başlar: '"Geliyorum!" dedi.' tek cümle.
+    bool single_dot = c == '.' && j == i + 1;
+    if ((single_dot && is_abbreviation(s, i)) ||
+        starts_lowercase(s.substr(k))) {
+      i = j;
+      continue;
+    }
+    return j + 1;
+  }
+  // Karar için veri yetmedi; taramaya buradan devam edilir.
+  scan_pos_ = i;
+  return 0;
+}
@@ -0,0 +1,45 @@
+// Dosya: src/core/sentence_chunker.h
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+
+// Akış metnini TTS için cümle/yan cümle parçalarına böler (Türkçe kurallı).
+// Cümle sonu: . ! ? … (kapanış tırnağı/parantezi dahil) ardından boşluk, ya
+// da satır sonu. Sonraki kelime küçük harfle başlıyorsa ("15. yüzyıl",
+// '"Geliyorum!" dedi') ya da nokta bir kısaltmadan (Dr., vb., örn. ...) veya
+// tek harfli baş harften sonra geliyorsa cümle sonu sayılmaz. Uzun cümleler
+// , ; : işaretlerinde, o da yoksa max_chunk_bytes'ta son boşlukta bölünür.
+// Parçalar boşluklarıyla birlikte verilir; art arda eklenince özgün metni
+// verir.
+class SentenceChunker {
+ public:
+  static constexpr size_t kDefaultMinClauseBytes = 48;
+  static constexpr size_t kDefaultMaxChunkBytes = 400;
+
+  explicit SentenceChunker(size_t min_clause_bytes = kDefaultMinClauseBytes,
+                           size_t max_chunk_bytes = kDefaultMaxChunkBytes);
+
+  void append(std::string_view text) { buffer_.append(text); }
+
+  // Tamamlanmış bir parça varsa out'a yazar ve tampondan çıkarır.
+  // Bir sınırın kesinleşmesi için ondan sonraki ilk karakter gerekir.
+  bool next(std::string& out);
+
+  // Akış sonu: kalan metnin tamamı (boş olabilir).
+  std::string flush();
+
+  bool empty() const { return buffer_.empty(); }
+
+ private:
+  // buffer_[0, end) içinde bir sınır varsa konumunu (parçanın bittiği
+  // bayt) döndürür; yoksa 0. Karar için veri yetmezse de 0.
+  size_t find_boundary();
+
+  size_t min_clause_bytes_;
+  size_t max_chunk_bytes_;
+  std::string buffer_;
+  // Bu konumdan öncesi sınır içermediği kesinleşmiş bölge.
+  size_t scan_pos_ = 0;
+};
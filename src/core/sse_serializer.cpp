@@ -0,0 +1,87 @@
+// Dosya: src/core/sse_serializer.cpp
+#include "core/sse_serializer.h"
+
+#include <array>
+
+namespace {
+
+// Kaçış gerektiren baytlar: kontrol karakterleri, '"' ve '\\'.
+constexpr std::array<bool, 256> make_escape_table() {
+  std::array<bool, 256> table{};
+  for (int c = 0; c < 0x20; ++c) table[c] = true;
+  table['"'] = true;
+  table['\\'] = true;
+  return table;
+}
+
+constexpr std::array<bool, 256> kNeedsEscape = make_escape_table();
+
+}  // namespace
+
+void append_json_escaped(std::string& out, std::string_view text) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  size_t run_start = 0;
+  for (size_t i = 0; i < text.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(text[i]);
+    if (!kNeedsEscape[c]) continue;
+    // Kaçışsız aralık tek seferde kopyalanır.
+    out.append(text.data() + run_start, i - run_start);
+    run_start = i + 1;
+    switch (c) {
+      case '"':
+        out.append("\\\"", 2);
+        break;
+      case '\\':
+        out.append("\\\\", 2);
+        break;
+      case '\n':
+        out.append("\\n", 2);
+        break;
+      case '\r':
+        out.append("\\r", 2);
+        break;
+      case '\t':
+        out.append("\\t", 2);
+        break;
+      case '\b':
+        out.append("\\b", 2);
+        break;
+      case '\f':
+        out.append("\\f", 2);
+        break;
+      default: {
+        char escaped[6] = {'\\', 'u', '0', '0', kHex[c >> 4], kHex[c & 0xF]};
+        out.append(escaped, sizeof(escaped));
+      }
+    }
+  }
+  out.append(text.data() + run_start, text.size() - run_start);
+}
+
+SseChunkSerializer::SseChunkSerializer(std::string_view id,
+                                       std::string_view model,
+                                       int64_t created, bool with_final_flag)
+    : with_final_flag_(with_final_flag) {
+  prefix_ = "data: {\"id\":\"";
+  append_json_escaped(prefix_, id);
+  prefix_ += "\",\"object\":\"chat.completion.chunk\",\"created\":";
+  prefix_ += std::to_string(created);
+  prefix_ += ",\"model\":\"";
+  append_json_escaped(prefix_, model);
+  prefix_ += "\",\"choices\":[{\"index\":";
+  buffer_.reserve(prefix_.size() + 256);
+}
+
+const std::string& SseChunkSerializer::chunk(std::string_view content,
+                                             bool final, uint32_t index) {
+  buffer_.assign(prefix_);
+  buffer_ += std::to_string(index);
+  buffer_.append(",\"delta\":{\"content\":\"");
+  append_json_escaped(buffer_, content);
+  buffer_.append("\"}}]");
+  if (with_final_flag_) {
+    buffer_.append(final ? ",\"final\":true" : ",\"final\":false");
+  }
+  buffer_.append("}\n\n");
+  return buffer_;
+}
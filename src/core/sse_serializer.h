@@ -0,0 +1,31 @@
+// Dosya: src/core/sse_serializer.h
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// JSON string içeriği olarak kaçışlar (tırnaklar eklenmez). UTF-8 baytları
+// olduğu gibi geçer; girdinin geçerli UTF-8 olması çağıranın sorumluluğudur.
+void append_json_escaped(std::string& out, std::string_view text);
+
+// OpenAI chat.completion.chunk SSE çerçevesi. id, created ve model akış
+// boyunca sabit olduğundan çerçevenin içerikten önceki kısmı bir kez
+// kurulur; her parçada yalnızca içerik kaçışlanıp yeniden kullanılan
+// tampona eklenir. Token başına json nesnesi, dump() veya heap ayırma yoktur.
+class SseChunkSerializer {
+ public:
+  // with_final_flag: her çerçeveye "final" alanı eklenir (cümle modu).
+  SseChunkSerializer(std::string_view id, std::string_view model,
+                     int64_t created, bool with_final_flag = false);
+
+  // "data: {...}\n\n"; sonraki çağrıya kadar geçerlidir. index: n > 1
+  // isteklerde çerçevenin ait olduğu seçenek.
+  const std::string& chunk(std::string_view content, bool final = false,
+                           uint32_t index = 0);
+
+ private:
+  std::string prefix_;
+  bool with_final_flag_;
+  std::string buffer_;
+};
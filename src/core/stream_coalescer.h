@@ -0,0 +1,63 @@
+// Dosya: src/core/stream_coalescer.h
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+// Akış yazıcısında (SSE çerçevesi / gRPC mesajı) ardışık token'ları tek
+// mesajda birleştirme kararı. İlk parça her zaman hemen gider (TTFT
+// korunur); sonrakiler min_chunk_bytes birikene veya en eski bekleyen token
+// max_flush_interval kadar bekleyene dek tutulur. min_chunk_bytes = 0 ise
+// birleştirme kapalıdır: hazır olan her parça hemen gönderilir.
+class StreamCoalescer {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  StreamCoalescer(size_t min_chunk_bytes,
+                  std::chrono::milliseconds max_flush_interval)
+      : min_chunk_bytes_(min_chunk_bytes),
+        max_flush_interval_(max_flush_interval) {}
+
+  bool enabled() const { return min_chunk_bytes_ > 0; }
+  bool has_pending() const { return has_pending_; }
+
+  // Bekleyen mesaja token eklendi.
+  void on_append() {
+    if (has_pending_) return;
+    has_pending_ = true;
+    pending_since_ = Clock::now();
+  }
+
+  // Bekleyen mesaj şimdi gönderilmeli mi? closed: akışın sonu.
+  bool should_flush(size_t pending_bytes, bool closed) const {
+    if (!has_pending_) return false;
+    if (!enabled() || closed || !first_flushed_) return true;
+    return pending_bytes >= min_chunk_bytes_ || Clock::now() >= deadline();
+  }
+
+  void on_flush() {
+    has_pending_ = false;
+    first_flushed_ = true;
+  }
+
+  // Bekleyen mesajın en geç gönderileceği an.
+  Clock::time_point deadline() const {
+    return pending_since_ + max_flush_interval_;
+  }
+
+  // Tüketicinin bir sonraki beklemesi: bekleyen mesaj varsa son tarihe kadar.
+  std::chrono::milliseconds wait_budget(std::chrono::milliseconds idle) const {
+    if (!enabled() || !has_pending_) return idle;
+    auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline() - Clock::now());
+    return std::clamp(left, std::chrono::milliseconds(1), idle);
+  }
+
+ private:
+  size_t min_chunk_bytes_;
+  std::chrono::milliseconds max_flush_interval_;
+  bool has_pending_ = false;
+  bool first_flushed_ = false;
+  Clock::time_point pending_since_;
+};
@@ -0,0 +1,124 @@
+// Dosya: src/core/threadpool_manager.cpp
+#include "core/threadpool_manager.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <utility>
+
+#include "core/cpu_topology.h"
+#include "ggml-cpu.h"
+#include "suts_logger.h"
+
+ThreadpoolManager::ThreadpoolManager(const Settings& settings, size_t n_slots)
+    : bindings_(n_slots) {
+  const std::string& mode = settings.threadpool_mode;
+  int decode_budget = settings.pool_decode_threads > 0
+                          ? settings.pool_decode_threads
+                          : settings.n_threads;
+  int prefill_budget = settings.pool_prefill_threads > 0
+                           ? settings.pool_prefill_threads
+                           : settings.n_threads_batch;
+  decode_budget = std::max(1, decode_budget);
+  prefill_budget = std::max(1, prefill_budget);
+
+  auto cpusets = CpuTopology::plan_context_cpusets(settings, n_slots);
+
+  if (mode == "shared" && n_slots > 0) {
+    // Paylaşımlı havuzlar tüm planlanan çekirdeklerin birleşimine sabitlenir.
+    std::vector<int> cpus;
+    for (const auto& set : cpusets) {
+      cpus.insert(cpus.end(), set.begin(), set.end());
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    if (!cpus.empty()) {
+      decode_budget = std::min<int>(decode_budget, cpus.size());
+      prefill_budget = std::min<int>(prefill_budget, cpus.size());
+    }
+
+    ggml_threadpool* decode = create_pool(cpus, decode_budget);
+    ggml_threadpool* prefill = create_pool(cpus, prefill_budget);
+    shared_decode_mutex_ = std::make_unique<std::mutex>();
+    shared_prefill_mutex_ = std::make_unique<std::mutex>();
+
+    for (auto& b : bindings_) {
+      b.decode = decode;
+      b.prefill = prefill;
+      b.decode_mutex = shared_decode_mutex_.get();
+      b.prefill_mutex = shared_prefill_mutex_.get();
+      b.n_threads = decode_budget;
+      b.n_threads_batch = prefill_budget;
+      b.cpus = cpus;
+    }
+    total_threads_ = decode_budget + prefill_budget;
+
+    SUTS_INFO("THREADPOOL_SHARED", "", "", "",
+              "🧵 Shared threadpools: decode={} prefill={} threads for {} "
+              "context(s). CPUs: [{}]",
+              decode_budget, prefill_budget, n_slots,
+              cpus.empty() ? "any" : CpuTopology::format_cpu_list(cpus));
+    return;
+  }
+
+  bool partitioned = (mode == "partitioned");
+  for (size_t i = 0; i < n_slots; ++i) {
+    auto& b = bindings_[i];
+    b.cpus = cpusets[i];
+    if (partitioned) {
+      b.n_threads = std::max<int>(1, decode_budget / (int)n_slots);
+      b.n_threads_batch = std::max<int>(1, prefill_budget / (int)n_slots);
+    } else {
+      b.n_threads = settings.n_threads;
+      b.n_threads_batch = settings.n_threads_batch;
+    }
+
+    if (!b.cpus.empty()) {
+      // Strict pinning aynı çekirdeğe iki thread koymasın.
+      b.n_threads = std::min<int>(b.n_threads, b.cpus.size());
+      b.n_threads_batch = std::min<int>(b.n_threads_batch, b.cpus.size());
+    }
+
+    // per_context + affinity yoksa llama.cpp'nin kendi havuzu kullanılır.
+    if (partitioned || !b.cpus.empty()) {
+      b.decode = create_pool(b.cpus, b.n_threads);
+      b.prefill = create_pool(b.cpus, b.n_threads_batch);
+    }
+    total_threads_ += b.n_threads + b.n_threads_batch;
+  }
+
+  if (n_slots > 0 && bindings_[0].decode) {
+    auxiliary_decode_mutex_ = std::make_unique<std::mutex>();
+    auxiliary_prefill_mutex_ = std::make_unique<std::mutex>();
+    bindings_[0].decode_mutex = auxiliary_decode_mutex_.get();
+    bindings_[0].prefill_mutex = auxiliary_prefill_mutex_.get();
+  }
+
+  if (partitioned) {
+    SUTS_INFO("THREADPOOL_PARTITIONED", "", "", "",
+              "🧵 Partitioned threadpools: {} context(s) x (decode={}, "
+              "prefill={}) threads.",
+              n_slots, n_slots ? bindings_[0].n_threads : 0,
+              n_slots ? bindings_[0].n_threads_batch : 0);
+  }
+}
+
+void ThreadpoolManager::PoolDeleter::operator()(ggml_threadpool* pool) const {
+  ggml_threadpool_free(pool);
+}
+
+ggml_threadpool* ThreadpoolManager::create_pool(const std::vector<int>& cpus,
+                                                int n_threads) {
+  ggml_threadpool_params tpp = ggml_threadpool_params_default(n_threads);
+  if (!cpus.empty()) {
+    std::fill(std::begin(tpp.cpumask), std::end(tpp.cpumask), false);
+    for (int cpu : cpus) {
+      if (cpu < GGML_MAX_N_THREADS) tpp.cpumask[cpu] = true;
+    }
+    tpp.strict_cpu = true;
+  }
+
+  PoolPtr pool(ggml_threadpool_new(&tpp));
+  if (!pool) throw std::runtime_error("Failed to create ggml threadpool.");
+  owned_pools_.push_back(std::move(pool));
+  return owned_pools_.back().get();
+}
@@ -0,0 +1,62 @@
+// Dosya: src/core/threadpool_manager.h
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "config.h"
+#include "llama.h"
+
+// Context'lerin kullandığı ggml threadpool'larının sahibi.
+// threadpool_mode:
+//   "per_context" -> eski davranış; sadece cpu_affinity varsa context başına
+//                    sabitlenmiş havuz, yoksa llama.cpp kendi havuzunu kurar
+//   "shared"      -> tüm context'ler tek decode + tek prefill havuzunu
+//                    paylaşır; aynı havuzda hesaplama mutex ile sıralanır
+//   "partitioned" -> decode/prefill thread bütçesi context'lere bölünür
+// Her iki modda da toplam inference thread sayısı context sayısından
+// bağımsız olarak bütçe ile sınırlıdır.
+class ThreadpoolManager {
+ public:
+  struct Binding {
+    ggml_threadpool* decode = nullptr;
+    ggml_threadpool* prefill = nullptr;
+    // Havuz birden fazla context'e bağlıysa dolu; aksi halde nullptr.
+    std::mutex* decode_mutex = nullptr;
+    std::mutex* prefill_mutex = nullptr;
+    int n_threads = 1;
+    int n_threads_batch = 1;
+    std::vector<int> cpus;
+  };
+
+  ThreadpoolManager(const Settings& settings, size_t n_slots);
+
+  ThreadpoolManager(const ThreadpoolManager&) = delete;
+  ThreadpoolManager& operator=(const ThreadpoolManager&) = delete;
+
+  const Binding& binding(size_t slot) const { return bindings_[slot]; }
+  // Havuz dışı context'ler (embeddings) için: slot 0'ın havuzları. Bu
+  // havuzlar artık iki context'e bağlı olduğundan mutex'leri her modda
+  // doludur; ek thread açılmaz, bütçe aşılmaz.
+  const Binding& auxiliary_binding() const { return bindings_[0]; }
+  size_t get_total_threads() const { return total_threads_; }
+
+ private:
+  struct PoolDeleter {
+    void operator()(ggml_threadpool* pool) const;
+  };
+  using PoolPtr = std::unique_ptr<ggml_threadpool, PoolDeleter>;
+
+  ggml_threadpool* create_pool(const std::vector<int>& cpus, int n_threads);
+
+  std::vector<Binding> bindings_;
+  // Kurucu yarıda throw ederse önceden açılan havuzlar da serbest kalır.
+  std::vector<PoolPtr> owned_pools_;
+  std::unique_ptr<std::mutex> shared_decode_mutex_;
+  std::unique_ptr<std::mutex> shared_prefill_mutex_;
+  // shared dışındaki modlarda slot 0 havuzlarının kilitleri.
+  std::unique_ptr<std::mutex> auxiliary_decode_mutex_;
+  std::unique_ptr<std::mutex> auxiliary_prefill_mutex_;
+  size_t total_threads_ = 0;
+};
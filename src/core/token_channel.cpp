@@ -0,0 +1,135 @@
+// Dosya: src/core/token_channel.cpp
+#include "core/token_channel.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+size_t round_up_pow2(size_t n) {
+  size_t p = 1;
+  while (p < n) p <<= 1;
+  return p;
+}
+
+// word hâlâ 'expected' ise en fazla timeout kadar uyur.
+void futex_wait(std::atomic<uint32_t>& word, uint32_t expected,
+                std::chrono::milliseconds timeout) {
+#ifdef __linux__
+  struct timespec ts;
+  ts.tv_sec = timeout.count() / 1000;
+  ts.tv_nsec = (timeout.count() % 1000) * 1000000;
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT_PRIVATE,
+          expected, &ts, nullptr, 0);
+#else
+  // Futex olmayan platformlarda kısa aralıklı yoklama.
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while (word.load() == expected && std::chrono::steady_clock::now() < deadline)
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+}
+
+void futex_wake(std::atomic<uint32_t>& word) {
+#ifdef __linux__
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE_PRIVATE, 1,
+          nullptr, nullptr, 0);
+#else
+  (void)word;
+#endif
+}
+
+}  // namespace
+
+TokenChannel::TokenChannel(size_t max_tokens, size_t max_bytes) {
+  size_t n_records = round_up_pow2(std::max<size_t>(max_tokens, 2));
+  byte_capacity_ = round_up_pow2(std::max<size_t>(max_bytes, 256));
+  record_mask_ = n_records - 1;
+  byte_mask_ = byte_capacity_ - 1;
+  records_ = std::make_unique<Record[]>(n_records);
+  bytes_ = std::make_unique<char[]>(byte_capacity_);
+}
+
+bool TokenChannel::try_push(llama_token id, std::string_view text,
+                            uint32_t choice) {
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) > record_mask_) {
+    return false;
+  }
+  // Tek token halkadan büyükse sığacak kadarı yazılır (pratikte olmaz;
+  // token parçaları birkaç bayttır).
+  size_t length = std::min(text.size(), byte_capacity_);
+
+  // Metin halkanın sonunu aşacaksa baştan başlar; aradaki boşluk, kayıt
+  // okunduğunda tüketici tarafından birlikte iade edilir.
+  uint64_t begin = byte_head_.load(std::memory_order_relaxed);
+  size_t offset = begin & byte_mask_;
+  if (offset + length > byte_capacity_) begin += byte_capacity_ - offset;
+  if (begin + length - byte_tail_.load(std::memory_order_acquire) >
+      byte_capacity_) {
+    return false;
+  }
+
+  std::memcpy(bytes_.get() + (begin & byte_mask_), text.data(), length);
+  Record& rec = records_[head & record_mask_];
+  rec.id = id;
+  rec.length = static_cast<uint32_t>(length);
+  rec.byte_begin = begin;
+  rec.choice = choice;
+  byte_head_.store(begin + length, std::memory_order_relaxed);
+  head_.store(head + 1, std::memory_order_release);
+  notify_data();
+  return true;
+}
+
+bool TokenChannel::wait_for_space(std::chrono::milliseconds timeout) {
+  uint32_t seen = space_seq_.load(std::memory_order_acquire);
+  uint64_t head = head_.load(std::memory_order_relaxed);
+  if (head - tail_.load(std::memory_order_acquire) <= record_mask_ &&
+      byte_head_.load(std::memory_order_relaxed) -
+              byte_tail_.load(std::memory_order_acquire) <
+          byte_capacity_ / 2) {
+    return true;
+  }
+  producer_waiting_.store(true, std::memory_order_seq_cst);
+  futex_wait(space_seq_, seen, timeout);
+  producer_waiting_.store(false, std::memory_order_relaxed);
+  return head_.load(std::memory_order_relaxed) -
+             tail_.load(std::memory_order_acquire) <=
+         record_mask_;
+}
+
+void TokenChannel::close() {
+  closed_.store(true, std::memory_order_release);
+  data_seq_.fetch_add(1, std::memory_order_seq_cst);
+  futex_wake(data_seq_);
+}
+
+bool TokenChannel::wait(std::chrono::milliseconds timeout) {
+  uint32_t seen = data_seq_.load(std::memory_order_acquire);
+  if (!empty() || is_closed()) return true;
+  consumer_waiting_.store(true, std::memory_order_seq_cst);
+  // Bayrak görünmeden önce gelen push'u kaçırmamak için tekrar kontrol.
+  if (empty() && !is_closed()) futex_wait(data_seq_, seen, timeout);
+  consumer_waiting_.store(false, std::memory_order_relaxed);
+  return !empty() || is_closed();
+}
+
+void TokenChannel::notify_data() {
+  data_seq_.fetch_add(1, std::memory_order_seq_cst);
+  if (consumer_waiting_.load(std::memory_order_seq_cst)) futex_wake(data_seq_);
+}
+
+void TokenChannel::notify_space() {
+  space_seq_.fetch_add(1, std::memory_order_seq_cst);
+  if (producer_waiting_.load(std::memory_order_seq_cst)) {
+    futex_wake(space_seq_);
+  }
+}
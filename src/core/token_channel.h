@@ -0,0 +1,118 @@
+// Dosya: src/core/token_channel.h
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+#include "llama.h"
+
+// Tek üretici (inference worker) / tek tüketici (HTTP/gRPC yazıcı) arasında
+// kilitsiz, sınırlı token kanalı.
+// Token kayıtları (id + metin aralığı) sabit boyutlu bir halkada, metin
+// baytları istek başına ayrılan ikinci bir bayt halkasında tutulur; token
+// başına heap ayırma, mutex veya condvar yoktur. Tüketici futex ile uyur ve
+// yalnızca gerçekten bekliyorsa uyandırılır; drain() o an hazır olan tüm
+// token'ları tek seferde verir.
+class TokenChannel {
+ public:
+  static constexpr size_t kDefaultMaxTokens = 1024;
+  static constexpr size_t kDefaultMaxBytes = 64 * 1024;
+
+  struct Token {
+    llama_token id;
+    // Yalnızca drain() callback'i süresince geçerlidir.
+    std::string_view text;
+    // n > 1 isteklerde token'ın ait olduğu seçenek.
+    uint32_t choice;
+  };
+
+  explicit TokenChannel(size_t max_tokens = kDefaultMaxTokens,
+                        size_t max_bytes = kDefaultMaxBytes);
+
+  TokenChannel(const TokenChannel&) = delete;
+  TokenChannel& operator=(const TokenChannel&) = delete;
+
+  // --- Üretici ---
+  // Kanal doluysa false döner ve hiçbir şey yazmaz.
+  bool try_push(llama_token id, std::string_view text, uint32_t choice = 0);
+  // Yer açılana veya süre dolana kadar bekler; yer varsa true.
+  bool wait_for_space(std::chrono::milliseconds timeout);
+  // Akışın sonu; sonrasında push yapılmaz. Birden çok kez çağrılabilir.
+  void close();
+
+  // --- Tüketici ---
+  // Hazır olan token'ları (en fazla max_tokens) sırayla fn(const Token&) ile
+  // verir ve yerlerini üreticiye iade eder. Verilen token sayısını döndürür.
+  template <typename Fn>
+  size_t drain(Fn&& fn, size_t max_tokens = SIZE_MAX) {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (head == tail || max_tokens == 0) return 0;
+    if (head - tail > max_tokens) head = tail + max_tokens;
+    uint64_t byte_end = byte_tail_.load(std::memory_order_relaxed);
+    for (uint64_t i = tail; i < head; ++i) {
+      const Record& rec = records_[i & record_mask_];
+      Token token{rec.id,
+                  std::string_view(bytes_.get() + (rec.byte_begin & byte_mask_),
+                                   rec.length),
+                  rec.choice};
+      fn(token);
+      byte_end = rec.byte_begin + rec.length;
+    }
+    byte_tail_.store(byte_end, std::memory_order_release);
+    tail_.store(head, std::memory_order_release);
+    notify_space();
+    return static_cast<size_t>(head - tail);
+  }
+
+  // Token gelene, kanal kapanana veya süre dolana kadar bekler.
+  // Okunacak token varsa ya da kanal kapandıysa true.
+  bool wait(std::chrono::milliseconds timeout);
+
+  bool empty() const {
+    return head_.load(std::memory_order_acquire) ==
+           tail_.load(std::memory_order_acquire);
+  }
+  bool is_closed() const { return closed_.load(std::memory_order_acquire); }
+  // Kapandı ve tüm token'lar okundu: akış bitti.
+  bool finished() const { return is_closed() && empty(); }
+  size_t byte_capacity() const { return byte_capacity_; }
+  size_t size() const {
+    return static_cast<size_t>(head_.load(std::memory_order_acquire) -
+                               tail_.load(std::memory_order_acquire));
+  }
+
+ private:
+  struct Record {
+    llama_token id;
+    uint32_t length;
+    uint64_t byte_begin;  // Bayt halkasında monoton konum
+    uint32_t choice;
+  };
+
+  void notify_data();
+  void notify_space();
+
+  size_t record_mask_;
+  size_t byte_capacity_;
+  size_t byte_mask_;
+  std::unique_ptr<Record[]> records_;
+  std::unique_ptr<char[]> bytes_;
+
+  // Üretici yazar, tüketici okur.
+  alignas(64) std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> byte_head_{0};
+  // Tüketici yazar, üretici okur.
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> byte_tail_{0};
+
+  std::atomic<bool> closed_{false};
+  // Futex kelimeleri: her push/close ve her drain'de artar.
+  alignas(64) std::atomic<uint32_t> data_seq_{0};
+  std::atomic<uint32_t> space_seq_{0};
+  std::atomic<bool> consumer_waiting_{false};
+  std::atomic<bool> producer_waiting_{false};
+};
@@ -0,0 +1,95 @@
+// Dosya: src/core/work_estimator.h
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "sentiric/llm/v1/llama.pb.h"
+
+// Shortest-Job-First zamanlayıcısı için kalan iş tahmini.
+// Maliyet birimi "decode token" dur: prefill paralel çalıştığı için prompt
+// tokenları daha düşük ağırlıkla sayılır.
+class WorkEstimator {
+ public:
+  // Tokenizer'a gitmeden kaba prompt token tahmini (Türkçe için ~3.5 byte).
+  static constexpr double kBytesPerToken = 3.5;
+  // Prefill token başına maliyet (decode token = 1.0).
+  static constexpr double kPrefillTokenWeight = 0.1;
+  // Tenant + profil başına hareketli ortalama katsayısı.
+  static constexpr double kEmaAlpha = 0.2;
+  static constexpr size_t kMaxTrackedTenants = 1024;
+
+  // Profilin default_max_tokens değeri (boş profil = varsayılan model).
+  // Ek modeller (resident) kendi sınırlarıyla tahmin edilir.
+  using MaxTokensLookup = std::function<int32_t(const std::string& profile)>;
+
+  void set_max_tokens_lookup(MaxTokensLookup lookup) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    max_tokens_lookup_ = std::move(lookup);
+  }
+
+  double estimate(const sentiric::llm::v1::GenerateStreamRequest& request,
+                  const std::string& tenant_id, const std::string& profile) {
+    size_t prompt_bytes = request.system_prompt().size() +
+                          request.user_prompt().size() +
+                          request.rag_context().size();
+    for (const auto& turn : request.history()) {
+      prompt_bytes += turn.content().size();
+    }
+    double prefill_tokens = prompt_bytes / kBytesPerToken;
+
+    double cap = 0;
+    if (request.params().has_max_new_tokens()) {
+      cap = request.params().max_new_tokens();
+    } else {
+      MaxTokensLookup lookup;
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        lookup = max_tokens_lookup_;
+      }
+      cap = std::max(1, lookup ? lookup(profile) : kFallbackMaxTokens);
+    }
+
+    // Tenant geçmişi yoksa kötümser tahmin: isteğin üst sınırı.
+    double expected_gen = cap;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = completion_ema_.find(key(tenant_id, profile));
+    if (it != completion_ema_.end()) {
+      expected_gen = std::min(cap, it->second);
+    }
+    return prefill_tokens * kPrefillTokenWeight + expected_gen;
+  }
+
+  // Seçenek başına üretilen token sayısı. Yalnızca doğal biten ("stop" /
+  // "length") gerçek zamanlı istekler için çağrılmalı; kesilen istekler
+  // ve batch işleri ortalamayı aşağı çeker.
+  void observe(const std::string& tenant_id, const std::string& profile,
+               double completion_tokens) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = completion_ema_.find(key(tenant_id, profile));
+    if (it == completion_ema_.end()) {
+      if (completion_ema_.size() >= kMaxTrackedTenants) {
+        completion_ema_.clear();
+      }
+      completion_ema_[key(tenant_id, profile)] = completion_tokens;
+      return;
+    }
+    it->second = kEmaAlpha * completion_tokens + (1.0 - kEmaAlpha) * it->second;
+  }
+
+ private:
+  static constexpr int32_t kFallbackMaxTokens = 1024;
+
+  static std::string key(const std::string& tenant_id,
+                         const std::string& profile) {
+    return tenant_id + '\x1f' + profile;
+  }
+
+  std::mutex mutex_;
+  MaxTokensLookup max_tokens_lookup_;
+  std::unordered_map<std::string, double> completion_ema_;
+};
@@ -1,18 +1,296 @@
 // Dosya: src/grpc_server.cpp
 #include "grpc_server.h"
 
+#include <grpcpp/alarm.h>
+
 #include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
+#include "core/sentence_chunker.h"
+#include "core/stream_coalescer.h"
 #include "suts_logger.h"
 
+using sentiric::llm::v1::GenerateStreamRequest;
+using sentiric::llm::v1::GenerateStreamResponse;
+
+namespace {
+
+// Doğrulamada reddedilen çağrı: hemen Finish edilir.
+class RejectedStream : public grpc::ServerWriteReactor<GenerateStreamResponse> {
+ public:
+  explicit RejectedStream(const grpc::Status& status) { Finish(status); }
+  void OnDone() override { delete this; }
+};
+
+// Tek bir GenerateStream çağrısı. Token'lar engine worker'ından isteğin
+// kanalına yazılır; on_tokens_ready ile pump() tetiklenir. Aynı anda tek
+// yazma bekler, yazma sürerken gelen token'lar kanalda birikir ve
+// OnWriteDone'dan sonra sırayla gönderilir. Reactor, gRPC OnDone çağırana
+// kadar kendi shared_ptr'ını tutar; istek callback'leri weak_ptr kullanır.
+class GenerateStreamReactor
+    : public grpc::ServerWriteReactor<GenerateStreamResponse>,
+      public std::enable_shared_from_this<GenerateStreamReactor> {
+ public:
+  GenerateStreamReactor(AppMetrics& metrics,
+                        grpc::CallbackServerContext* context,
+                        std::shared_ptr<BatchedRequest> request)
+      : metrics_(metrics),
+        context_(context),
+        request_(std::move(request)),
+        coalescer_(request_->min_chunk_bytes, request_->max_flush_interval),
+        choice_texts_(request_->n_choices > 1 ? request_->n_choices : 0) {}
+
+  void start(DynamicBatcher& batcher) {
+    self_ = shared_from_this();
+    std::weak_ptr<GenerateStreamReactor> weak = self_;
+    // [ARCH-COMPLIANCE FIX]: gRPC Client'ın (Gateway) koptuğunu anında yakala
+    // ve LLM Inference döngüsünü (GPU) anında durdur (Zero-Latency Barge-in)
+    request_->should_stop_callback = [weak]() {
+      auto self = weak.lock();
+      return !self || self->cancelled_ || self->write_failed_;
+    };
+    request_->on_tokens_ready = [weak]() {
+      if (auto self = weak.lock()) self->pump();
+    };
+    batcher.add_request(request_);
+  }
+
+  void OnWriteDone(bool ok) override {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      write_in_flight_ = false;
+      if (!ok) write_failed_ = true;
+      if (finishing_) return;
+    }
+    pump();
+  }
+
+  void OnCancel() override { cancelled_ = true; }
+
+  void OnDone() override { self_.reset(); }
+
+ private:
+  void pump() {
+    bool write = false;
+    bool finish = false;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (write_in_flight_ || finishing_) return;
+      auto& channel = request_->tokens;
+      // Kapanış, son token'dan sonra yayınlanır; önce okunursa aşağıdaki
+      // boş drain akışın gerçekten bittiğini gösterir.
+      bool closed = channel.is_closed();
+      if (write_failed_) {
+        // İstemci gitti: kalan token'lar atılır, yalnızca bitiş beklenir.
+        channel.drain([](const TokenChannel::Token&) {});
+        next_choice_ = choice_texts_.size();
+      } else if (!choice_texts_.empty()) {
+        // n > 1: seçenekler karışık üretilir ve kontratta seçenek numarası
+        // yoktur; kanal kapanınca seçenek başına tek mesaj sırayla gider
+        // (mesaj i = seçenek i), ardından finish_details. Seçenek başına
+        // bitiş nedenleri trailer'dadır. TTFT ilk üretilen token'da ölçülür.
+        size_t n = channel.drain([this](const TokenChannel::Token& t) {
+          choice_texts_[t.choice].append(t.text);
+        });
+        if (n > 0) record_ttft();
+        if (closed && next_choice_ < choice_texts_.size()) {
+          response_.Clear();
+          response_.set_token(std::move(choice_texts_[next_choice_++]));
+          write = true;
+        }
+      } else if (request_->sentence_chunks) {
+        // Cümle modu: mesaj başına bir cümle; kalan metin kanal kapanınca
+        // gider ve ardından gelen finish_details son parçayı işaretler.
+        channel.drain([this](const TokenChannel::Token& t) {
+          chunker_.append(t.text);
+        });
+        std::string sentence;
+        if (chunker_.next(sentence) ||
+            (closed && !(sentence = chunker_.flush()).empty())) {
+          response_.Clear();
+          response_.set_token(std::move(sentence));
+          write = true;
+        }
+      } else {
+        // Birleştirme kapalıysa mesaj başına tek token; açıksa hazır olan
+        // tüm token'lar bekleyen mesaja eklenir.
+        if (!coalescer_.has_pending()) response_.Clear();
+        size_t n = channel.drain(
+            [this](const TokenChannel::Token& t) {
+              response_.mutable_token()->append(t.text);
+            },
+            coalescer_.enabled() ? SIZE_MAX : 1);
+        if (n > 0) coalescer_.on_append();
+        write = coalescer_.should_flush(response_.token().size(), closed);
+        if (!write && coalescer_.has_pending()) arm_flush_alarm();
+      }
+      if (write) {
+        coalescer_.on_flush();
+        write_in_flight_ = true;
+      } else if (closed && !coalescer_.has_pending() && chunker_.empty() &&
+                 next_choice_ >= choice_texts_.size()) {
+        finishing_ = true;
+        finish = true;
+      }
+    }
+    if (write) {
+      record_ttft();
+      StartWrite(&response_);
+    } else if (finish) {
+      finish_stream();
+    }
+  }
+
+  // Bekleyen mesaj, son tarihine kadar yeni token gelmezse de gönderilsin.
+  // Alarm kendi callback'i içinden yeniden kurulabildiği için her seferinde
+  // yenisi açılır; bir önceki, callback'i dönene kadar saklanır.
+  // mutex_ tutulurken çağrılır.
+  void arm_flush_alarm() {
+    if (alarm_armed_) return;
+    alarm_armed_ = true;
+    auto deadline =
+        std::chrono::system_clock::now() +
+        (coalescer_.deadline() - StreamCoalescer::Clock::now());
+    std::weak_ptr<GenerateStreamReactor> weak = weak_from_this();
+    retired_alarm_ = std::move(flush_alarm_);
+    flush_alarm_ = std::make_unique<grpc::Alarm>();
+    flush_alarm_->Set(deadline, [weak](bool) {
+      auto self = weak.lock();
+      if (!self) return;
+      {
+        std::lock_guard<std::mutex> lock(self->mutex_);
+        self->alarm_armed_ = false;
+      }
+      self->pump();
+    });
+  }
+
+  void record_ttft() {
+    if (request_->first_token_emitted.exchange(true)) return;
+    std::chrono::duration<double, std::milli> ttft =
+        std::chrono::steady_clock::now() - request_->creation_time;
+    request_->ttft_ms = ttft.count();
+    SUTS_DEBUG("LLM_TTFT_COMPUTED", request_->trace_id, request_->span_id,
+               request_->tenant_id, "⚡ TTFT: {:.2f} ms",
+               request_->ttft_ms.load());
+  }
+
+  void finish_stream() {
+    const std::string& reason = request_->finish_reason;
+    if (cancelled_ || write_failed_) {
+      Finish(grpc::Status(grpc::StatusCode::CANCELLED, "Client cancelled."));
+      return;
+    }
+    // Drain: istemcinin retry politikası isteği başka replikaya yöneltir.
+    if (reason == "draining") {
+      Finish(grpc::Status(grpc::StatusCode::UNAVAILABLE,
+                          "Server is shutting down."));
+      return;
+    }
+    if (reason == "aborted") {
+      Finish(grpc::Status(grpc::StatusCode::UNAVAILABLE,
+                          "Server shut down before the request completed."));
+      return;
+    }
+    if (reason == "overflow") {
+      Finish(grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
+                          "Client is not reading the stream fast enough."));
+      return;
+    }
+    if (reason == "model_loading") {
+      Finish(grpc::Status(grpc::StatusCode::UNAVAILABLE,
+                          "Model profile '" + request_->model_profile +
+                              "' is loading."));
+      return;
+    }
+    if (reason == "model_unavailable") {
+      Finish(grpc::Status(grpc::StatusCode::UNAVAILABLE,
+                          "Model profile '" + request_->model_profile +
+                              "' could not be loaded."));
+      return;
+    }
+
+    auto* details = final_response_.mutable_finish_details();
+    details->set_finish_reason(reason);
+    details->set_prompt_tokens(request_->prompt_tokens);
+    details->set_completion_tokens(request_->completion_tokens);
+
+    metrics_.tokens_generated_total.Increment(request_->completion_tokens);
+    std::chrono::duration<double> latency =
+        std::chrono::steady_clock::now() - request_->creation_time;
+    metrics_.request_latency.Observe(latency.count());
+
+    SUTS_INFO("LLM_STREAM_COMPLETE", request_->trace_id, request_->span_id,
+              request_->tenant_id,
+              "Completed. Tokens: {}/{}, TTFT: {:.2f}ms, Total: {:.2f}s",
+              request_->prompt_tokens, request_->completion_tokens,
+              request_->ttft_ms.load(), latency.count());
+
+    // n > 1: seçenek i'nin bitiş nedeni, virgülle ayrılmış listenin i.
+    // elemanı (HTTP'deki choices[i].finish_reason karşılığı).
+    if (!request_->choice_finish_reasons.empty()) {
+      std::string reasons;
+      for (const auto& r : request_->choice_finish_reasons) {
+        if (!reasons.empty()) reasons += ',';
+        reasons += r;
+      }
+      context_->AddTrailingMetadata("x-choice-finish-reasons", reasons);
+    }
+
+    // Gateway'in önek yakınlığı için (bkz. /v1/cache/probe). Sözleşmedeki
+    // mesajlara alan eklenemediğinden trailer olarak gider.
+    if (!request_->cache_fingerprint.empty()) {
+      context_->AddTrailingMetadata("x-cache-fingerprint",
+                                    request_->cache_fingerprint);
+      context_->AddTrailingMetadata(
+          "x-cache-prefix-tokens",
+          std::to_string(request_->cache_prefix_tokens));
+    }
+
+    StartWriteAndFinish(&final_response_, grpc::WriteOptions(),
+                        grpc::Status::OK);
+  }
+
+  AppMetrics& metrics_;
+  grpc::CallbackServerContext* context_;
+  std::shared_ptr<BatchedRequest> request_;
+  std::shared_ptr<GenerateStreamReactor> self_;
+
+  std::mutex mutex_;
+  bool write_in_flight_ = false;
+  bool finishing_ = false;
+  std::atomic<bool> cancelled_{false};
+  std::atomic<bool> write_failed_{false};
+  GenerateStreamResponse response_;
+  GenerateStreamResponse final_response_;
+  StreamCoalescer coalescer_;
+  SentenceChunker chunker_;
+  // n > 1: seçenek metinleri ve sıradaki gönderilecek seçenek.
+  std::vector<std::string> choice_texts_;
+  size_t next_choice_ = 0;
+  std::unique_ptr<grpc::Alarm> flush_alarm_;
+  std::unique_ptr<grpc::Alarm> retired_alarm_;
+  bool alarm_armed_ = false;
+};
+
+grpc::ServerWriteReactor<GenerateStreamResponse>* reject(
+    grpc::StatusCode code, const std::string& message) {
+  return new RejectedStream(grpc::Status(code, message));
+}
+
+}  // namespace
+
 GrpcServer::GrpcServer(std::shared_ptr<LLMEngine> engine, AppMetrics& metrics)
     : engine_(std::move(engine)), metrics_(metrics) {}
 
-grpc::Status GrpcServer::GenerateStream(
-    grpc::ServerContext* context,
-    const sentiric::llm::v1::GenerateStreamRequest* request,
-    grpc::ServerWriter<sentiric::llm::v1::GenerateStreamResponse>* writer) {
+grpc::ServerWriteReactor<GenerateStreamResponse>* GrpcServer::GenerateStream(
+    grpc::CallbackServerContext* context,
+    const GenerateStreamRequest* request) {
   metrics_.requests_total.Increment();
   auto start_time = std::chrono::steady_clock::now();
 
@@ -34,12 +312,46 @@ grpc::Status GrpcServer::GenerateStream(
   if (it_tenant != client_metadata.end())
     tenant_id = std::string(it_tenant->second.begin(), it_tenant->second.end());
 
+  // Çoklu model: hedef profil kontrata dokunmadan metadata ile seçilir.
+  std::string model_profile;
+  auto it_profile = client_metadata.find("x-model-profile");
+  if (it_profile != client_metadata.end())
+    model_profile =
+        std::string(it_profile->second.begin(), it_profile->second.end());
+
+  // Token birleştirme (isteğe bağlı): en az bu kadar bayt veya en geç bu
+  // kadar milisaniyede bir mesaj. Başlık yoksa kMetadataAbsent; sayı değilse
+  // ya da negatifse kMetadataInvalid.
+  constexpr long kMetadataAbsent = -1;
+  constexpr long kMetadataInvalid = -2;
+  auto metadata_int = [&client_metadata](const char* key) -> long {
+    auto it = client_metadata.find(key);
+    if (it == client_metadata.end()) return kMetadataAbsent;
+    std::string text(it->second.begin(), it->second.end());
+    try {
+      size_t parsed = 0;
+      long value = std::stol(text, &parsed);
+      if (parsed != text.size() || value < 0) return kMetadataInvalid;
+      return value;
+    } catch (...) {
+      return kMetadataInvalid;
+    }
+  };
+  long min_chunk_bytes = metadata_int("x-min-chunk-bytes");
+  long max_flush_interval_ms = metadata_int("x-max-flush-interval-ms");
+  // OpenAI 'n' karşılığı: aynı prompt'tan bağımsız seçenek sayısı.
+  long num_choices = metadata_int("x-num-choices");
+  // TTS: cümle başına mesaj.
+  auto it_chunking = client_metadata.find("x-stream-chunking");
+  bool sentence_chunks =
+      it_chunking != client_metadata.end() && it_chunking->second == "sentence";
+
   // [ARCH-COMPLIANCE] Strict Tenant Isolation Fail-Fast
   if (tenant_id == "unknown" || tenant_id.empty()) {
     SUTS_ERROR("MISSING_TENANT_ID", trace_id, span_id, tenant_id,
                "Tenant ID is missing in gRPC metadata. Request rejected.");
-    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                        "tenant_id is strictly required for isolation");
+    return reject(grpc::StatusCode::INVALID_ARGUMENT,
+                  "tenant_id is strictly required for isolation");
   }
 
   SUTS_INFO(
@@ -47,81 +359,83 @@ grpc::Status GrpcServer::GenerateStream(
       "New GenerateStream request. LoRA: '{}'",
       request->has_lora_adapter_id() ? request->lora_adapter_id() : "none");
 
-  if (!engine_->is_model_loaded()) {
+  if (!engine_->is_accepting()) {
+    if (engine_->get_state() == EngineState::kDraining) {
+      return reject(grpc::StatusCode::UNAVAILABLE, "Server is shutting down.");
+    }
     SUTS_WARN("MODEL_NOT_READY", trace_id, span_id, tenant_id,
               "Model is not ready yet.");
-    return grpc::Status(grpc::StatusCode::UNAVAILABLE,
-                        "Model is not ready yet.");
+    return reject(grpc::StatusCode::UNAVAILABLE, "Model is not ready yet.");
   }
   if (request->user_prompt().empty()) {
-    return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                        "User prompt cannot be empty.");
+    return reject(grpc::StatusCode::INVALID_ARGUMENT,
+                  "User prompt cannot be empty.");
+  }
+  if (!model_profile.empty() && !engine_->has_profile(model_profile)) {
+    return reject(grpc::StatusCode::NOT_FOUND,
+                  "Unknown model profile: " + model_profile);
+  }
+  if (!model_profile.empty()) {
+    // Bellekte olmayan profil loader thread'inde yüklenir; istemcinin retry
+    // politikası isteği yeniden dener.
+    auto state = engine_->prepare_profile(model_profile);
+    if (state == LLMEngine::ProfileState::kLoading) {
+      return reject(grpc::StatusCode::UNAVAILABLE,
+                    "Model profile '" + model_profile + "' is loading.");
+    }
+    if (state == LLMEngine::ProfileState::kUnavailable) {
+      return reject(grpc::StatusCode::UNAVAILABLE,
+                    "Model profile '" + model_profile +
+                        "' could not be loaded.");
+    }
+  }
+  if (min_chunk_bytes == kMetadataInvalid) {
+    return reject(grpc::StatusCode::INVALID_ARGUMENT,
+                  "x-min-chunk-bytes must be a non-negative integer.");
+  }
+  if (max_flush_interval_ms == kMetadataInvalid) {
+    return reject(grpc::StatusCode::INVALID_ARGUMENT,
+                  "x-max-flush-interval-ms must be a non-negative integer.");
+  }
+  uint32_t max_choices = engine_->get_settings().max_choices;
+  if (num_choices == kMetadataAbsent) num_choices = 1;
+  if (num_choices < 1 || num_choices > static_cast<long>(max_choices)) {
+    return reject(grpc::StatusCode::INVALID_ARGUMENT,
+                  "x-num-choices must be between 1 and " +
+                      std::to_string(max_choices));
+  }
+  if (num_choices > 1 &&
+      !engine_->choices_fit(model_profile, num_choices,
+                            request->params().max_new_tokens())) {
+    return reject(grpc::StatusCode::INVALID_ARGUMENT,
+                  "x-num-choices x max_new_tokens exceeds the context size.");
   }
 
-  auto batched_request = std::make_shared<BatchedRequest>();
-  batched_request->request = *request;
+  // Mesaj kopyalanmaz: gRPC'nin sahip olduğu mesaj reactor Finish edilene
+  // kadar, yani üretim bitene kadar geçerlidir.
+  auto batched_request = engine_->new_request();
+  batched_request->request = request;
   batched_request->creation_time = start_time;
 
   batched_request->trace_id = trace_id;
   batched_request->span_id = span_id;
   batched_request->tenant_id = tenant_id;
+  batched_request->model_profile = model_profile;
+  if (min_chunk_bytes >= 0) batched_request->min_chunk_bytes = min_chunk_bytes;
+  batched_request->sentence_chunks = sentence_chunks;
+  if (max_flush_interval_ms > 0) {
+    batched_request->max_flush_interval =
+        std::chrono::milliseconds(max_flush_interval_ms);
+  }
+  if (num_choices > 1) {
+    batched_request->n_choices = num_choices;
+    batched_request->sentence_chunks = false;
+    batched_request->min_chunk_bytes = 0;
+  }
 
-  batched_request->on_token_callback =
-      [batched_request, writer](const std::string& token) -> bool {
-    if (!batched_request->first_token_emitted.exchange(true)) {
-      auto now = std::chrono::steady_clock::now();
-      std::chrono::duration<double, std::milli> ttft =
-          now - batched_request->creation_time;
-      batched_request->ttft_ms = ttft.count();
-      SUTS_DEBUG("LLM_TTFT_COMPUTED", batched_request->trace_id,
-                 batched_request->span_id, batched_request->tenant_id,
-                 "⚡ TTFT: {:.2f} ms", batched_request->ttft_ms.load());
-    }
-
-    sentiric::llm::v1::GenerateStreamResponse response;
-    response.set_token(token);
-    return writer->Write(response);
-  };
-
-  // [ARCH-COMPLIANCE FIX]: gRPC Client'ın (Gateway) koptuğunu anında yakala
-  // ve LLM Inference döngüsünü (GPU) anında durdur (Zero-Latency Barge-in)
-  batched_request->should_stop_callback = [context]() -> bool {
-    return context->IsCancelled();
-  };
-
-  try {
-    if (engine_->is_batching_enabled()) {
-      auto future = engine_->get_batcher()->add_request(batched_request);
-      future.get();
-    } else {
-      engine_->process_single_request(batched_request);
-    }
-  } catch (const std::exception& e) {
-    // [ARCH-COMPLIANCE] Surgical Folding of internal engine errors
-    SUTS_ERROR("LLM_INTERNAL_ERROR", batched_request->trace_id,
-               batched_request->span_id, batched_request->tenant_id,
-               "Unhandled exception during inference: {}", e.what());
-    batched_request->finish_reason = "error";
-  }
-
-  sentiric::llm::v1::GenerateStreamResponse final_response;
-  auto* details = final_response.mutable_finish_details();
-  details->set_finish_reason(batched_request->finish_reason);
-  details->set_prompt_tokens(batched_request->prompt_tokens);
-  details->set_completion_tokens(batched_request->completion_tokens);
-  writer->Write(final_response);
-
-  metrics_.tokens_generated_total.Increment(batched_request->completion_tokens);
-
-  auto end_time = std::chrono::steady_clock::now();
-  std::chrono::duration<double> latency = end_time - start_time;
-  metrics_.request_latency.Observe(latency.count());
-
-  SUTS_INFO("LLM_STREAM_COMPLETE", batched_request->trace_id,
-            batched_request->span_id, batched_request->tenant_id,
-            "Completed. Tokens: {}/{}, TTFT: {:.2f}ms, Total: {:.2f}s",
-            batched_request->prompt_tokens, batched_request->completion_tokens,
-            batched_request->ttft_ms.load(), latency.count());
-
-  return grpc::Status::OK;
-}
\ No newline at end of file
+  auto reactor =
+      std::make_shared<GenerateStreamReactor>(metrics_, context,
+                                              batched_request);
+  reactor->start(*engine_->get_batcher());
+  return reactor.get();
+}
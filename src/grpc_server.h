@@ -8,19 +8,20 @@
 #include "llm_engine.h"
 #include "sentiric/llm/v1/llama.grpc.pb.h"
 
-class GrpcServer final : public sentiric::llm::v1::LlamaService::Service {
+// Callback API: açık akış başına thread tutulmaz. Engine worker'ı token'ları
+// isteğin kanalına yazar; her akışın reactor'ü bunları tek bekleyen yazma ile
+// sırayla gönderir. Thread sayısı eşzamanlı akış sayısından bağımsızdır.
+class GrpcServer final
+    : public sentiric::llm::v1::LlamaService::CallbackService {
  public:
   explicit GrpcServer(std::shared_ptr<LLMEngine> engine, AppMetrics& metrics);
 
-  grpc::Status GenerateStream(
-      grpc::ServerContext* context,
-      // DÜZELTME: GenerateStreamRequest
-      const sentiric::llm::v1::GenerateStreamRequest* request,
-      // DÜZELTME: GenerateStreamResponse
-      grpc::ServerWriter<sentiric::llm::v1::GenerateStreamResponse>* writer)
-      override;
+  grpc::ServerWriteReactor<sentiric::llm::v1::GenerateStreamResponse>*
+  GenerateStream(
+      grpc::CallbackServerContext* context,
+      const sentiric::llm::v1::GenerateStreamRequest* request) override;
 
  private:
   std::shared_ptr<LLMEngine> engine_;
   AppMetrics& metrics_;
-};
\ No newline at end of file
+};
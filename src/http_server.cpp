@@ -4,6 +4,7 @@
 
 #include <sstream>
 
+#include "http_task_queue.h"
 #include "spdlog/spdlog.h"
 
 // --- MetricsServer ---
@@ -30,17 +31,49 @@ void run_metrics_server_thread(std::shared_ptr<MetricsServer> server) {
   if (server) server->run();
 }
 
+// --- HealthServer ---
+HealthServer::HealthServer(std::shared_ptr<LLMEngine> engine,
+                           const std::string &host, int port)
+    : system_controller_(std::make_unique<SystemController>(std::move(engine))),
+      host_(host),
+      port_(port) {
+  svr_.new_task_queue = [] { return new httplib::ThreadPool(kThreads); };
+  svr_.Get("/health",
+           [this](const httplib::Request &req, httplib::Response &res) {
+             system_controller_->handle_health(req, res);
+           });
+  svr_.Get("/v1/cache/probe",
+           [this](const httplib::Request &req, httplib::Response &res) {
+             system_controller_->handle_cache_probe(req, res);
+           });
+}
+void HealthServer::run() {
+  spdlog::info("🩺 Health server listening on {}:{}", host_, port_);
+  svr_.listen(host_.c_str(), port_);
+}
+void HealthServer::stop() {
+  if (svr_.is_running()) svr_.stop();
+}
+
 // --- HttpServer ---
 // [GÜNCELLEME] Thread havuzu ayarı eklendi
 HttpServer::HttpServer(std::shared_ptr<LLMEngine> engine,
-                       const std::string &host, int port, int threads)
+                       const std::string &host, int port, int threads,
+                       int max_threads)
     : engine_(std::move(engine)), host_(host), port_(port) {
-  // HTTP Thread Pool Yapılandırması
-  svr_.new_task_queue = [threads] { return new httplib::ThreadPool(threads); };
-  spdlog::info("🌐 HTTP Server initialized with {} threads.", threads);
+  // HTTP Thread Pool Yapılandırması: uzun SSE akışları /health'i ve kısa
+  // istekleri bekletmesin diye havuz talebe göre büyür.
+  svr_.new_task_queue = [threads, max_threads] {
+    return new ElasticTaskQueue(threads, max_threads);
+  };
+  spdlog::info("🌐 HTTP Server initialized with {} threads (max {}).",
+               threads, max_threads);
 
   // Controller başlatma
   chat_controller_ = std::make_unique<ChatController>(engine_);
+  batch_controller_ =
+      std::make_unique<BatchController>(engine_, *chat_controller_);
+  embedding_controller_ = std::make_unique<EmbeddingController>(engine_);
   model_controller_ = std::make_unique<ModelController>(engine_);
   system_controller_ = std::make_unique<SystemController>(engine_);
 
@@ -85,6 +118,11 @@ HttpServer::HttpServer(std::shared_ptr<LLMEngine> engine,
              system_controller_->handle_ui_layout(req, res);
            });
 
+  svr_.Get("/v1/cache/probe",
+           [this](const httplib::Request &req, httplib::Response &res) {
+             system_controller_->handle_cache_probe(req, res);
+           });
+
   // --- MODEL ENDPOINTS ---
   svr_.Get("/v1/profiles",
            [this](const httplib::Request &req, httplib::Response &res) {
@@ -107,6 +145,30 @@ HttpServer::HttpServer(std::shared_ptr<LLMEngine> engine,
               chat_controller_->handle_chat_completions(req, res);
             });
 
+  // --- EMBEDDINGS ---
+  svr_.Post("/v1/embeddings",
+            [this](const httplib::Request &req, httplib::Response &res) {
+              embedding_controller_->handle_embeddings(req, res);
+            });
+
+  // --- BATCH ENDPOINTS (çevrimdışı, en düşük öncelik) ---
+  svr_.Post("/v1/batches",
+            [this](const httplib::Request &req, httplib::Response &res) {
+              batch_controller_->handle_create(req, res);
+            });
+  svr_.Get(R"(/v1/batches/([A-Za-z0-9_]+))",
+           [this](const httplib::Request &req, httplib::Response &res) {
+             batch_controller_->handle_get(req, res);
+           });
+  svr_.Get(R"(/v1/batches/([A-Za-z0-9_]+)/results)",
+           [this](const httplib::Request &req, httplib::Response &res) {
+             batch_controller_->handle_results(req, res);
+           });
+  svr_.Post(R"(/v1/batches/([A-Za-z0-9_]+)/cancel)",
+            [this](const httplib::Request &req, httplib::Response &res) {
+              batch_controller_->handle_cancel(req, res);
+            });
+
   // --- STATIC CONTENT ---
   svr_.Get(R"(/context/(.+))",
            [this](const httplib::Request &req, httplib::Response &res) {
@@ -115,6 +177,8 @@ HttpServer::HttpServer(std::shared_ptr<LLMEngine> engine,
 
   // --- OPTIONS HANDLERS ---
   svr_.Options("/v1/chat/completions", set_cors);
+  svr_.Options("/v1/batches", set_cors);
+  svr_.Options("/v1/embeddings", set_cors);
   svr_.Options("/v1/models", set_cors);
   svr_.Options("/v1/models/switch", set_cors);
   svr_.Options("/v1/profiles", set_cors);
@@ -10,7 +10,9 @@
 #include <string>
 #include <thread>
 
+#include "controllers/batch_controller.h"
 #include "controllers/chat_controller.h"
+#include "controllers/embedding_controller.h"
 #include "controllers/model_controller.h"
 #include "controllers/system_controller.h"
 #include "httplib.h"
@@ -21,6 +23,8 @@ struct AppMetrics {
   prometheus::Histogram& request_latency;
   prometheus::Counter& tokens_generated_total;
   prometheus::Gauge& active_contexts;
+  prometheus::Gauge& in_flight_requests;
+  prometheus::Gauge& draining;
 };
 
 class MetricsServer {
@@ -39,13 +43,38 @@ class MetricsServer {
 
 void run_metrics_server_thread(std::shared_ptr<MetricsServer> server);
 
+// /health ve /v1/cache/probe'u kendi portunda, sabit küçük bir thread
+// havuzuyla sunar. Ana sunucunun havuzu açık SSE akışlarıyla dolduğunda
+// probe'lar ve gateway sorguları onların arkasında beklemez.
+class HealthServer {
+ public:
+  static constexpr int kThreads = 4;
+
+  HealthServer(std::shared_ptr<LLMEngine> engine, const std::string& host,
+               int port);
+  void run();
+  void stop();
+
+ private:
+  httplib::Server svr_;
+  std::unique_ptr<SystemController> system_controller_;
+  std::string host_;
+  int port_;
+};
+
 class HttpServer {
  public:
   // [GÜNCELLEME] Thread count parametresi eklendi
+  // threads: hep açık bağlantı thread'i; max_threads: SSE akışlarıyla
+  // büyüyebileceği üst sınır (bkz. ElasticTaskQueue).
   HttpServer(std::shared_ptr<LLMEngine> engine, const std::string& host,
-             int port, int threads = 50);
+             int port, int threads = 50, int max_threads = 512);
   void run();
   void stop();
+  // Bitmemiş SSE yanıtları; stop() bunlar sıfırlandıktan sonra çağrılmalı.
+  size_t get_open_streams() const {
+    return chat_controller_->get_open_streams();
+  }
 
  private:
   httplib::Server svr_;
@@ -53,6 +82,9 @@ class HttpServer {
 
   // Controllers
   std::unique_ptr<ChatController> chat_controller_;
+  // chat_controller_'a bağlı; ondan önce yok edilmeli.
+  std::unique_ptr<BatchController> batch_controller_;
+  std::unique_ptr<EmbeddingController> embedding_controller_;
   std::unique_ptr<ModelController> model_controller_;
   std::unique_ptr<SystemController> system_controller_;
 
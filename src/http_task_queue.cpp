@@ -0,0 +1,102 @@
+#include "http_task_queue.h"
+
+#include <algorithm>
+
+#include "spdlog/spdlog.h"
+
+ElasticTaskQueue::ElasticTaskQueue(size_t core_threads, size_t max_threads,
+                                   std::chrono::seconds idle_timeout)
+    : core_threads_(std::max<size_t>(core_threads, 1)),
+      max_threads_(std::max(max_threads, core_threads_)),
+      idle_timeout_(idle_timeout) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t i = 0; i < core_threads_; ++i) spawn_locked(true);
+}
+
+ElasticTaskQueue::~ElasticTaskQueue() { shutdown(); }
+
+bool ElasticTaskQueue::enqueue(std::function<void()> fn) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutdown_) return false;
+    reap_finished_locked();
+    jobs_.push_back(std::move(fn));
+    // Bekleyen iş, uyanacak boşta thread'den fazlaysa yeni thread açılır.
+    if (jobs_.size() > idle_ && threads_.size() < max_threads_) {
+      spawn_locked(false);
+      if (threads_.size() == max_threads_) {
+        spdlog::warn("⚠️ HTTP connection threads reached the limit ({}).",
+                     max_threads_);
+      }
+    }
+  }
+  cv_.notify_one();
+  return true;
+}
+
+void ElasticTaskQueue::shutdown() {
+  std::unordered_map<std::thread::id, std::thread> threads;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shutdown_ && threads_.empty()) return;
+    shutdown_ = true;
+    threads.swap(threads_);
+    finished_.clear();
+  }
+  cv_.notify_all();
+  for (auto& [id, thread] : threads) {
+    if (thread.joinable()) thread.join();
+  }
+}
+
+size_t ElasticTaskQueue::thread_count() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return threads_.size() - finished_.size();
+}
+
+void ElasticTaskQueue::spawn_locked(bool core) {
+  std::thread thread(&ElasticTaskQueue::worker, this, core);
+  auto id = thread.get_id();
+  threads_.emplace(id, std::move(thread));
+}
+
+void ElasticTaskQueue::reap_finished_locked() {
+  for (auto id : finished_) {
+    auto it = threads_.find(id);
+    if (it == threads_.end()) continue;
+    // Thread finished_'e yazdıktan sonra yalnızca geri döner; join kısa sürer.
+    it->second.join();
+    threads_.erase(it);
+  }
+  finished_.clear();
+}
+
+void ElasticTaskQueue::worker(bool core) {
+  for (;;) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      auto ready = [this] { return shutdown_ || !jobs_.empty(); };
+      ++idle_;
+      if (core) {
+        cv_.wait(lock, ready);
+      } else {
+        cv_.wait_for(lock, idle_timeout_, ready);
+      }
+      --idle_;
+      if (jobs_.empty()) {
+        // Kapanış ya da ek thread'in boşta kalma süresi doldu. Kapanışta
+        // thread'ler shutdown() tarafından join edilir.
+        if (shutdown_) return;
+        if (!core) {
+          finished_.push_back(std::this_thread::get_id());
+          return;
+        }
+        continue;
+      }
+      job = std::move(jobs_.front());
+      jobs_.pop_front();
+    }
+    job();
+  }
+}
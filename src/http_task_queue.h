@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "httplib.h"
+
+// cpp-httplib bağlantı havuzu. httplib her bağlantıyı (ve SSE akışını
+// sonuna kadar) tek bir görevde işler; sabit havuzda açık akışlar tüm
+// thread'leri tutunca /health dahil her şey kuyrukta bekliyordu.
+// Burada core_threads thread hep açıktır; boşta thread yoksa max_threads'e
+// kadar yenisi açılır ve ek thread'ler idle_timeout boşta kalınca kapanır.
+// Böylece yeni bağlantı, akışların arkasında sıraya girmez.
+class ElasticTaskQueue : public httplib::TaskQueue {
+ public:
+  ElasticTaskQueue(
+      size_t core_threads, size_t max_threads,
+      std::chrono::seconds idle_timeout = std::chrono::seconds(30));
+  ~ElasticTaskQueue() override;
+
+  bool enqueue(std::function<void()> fn) override;
+  void shutdown() override;
+
+  size_t thread_count() const;
+
+ private:
+  void worker(bool core);
+  // Kapanmış ek thread'leri join eder. mutex_ tutulurken çağrılır.
+  void reap_finished_locked();
+  void spawn_locked(bool core);
+
+  const size_t core_threads_;
+  const size_t max_threads_;
+  const std::chrono::seconds idle_timeout_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<std::function<void()>> jobs_;
+  std::unordered_map<std::thread::id, std::thread> threads_;
+  std::vector<std::thread::id> finished_;
+  size_t idle_ = 0;
+  bool shutdown_ = false;
+};
@@ -4,16 +4,21 @@
 
 #include <algorithm>
 #include <filesystem>
-#include <future>
+#include <fstream>
 #include <optional>
 #include <regex>
+#include <sstream>
 #include <stdexcept>
 #include <thread>
 #include <vector>
 
 #include "common.h"
+#include "core/model_warmup.h"
+#include "ggml-backend.h"
+#include "gguf.h"
 #include "model_manager.h"
 #include "spdlog/spdlog.h"
+#include "suts_logger.h"
 
 // --- RAII HELPERS ---
 
@@ -36,246 +41,898 @@ struct LlamaSamplerGuard {
   }
 };
 
+// İsteğin örnekleme zinciri: grammar, tekrar cezası, top_k, sıcaklık, dist.
+static void add_samplers(llama_sampler* chain, const llama_vocab* vocab,
+                         const Settings& settings, const BatchedRequest& req,
+                         uint32_t seed) {
+  const auto& params = req.request->params();
+  if (!req.grammar.empty()) {
+    llama_sampler* g =
+        llama_sampler_init_grammar(vocab, req.grammar.c_str(), "root");
+    if (g) llama_sampler_chain_add(chain, g);
+  }
+
+  float repeat_penalty = params.has_repetition_penalty()
+                             ? params.repetition_penalty()
+                             : settings.default_repeat_penalty;
+  llama_sampler_chain_add(
+      chain, llama_sampler_init_penalties(64, repeat_penalty, 0.0f, 0.0f));
+  llama_sampler_chain_add(
+      chain,
+      llama_sampler_init_top_k(params.has_top_k() ? params.top_k()
+                                                  : settings.default_top_k));
+  llama_sampler_chain_add(
+      chain, llama_sampler_init_temp(params.has_temperature()
+                                         ? params.temperature()
+                                         : settings.default_temperature));
+  llama_sampler_chain_add(chain, llama_sampler_init_dist(seed));
+}
+
+// "a, b,c" -> {"a", "b", "c"}
+static std::vector<std::string> split_profile_list(const std::string& list) {
+  std::vector<std::string> names;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    item.erase(0, item.find_first_not_of(" \t"));
+    item.erase(item.find_last_not_of(" \t") + 1);
+    if (!item.empty()) names.push_back(item);
+  }
+  return names;
+}
+
+// Ağırlıklar + havuzun üst sınırdaki KV belleği + varsa embeddings
+// context'i (bütçe hesabı için).
+static size_t instance_bytes(ModelInstance& instance) {
+  auto& pool = instance.context_pool();
+  size_t kv_contexts = pool.is_unified() ? 1 : pool.get_total_count();
+  return llama_model_size(instance.model()) +
+         pool.get_context_bytes() * kv_contexts + instance.embeddings_bytes();
+}
+
 // --- CONSTRUCTOR & DESTRUCTOR ---
 
 LLMEngine::LLMEngine(Settings& settings,
-                     prometheus::Gauge& active_contexts_gauge)
-    : settings_(settings), active_contexts_gauge_(active_contexts_gauge) {
-  spdlog::info("🚀 Initializing LLM Engine...");
+                     prometheus::Gauge& active_contexts_gauge,
+                     prometheus::Gauge* in_flight_gauge)
+    : settings_(settings),
+      active_contexts_gauge_(active_contexts_gauge),
+      in_flight_gauge_(in_flight_gauge) {}
 
-  formatter_ = create_formatter(settings_.model_id);
+void LLMEngine::start() {
+  spdlog::info("🚀 Initializing LLM Engine...");
 
   if (!reload_model(settings_.profile_name)) {
+    if (stop_requested_) {
+      spdlog::warn("🛑 Shutdown requested during startup; model not loaded.");
+      return;
+    }
     throw std::runtime_error("Critical: Initial model load failed.");
   }
 
-  size_t batch_size =
+  size_t num_workers =
       settings_.enable_dynamic_batching ? settings_.max_batch_size : 1;
-  batcher_ = std::make_unique<DynamicBatcher>(
-      batch_size, std::chrono::milliseconds(settings_.batch_timeout_ms));
-  batcher_->batch_processing_callback =
-      [this](std::vector<std::shared_ptr<BatchedRequest>>& batch) {
-        this->process_batch(batch);
-      };
+
+  // Ek modeller açılışta yüklenir; her birinin slotları için worker eklenir
+  // ki bir modelin kuyruğu diğerlerini bekletmesin.
+  bool residents_ok = true;
+  for (const auto& profile : split_profile_list(settings_.resident_profiles)) {
+    if (profile == settings_.profile_name) continue;
+    if (stop_requested_) break;
+    auto resident = load_resident(profile);
+    if (!resident) residents_ok = false;
+    if (resident && settings_.enable_dynamic_batching) {
+      num_workers += resident->context_pool().get_total_count();
+    }
+  }
+
+  if (stop_requested_) {
+    spdlog::warn("🛑 Shutdown requested during startup; not accepting.");
+    return;
+  }
+
+  owned_batcher_ = std::make_unique<DynamicBatcher>(
+      num_workers, std::chrono::milliseconds(settings_.batch_timeout_ms),
+      [this](std::shared_ptr<BatchedRequest> req) {
+        this->process_request(req);
+      },
+      parse_scheduling_policy(settings_.scheduling_policy),
+      std::chrono::milliseconds(settings_.sjf_max_wait_ms), in_flight_gauge_);
+  // SJF tahmini isteğin profilinin sınırını kullanır (ek modeller dahil).
+  owned_batcher_->estimator().set_max_tokens_lookup(
+      [this](const std::string& profile) {
+        std::shared_ptr<ModelInstance> instance = find_instance(profile);
+        return instance ? instance->settings().default_max_tokens
+                        : get_settings().default_max_tokens;
+      });
+  batcher_ = owned_batcher_.get();
+
+  // Batcher hazır olmadan kabul açılmasın; reload_model ready'yi erken
+  // bildirmişti.
+  set_state(residents_ok ? EngineState::kReady : EngineState::kDegraded);
 }
 
 LLMEngine::~LLMEngine() {
-  if (batcher_) batcher_->stop();
   {
-    std::unique_lock<std::shared_mutex> lock(model_mutex_);
-    clear_adapter_cache();
-    context_pool_.reset();
-    if (model_) llama_model_free(model_);
-    llama_backend_free();
+    std::lock_guard<std::mutex> lock(loader_mutex_);
+    loader_stopping_ = true;
   }
+  loader_cv_.notify_all();
+  if (loader_.joinable()) loader_.join();
+  if (owned_batcher_) owned_batcher_->stop();
+  {
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    residents_.clear();
+    instance_.reset();
+  }
+  // Bırakılan örnekler backend kapanmadan silinir.
+  reaper_->stop();
+  llama_backend_free();
 }
 
 // --- MODEL MANAGEMENT ---
 
+std::shared_ptr<ModelInstance> LLMEngine::get_instance() const {
+  std::lock_guard<std::mutex> lock(instance_mutex_);
+  return instance_;
+}
+
+Settings LLMEngine::get_settings() const {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  return settings_;
+}
+
+std::shared_ptr<BatchedRequest> LLMEngine::new_request() const {
+  std::lock_guard<std::mutex> lock(settings_mutex_);
+  auto req = std::make_shared<BatchedRequest>(
+      settings_.stream_buffer_tokens, settings_.stream_buffer_kb * 1024);
+  req->overflow_policy =
+      parse_overflow_policy(settings_.stream_overflow_policy);
+  req->stall_timeout =
+      std::chrono::milliseconds(std::max(settings_.stream_stall_timeout_ms, 0));
+  req->min_chunk_bytes = settings_.stream_min_chunk_bytes;
+  req->max_flush_interval = std::chrono::milliseconds(
+      std::max(settings_.stream_max_flush_interval_ms, 1));
+  return req;
+}
+
 bool LLMEngine::reload_model(const std::string& profile_name) {
+  std::lock_guard<std::mutex> reload_lock(reload_mutex_);
   spdlog::info("🔄 Profile switch requested: {}", profile_name);
+  // Değişim çoğunlukla profiles.json düzenlemesinin ardından gelir.
+  invalidate_profile_cache();
 
-  Settings temp_settings = settings_;
+  Settings temp_settings = get_settings();
   if (!apply_profile(temp_settings, profile_name)) {
     spdlog::error("❌ Reload aborted: Profile '{}' invalid.", profile_name);
     return false;
   }
+  if (stop_requested_) return false;
 
   try {
     spdlog::info("⬇️ checking/downloading model in background...");
+    report_phase(EngineState::kDownloading);
     temp_settings.model_path =
         ModelManager::ensure_model_is_ready(temp_settings);
   } catch (const std::exception& e) {
     spdlog::error("❌ Background download failed: {}", e.what());
+    report_load_failure();
+    return false;
+  }
+  if (stop_requested_) {
+    spdlog::warn("🛑 Shutdown requested; skipping load of '{}'.",
+                 profile_name);
     return false;
   }
 
-  settings_ = temp_settings;
-  formatter_ = create_formatter(settings_.model_id);
+  if (!swap_instance(temp_settings)) return false;
 
-  return internal_reload_model();
+  // Yeni varsayılan daha önce ek model olarak yüklüyse ikinci kopyayı bırak.
+  std::shared_ptr<ModelInstance> duplicate;
+  {
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    auto it = residents_.find(temp_settings.profile_name);
+    if (it != residents_.end()) {
+      duplicate = std::move(it->second.instance);
+      residents_.erase(it);
+    }
+  }
+  if (duplicate) release_instance(std::move(duplicate));
+  return true;
 }
 
 bool LLMEngine::update_hardware_config(int gpu_layers, int context_size,
-                                       bool kv_offload) {
+                                       bool kv_offload,
+                                       const std::string& cache_type_k,
+                                       const std::string& cache_type_v,
+                                       const std::string& flash_attn) {
+  std::lock_guard<std::mutex> reload_lock(reload_mutex_);
   spdlog::info(
-      "⚙️ Hardware Reconfiguration: GPU={} Layers, Context={}, KV_Offload={}",
-      gpu_layers, context_size, kv_offload);
-
-  settings_.n_gpu_layers = gpu_layers;
-  settings_.context_size = context_size;
-  settings_.kv_offload = kv_offload;
-
-  return internal_reload_model();
+      "⚙️ Hardware Reconfiguration: GPU={} Layers, Context={}, KV_Offload={}, "
+      "KV Cache={}/{}, FlashAttn={}",
+      gpu_layers, context_size, kv_offload, cache_type_k, cache_type_v,
+      flash_attn);
+
+  Settings temp_settings = get_settings();
+  temp_settings.n_gpu_layers = gpu_layers;
+  temp_settings.context_size = context_size;
+  temp_settings.kv_offload = kv_offload;
+  temp_settings.cache_type_k = cache_type_k;
+  temp_settings.cache_type_v = cache_type_v;
+  temp_settings.flash_attn = flash_attn;
+
+  return swap_instance(temp_settings);
 }
 
-bool LLMEngine::internal_reload_model() {
-  std::unique_lock<std::shared_mutex> lock(model_mutex_);
-  spdlog::info("🔒 System locked for model update...");
+void LLMEngine::ensure_backend_initialized() {
+  static bool backend_initialized = false;
+  if (backend_initialized) return;
+
+  llama_backend_init();
+  ggml_numa_strategy numa = settings_.numa_strategy;
+  if (numa == GGML_NUMA_STRATEGY_MIRROR) {
+    // ggml ağırlık replikasyonunu (mirror) henüz desteklemiyor; en yakın
+    // karşılık distribute. Bu yalnızca thread'leri düğümlere dağıtır;
+    // ağırlık sayfaları interleave edilmez, onları ilk dokunan thread'in
+    // düğümünde kalırlar.
+    spdlog::warn(
+        "⚠️ NUMA 'mirror' is not supported by ggml. Using 'distribute'.");
+    numa = GGML_NUMA_STRATEGY_DISTRIBUTE;
+  }
+  llama_numa_init(numa);
+  if (numa != GGML_NUMA_STRATEGY_DISABLED) {
+    spdlog::info("🧭 NUMA strategy: {}", numa_strategy_name(numa));
+  }
+  backend_initialized = true;
+}
 
-  model_loaded_ = false;
+// Ağırlıkların GPU'ya gidecek kısmı: katman sayısı GGUF'tan okunur, çıkış
+// katmanı dahil n_gpu_layers / (block_count + 1) oranında. Okunamazsa tümü.
+static uintmax_t offloaded_weight_bytes(const Settings& s,
+                                        uintmax_t model_bytes) {
+  if (s.n_gpu_layers <= 0) return 0;
+  uint32_t n_layers = 0;
+  gguf_init_params params = {/*no_alloc=*/true, /*ctx=*/nullptr};
+  if (gguf_context* ctx = gguf_init_from_file(s.model_path.c_str(), params)) {
+    int64_t arch = gguf_find_key(ctx, "general.architecture");
+    if (arch >= 0) {
+      std::string key =
+          std::string(gguf_get_val_str(ctx, arch)) + ".block_count";
+      int64_t count = gguf_find_key(ctx, key.c_str());
+      if (count >= 0) n_layers = gguf_get_val_u32(ctx, count);
+    }
+    gguf_free(ctx);
+  }
+  if (n_layers == 0) return model_bytes;
+  uint32_t offloaded = std::min<uint32_t>(s.n_gpu_layers, n_layers + 1);
+  return model_bytes * offloaded / (n_layers + 1);
+}
 
-  try {
-    clear_adapter_cache();
-    context_pool_.reset();
-    if (model_) {
-      llama_model_free(model_);
-      model_ = nullptr;
+// Yeni model eskisinin yanına sığıyor mu? Host: /proc/meminfo MemAvailable
+// ağırlık + %25 pay. GPU: GPU cihazlarının boş belleği GPU'ya gidecek
+// katmanlar + KV (kv_offload; eski havuzun KV'si tahmin olarak) + %25 pay.
+// Okunamayan kaynak (ör. Linux dışı, GPU'suz derleme) için yer olduğu
+// varsayılır.
+static bool has_memory_for_second_instance(const Settings& s,
+                                           uintmax_t kv_bytes) {
+  std::error_code ec;
+  uintmax_t model_bytes = std::filesystem::file_size(s.model_path, ec);
+  if (ec) return true;
+
+  uintmax_t gpu_bytes = offloaded_weight_bytes(s, model_bytes);
+  if (gpu_bytes > 0) {
+    size_t free_vram = 0;
+    bool has_gpu = false;
+    for (size_t i = 0; i < ggml_backend_dev_count(); ++i) {
+      ggml_backend_dev_t dev = ggml_backend_dev_get(i);
+      if (ggml_backend_dev_type(dev) != GGML_BACKEND_DEVICE_TYPE_GPU) continue;
+      size_t free = 0, total = 0;
+      ggml_backend_dev_memory(dev, &free, &total);
+      free_vram += free;
+      has_gpu = true;
+    }
+    uintmax_t required =
+        gpu_bytes + gpu_bytes / 4 + (s.kv_offload ? kv_bytes : 0);
+    if (has_gpu && free_vram < required) {
+      spdlog::warn("⚠️ Not enough VRAM for a side-by-side load ({} MB free, "
+                   "~{} MB needed).",
+                   free_vram / (1024 * 1024), required / (1024 * 1024));
+      return false;
     }
+  }
 
-    static bool backend_initialized = false;
-    if (!backend_initialized) {
-      llama_backend_init();
-      llama_numa_init(settings_.numa_strategy);
-      backend_initialized = true;
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  uintmax_t value_kb = 0;
+  std::string unit;
+  while (meminfo >> key >> value_kb >> unit) {
+    if (key == "MemAvailable:") {
+      uintmax_t required = model_bytes + model_bytes / 4;
+      return value_kb * 1024 >= required;
     }
+  }
+  return true;
+}
 
-    llama_model_params model_params = llama_model_default_params();
-    model_params.n_gpu_layers = settings_.n_gpu_layers;
-    model_params.use_mmap = settings_.use_mmap;
+bool LLMEngine::swap_instance(const Settings& new_settings) {
+  ensure_backend_initialized();
+
+  std::shared_ptr<ModelInstance> old_instance = get_instance();
+  std::optional<Settings> previous;
+  if (old_instance) previous = old_instance->settings();
+  uintmax_t kv_bytes =
+      old_instance ? instance_bytes(*old_instance) -
+                         llama_model_size(old_instance->model())
+                   : 0;
+  bool hot = old_instance && new_settings.hot_swap &&
+             has_memory_for_second_instance(new_settings, kv_bytes);
+
+  if (old_instance && !hot) {
+    // Soğuk değişim: iki model birden sığmıyor. Eski örnek yayından kalkar,
+    // istekler boşaltılır ve serbest bırakıldıktan sonra yenisi yüklenir.
+    spdlog::warn(
+        "⚠️ Not enough memory for a side-by-side load. Falling back to a "
+        "cold model swap (requests will be rejected while loading).");
+    {
+      std::lock_guard<std::mutex> lock(instance_mutex_);
+      instance_.reset();
+    }
+    release_instance(std::move(old_instance), /*wait=*/true);
+  }
 
-    spdlog::info("⚙️ Loading model from: {}", settings_.model_path);
-    model_ =
-        llama_model_load_from_file(settings_.model_path.c_str(), model_params);
-    if (!model_) throw std::runtime_error("Failed to load model file.");
+  std::shared_ptr<ModelInstance> fresh;
+  load_progress_ = 0.0;
+  try {
+    report_phase(EngineState::kLoading);
+    fresh = reaper_->adopt(std::make_unique<ModelInstance>(
+        new_settings, active_contexts_gauge_, &load_progress_));
+    if (new_settings.enable_warm_up && !stop_requested_) {
+      report_phase(EngineState::kWarming);
+      auto& pool = fresh->context_pool();
+      ModelWarmup::fast_warmup(pool, pool.get_allocated_count());
+    }
+  } catch (const std::exception& e) {
+    load_progress_ = -1.0;
+    spdlog::error("❌ Update failed: {}", e.what());
+    // Sıcak değişimde eski örnek yayında kalmaya devam eder. Soğuk
+    // değişimde eski örnek bırakılmıştı; önceki model geri yüklenir.
+    if (previous && !hot && !stop_requested_) restore_instance(*previous);
+    report_load_failure();
+    return false;
+  }
+  load_progress_ = -1.0;
+  if (stop_requested_) {
+    // Kapanış başladı; yüklenen örnek yayına alınmadan bırakılır.
+    spdlog::warn("🛑 Shutdown requested; discarding freshly loaded model.");
+    release_instance(std::move(fresh));
+    return false;
+  }
 
-    context_pool_ = std::make_unique<LlamaContextPool>(settings_, model_,
-                                                       active_contexts_gauge_);
+  {
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    instance_ = fresh;
+  }
+  {
+    std::lock_guard<std::mutex> lock(settings_mutex_);
+    settings_ = new_settings;
+  }
+  spdlog::info("✅ Model update successful. Active profile: {}",
+               new_settings.profile_name);
+  // Açılışta batcher henüz yok; ready'yi start() bildirir.
+  if (batcher_.load()) set_state(EngineState::kReady);
+
+  // Sıcak değişim: eski örnek son isteği bitince arka planda silinir;
+  // değişimi yapan thread beklemez.
+  if (old_instance) release_instance(std::move(old_instance));
+  return true;
+}
 
-    model_loaded_ = true;
-    spdlog::info("✅ Model update successful. Unlock.");
-    return true;
+bool LLMEngine::restore_instance(const Settings& previous) {
+  spdlog::warn("↩️ Restoring previous model '{}' after a failed cold swap.",
+               previous.profile_name);
+  std::shared_ptr<ModelInstance> restored;
+  try {
+    report_phase(EngineState::kLoading);
+    restored = reaper_->adopt(std::make_unique<ModelInstance>(
+        previous, active_contexts_gauge_, &load_progress_));
+    if (previous.enable_warm_up) {
+      auto& pool = restored->context_pool();
+      ModelWarmup::fast_warmup(pool, pool.get_allocated_count());
+    }
   } catch (const std::exception& e) {
-    spdlog::error("❌ Update failed: {}", e.what());
+    load_progress_ = -1.0;
+    spdlog::error("❌ Could not restore previous model: {}", e.what());
     return false;
   }
+  load_progress_ = -1.0;
+  std::lock_guard<std::mutex> lock(instance_mutex_);
+  instance_ = restored;
+  return true;
+}
+
+void LLMEngine::release_instance(std::shared_ptr<ModelInstance> instance,
+                                 bool wait) {
+  // Devam eden istekler örneğin kendi kopyalarını tutar; son kopya
+  // bırakıldığında reaper siler.
+  const ModelInstance* raw = instance.get();
+  instance.reset();
+  if (!wait || !raw) return;
+  if (!reaper_->wait_released(raw, kDrainTimeout)) {
+    spdlog::warn(
+        "⏳ Old model instance still has in-flight users after {}s; it will "
+        "be freed by the last one.",
+        kDrainTimeout.count());
+  }
+}
+
+bool LLMEngine::is_model_loaded() const { return get_instance() != nullptr; }
+
+// --- LIFECYCLE ---
+
+const char* engine_state_name(EngineState state) {
+  switch (state) {
+    case EngineState::kDownloading:
+      return "downloading";
+    case EngineState::kLoading:
+      return "loading";
+    case EngineState::kWarming:
+      return "warming";
+    case EngineState::kReady:
+      return "ready";
+    case EngineState::kDegraded:
+      return "degraded";
+    case EngineState::kUnavailable:
+      return "unavailable";
+    case EngineState::kDraining:
+      return "draining";
+  }
+  return "unknown";
+}
+
+EngineState LLMEngine::get_state() const {
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  return state_;
+}
+
+bool LLMEngine::is_accepting() const {
+  EngineState state = get_state();
+  return (state == EngineState::kReady || state == EngineState::kDegraded) &&
+         batcher_.load() && is_model_loaded();
+}
+
+void LLMEngine::set_state_listener(
+    std::function<void(EngineState)> listener) {
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  state_listener_ = std::move(listener);
+  if (state_listener_) state_listener_(state_);
+}
+
+void LLMEngine::set_state(EngineState state) {
+  std::lock_guard<std::mutex> lock(state_mutex_);
+  // Boşaltma başladıysa geç biten bir yükleme replikayı geri açamaz.
+  if (state_ == EngineState::kDraining || state_ == state) return;
+  spdlog::info("🔁 Engine state: {} -> {}", engine_state_name(state_),
+               engine_state_name(state));
+  state_ = state;
+  if (state_listener_) state_listener_(state_);
+}
+
+void LLMEngine::report_phase(EngineState phase) {
+  if (!is_model_loaded()) set_state(phase);
+}
+
+void LLMEngine::report_load_failure() {
+  set_state(is_model_loaded() ? EngineState::kDegraded
+                              : EngineState::kUnavailable);
+}
+
+void LLMEngine::begin_draining() {
+  set_state(EngineState::kDraining);
+  if (DynamicBatcher* batcher = batcher_.load()) batcher->close();
 }
 
-bool LLMEngine::is_model_loaded() const {
-  std::shared_lock<std::shared_mutex> lock(model_mutex_);
-  return model_loaded_.load();
+void LLMEngine::abort_in_flight() { aborting_ = true; }
+
+size_t LLMEngine::get_in_flight() const {
+  DynamicBatcher* batcher = batcher_.load();
+  return batcher ? batcher->get_in_flight() : 0;
 }
 
-// --- LORA MANAGEMENT (LRU HARDENING) ---
+// --- MULTI-MODEL REGISTRY ---
+
+std::shared_ptr<ModelInstance> LLMEngine::get_instance_for(
+    const std::string& profile, ProfileState* state) {
+  if (state) *state = ProfileState::kReady;
+  if (profile.empty()) return get_instance();
+  {
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    if (instance_ && instance_->settings().profile_name == profile) {
+      return instance_;
+    }
+    auto it = residents_.find(profile);
+    if (it != residents_.end()) {
+      it->second.last_used = std::chrono::steady_clock::now();
+      return it->second.instance;
+    }
+  }
+
+  // İndirme ve yükleme dakikalar sürebilir; worker'ı (ve yüklü modellerin
+  // trafiğini) bekletmemek için loader thread'ine verilir.
+  ProfileState result = ProfileState::kLoading;
+  {
+    std::lock_guard<std::mutex> lock(loader_mutex_);
+    auto failed = load_failed_.find(profile);
+    if (failed != load_failed_.end() &&
+        std::chrono::steady_clock::now() - failed->second < kLoadRetryAfter) {
+      result = ProfileState::kUnavailable;
+    } else if (loader_stopping_) {
+      result = ProfileState::kUnavailable;
+    } else if (loading_.insert(profile).second) {
+      load_queue_.push_back(profile);
+      if (!loader_.joinable()) {
+        loader_ = std::thread(&LLMEngine::loader_loop, this);
+      }
+      loader_cv_.notify_one();
+    }
+  }
+  if (state) *state = result;
+  return nullptr;
+}
 
-void LLMEngine::evict_oldest_lora() {
-  if (lora_lru_list_.empty()) return;
-  std::string oldest_id = lora_lru_list_.back();
-  lora_lru_list_.pop_back();
+LLMEngine::ProfileState LLMEngine::prepare_profile(
+    const std::string& profile) {
+  ProfileState state;
+  get_instance_for(profile, &state);
+  return state;
+}
 
-  auto it = lora_cache_.find(oldest_id);
-  if (it != lora_cache_.end()) {
-    spdlog::info("♻️ Evicting LoRA adapter from cache: {}", oldest_id);
-    llama_adapter_lora_free(it->second);
-    lora_cache_.erase(it);
+std::shared_ptr<ModelInstance> LLMEngine::find_instance(
+    const std::string& profile) const {
+  std::lock_guard<std::mutex> lock(instance_mutex_);
+  if (instance_ && (profile.empty() ||
+                    instance_->settings().profile_name == profile)) {
+    return instance_;
   }
+  auto it = residents_.find(profile);
+  return it != residents_.end() ? it->second.instance : nullptr;
 }
 
-struct llama_adapter_lora* LLMEngine::get_or_load_adapter(
-    const std::string& lora_id) {
-  std::lock_guard<std::mutex> lock(lora_mutex_);
+bool LLMEngine::choices_fit(const std::string& profile, uint32_t n,
+                            int64_t max_tokens) const {
+  if (n <= 1) return true;
+  std::shared_ptr<ModelInstance> instance = find_instance(profile);
+  if (!instance) return true;  // Yükleniyor; worker yine kontrol eder.
+  const auto& settings = instance->settings();
+  uint64_t max_gen =
+      max_tokens > 0 ? max_tokens : settings.default_max_tokens;
+  return n * max_gen < settings.context_size;
+}
 
-  // Check Cache
-  auto it = lora_cache_.find(lora_id);
-  if (it != lora_cache_.end()) {
-    // Update LRU: move to front
-    lora_lru_list_.remove(lora_id);
-    lora_lru_list_.push_front(lora_id);
-    return it->second;
+void LLMEngine::loader_loop() {
+  std::unique_lock<std::mutex> lock(loader_mutex_);
+  while (true) {
+    loader_cv_.wait(
+        lock, [this] { return loader_stopping_ || !load_queue_.empty(); });
+    if (loader_stopping_) return;
+    std::string profile = load_queue_.front();
+    load_queue_.pop_front();
+
+    lock.unlock();
+    spdlog::info("⏳ Loading model profile '{}' in the background...",
+                 profile);
+    bool ok = load_resident(profile) != nullptr;
+    lock.lock();
+
+    loading_.erase(profile);
+    if (ok) {
+      load_failed_.erase(profile);
+    } else {
+      load_failed_[profile] = std::chrono::steady_clock::now();
+    }
   }
+}
 
-  // Security & Path Check
-  std::string sanitized_id = lora_id;
-  sanitized_id.erase(std::remove(sanitized_id.begin(), sanitized_id.end(), '/'),
-                     sanitized_id.end());
-  sanitized_id.erase(
-      std::remove(sanitized_id.begin(), sanitized_id.end(), '\\'),
-      sanitized_id.end());
+bool LLMEngine::has_profile(const std::string& profile) const {
+  Settings current = get_settings();
+  if (profile == current.profile_name) return true;
+  {
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    if (residents_.count(profile)) return true;
+  }
+  return profile_defined(current, profile);
+}
 
+bool LLMEngine::profile_defined(const Settings& s,
+                                const std::string& name) const {
   namespace fs = std::filesystem;
-  fs::path lora_path = fs::path(settings_.lora_dir) / (sanitized_id + ".gguf");
-  if (!fs::exists(lora_path)) {
-    lora_path = fs::path(settings_.lora_dir) / (sanitized_id + ".bin");
+  if (name.empty()) return false;
+  std::lock_guard<std::mutex> lock(profile_cache_mutex_);
+  auto now = std::chrono::steady_clock::now();
+  if (!profile_cache_valid_ || now - profile_checked_ >= kProfileRecheck) {
+    profile_checked_ = now;
+    fs::path path = find_profiles_file(s);
+    std::error_code ec;
+    fs::file_time_type mtime{};
+    if (!path.empty()) mtime = fs::last_write_time(path, ec);
+    if (!profile_cache_valid_ || path != profile_file_ ||
+        mtime != profile_mtime_) {
+      profile_names_ = read_profile_names(path);
+      profile_file_ = path;
+      profile_mtime_ = mtime;
+      profile_cache_valid_ = true;
+    }
   }
+  return profile_names_.count(name) > 0;
+}
 
-  if (!fs::exists(lora_path)) {
-    spdlog::error("❌ LoRA adapter not found: {}", lora_path.string());
+void LLMEngine::invalidate_profile_cache() {
+  std::lock_guard<std::mutex> lock(profile_cache_mutex_);
+  profile_cache_valid_ = false;
+}
+
+std::string LLMEngine::find_profile_by_model_id(
+    const std::string& model_id) const {
+  std::lock_guard<std::mutex> lock(instance_mutex_);
+  for (const auto& [profile, resident] : residents_) {
+    if (resident.instance->settings().model_id == model_id) return profile;
+  }
+  return "";
+}
+
+std::shared_ptr<ModelInstance> LLMEngine::load_resident(
+    const std::string& profile) {
+  std::lock_guard<std::mutex> load_lock(resident_load_mutex_);
+  {
+    // Kilidi beklerken başka bir worker yüklemiş olabilir.
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    auto it = residents_.find(profile);
+    if (it != residents_.end()) {
+      it->second.last_used = std::chrono::steady_clock::now();
+      return it->second.instance;
+    }
+  }
+
+  Settings resident_settings = get_settings();
+  if (!apply_profile(resident_settings, profile)) {
+    spdlog::error("❌ Cannot load model: profile '{}' is not defined.",
+                  profile);
+    return nullptr;
+  }
+
+  try {
+    resident_settings.model_path =
+        ModelManager::ensure_model_is_ready(resident_settings);
+  } catch (const std::exception& e) {
+    spdlog::error("❌ Download failed for profile '{}': {}", profile,
+                  e.what());
+    return nullptr;
+  }
+
+  // KV boyutu yüklemeden önce bilinmez; ağırlık dosyası ile yer açılır.
+  std::error_code ec;
+  size_t estimate =
+      std::filesystem::file_size(resident_settings.model_path, ec);
+  if (!make_room_for(ec ? 0 : estimate)) {
+    spdlog::error(
+        "❌ Model memory budget exhausted; cannot load profile '{}' while the "
+        "other models are busy.",
+        profile);
     return nullptr;
   }
 
-  // Capacity Control
-  if (lora_cache_.size() >= MAX_LORA_CACHE_SIZE) {
-    evict_oldest_lora();
+  std::shared_ptr<ModelInstance> fresh;
+  try {
+    fresh = reaper_->adopt(std::make_unique<ModelInstance>(
+        resident_settings, active_contexts_gauge_));
+    if (resident_settings.enable_warm_up) {
+      auto& pool = fresh->context_pool();
+      ModelWarmup::fast_warmup(pool, pool.get_allocated_count());
+    }
+  } catch (const std::exception& e) {
+    spdlog::error("❌ Failed to load profile '{}': {}", profile, e.what());
+    return nullptr;
   }
 
-  spdlog::info("💾 Loading LoRA adapter: {}", sanitized_id);
-  struct llama_adapter_lora* adapter =
-      llama_adapter_lora_init(model_, lora_path.c_str());
+  size_t bytes = instance_bytes(*fresh);
+  {
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    residents_[profile] = {fresh, std::chrono::steady_clock::now(), bytes};
+  }
+  spdlog::info("📚 Resident model loaded: '{}' (~{} MB).", profile,
+               bytes / (1024 * 1024));
 
-  if (adapter) {
-    lora_cache_[sanitized_id] = adapter;
-    lora_lru_list_.push_front(sanitized_id);
-    return adapter;
+  // Gerçek boyut (KV dahil) tahmini aşmış olabilir; bütçeyi yeniden dengele.
+  make_room_for(0);
+  return fresh;
+}
+
+bool LLMEngine::make_room_for(size_t incoming_bytes) {
+  size_t budget = get_settings().model_memory_budget_mb * 1024 * 1024;
+  if (budget == 0) return true;
+
+  std::vector<std::shared_ptr<ModelInstance>> evicted;
+  bool fits = false;
+  {
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    size_t used = instance_ ? instance_bytes(*instance_) : 0;
+    for (const auto& [profile, resident] : residents_) used += resident.bytes;
+
+    while (used + incoming_bytes > budget) {
+      // Sadece kimsenin kullanmadığı (tek sahibi bu tablo olan) ek modeller
+      // bırakılabilir; varsayılan model hiçbir zaman bırakılmaz.
+      auto victim = residents_.end();
+      for (auto it = residents_.begin(); it != residents_.end(); ++it) {
+        if (it->second.instance.use_count() > 1) continue;
+        if (victim == residents_.end() ||
+            it->second.last_used < victim->second.last_used) {
+          victim = it;
+        }
+      }
+      if (victim == residents_.end()) break;
+
+      spdlog::info("♻️ Unloading idle model '{}' to stay within the memory "
+                   "budget.",
+                   victim->first);
+      used -= victim->second.bytes;
+      evicted.push_back(std::move(victim->second.instance));
+      residents_.erase(victim);
+    }
+    fits = used + incoming_bytes <= budget;
   }
-  return nullptr;
+  // Modeller kilit dışında serbest bırakılır.
+  evicted.clear();
+  return fits;
 }
 
-bool LLMEngine::apply_lora_to_context(llama_context* ctx,
-                                      const std::string& lora_adapter_id) {
-  if (lora_adapter_id.empty()) return true;
-  auto* adapter = get_or_load_adapter(lora_adapter_id);
-  if (!adapter) return false;
-  return llama_set_adapter_lora(ctx, adapter, 1.0f) == 0;
+std::vector<LLMEngine::ResidentInfo> LLMEngine::get_resident_models() const {
+  std::vector<ResidentInfo> models;
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> lock(instance_mutex_);
+
+  auto describe = [&](ModelInstance& instance, bool is_default, size_t bytes,
+                      double idle_seconds) {
+    auto& pool = instance.context_pool();
+    models.push_back({instance.settings().profile_name,
+                      instance.settings().model_id, is_default, bytes,
+                      pool.get_active_count(), pool.get_total_count(),
+                      idle_seconds});
+  };
+
+  if (instance_) describe(*instance_, true, instance_bytes(*instance_), 0.0);
+  for (const auto& [profile, resident] : residents_) {
+    std::chrono::duration<double> idle = now - resident.last_used;
+    describe(*resident.instance, false, resident.bytes, idle.count());
+  }
+  return models;
 }
 
-void LLMEngine::clear_lora_from_context(llama_context* ctx) {
-  llama_clear_adapter_lora(ctx);
+size_t LLMEngine::probe_prefix_cache(const std::string& profile,
+                                     const std::string& tenant,
+                                     uint64_t fingerprint) const {
+  // Parmak izi kiracıya göre tohumlanır; başka kiracının öneki eşleşmez.
+  std::shared_ptr<ModelInstance> instance = find_instance(profile);
+  if (!instance) return 0;
+  return instance->context_pool().probe_prefix(fingerprint, tenant);
 }
 
-void LLMEngine::clear_adapter_cache() {
-  std::lock_guard<std::mutex> lock(lora_mutex_);
-  for (auto& [id, adapter] : lora_cache_) {
-    if (adapter) llama_adapter_lora_free(adapter);
+// --- EMBEDDINGS ---
+
+std::vector<std::vector<float>> LLMEngine::embed(
+    const std::string& profile, const std::vector<std::string>& inputs,
+    int32_t& prompt_tokens) {
+  // Embeddings HTTP thread'inde çalışır ama in_flight'ta sayılır; drain
+  // bitmeden süreç kapanmaz.
+  DynamicBatcher* batcher = batcher_.load();
+  if (!batcher || !batcher->begin_external()) {
+    throw std::runtime_error("Server is not accepting requests.");
+  }
+  struct InFlightScope {
+    DynamicBatcher* batcher;
+    ~InFlightScope() { batcher->end_external(); }
+  } in_flight{batcher};
+
+  // Örnek işlem boyunca tutulur; model değişimi onu etkilemez. Embeddings
+  // yolu model yüklemez; yalnızca bellekteki örnekler kullanılır.
+  std::shared_ptr<ModelInstance> instance = find_instance(profile);
+  if (!instance) throw std::runtime_error("Model is not loaded.");
+  if (instance->embeddings_bytes() == 0) {
+    // İlk çağrı ikinci bir context açar; model bütçesinde yer yoksa 503.
+    size_t bytes = EmbeddingContext::estimate_bytes(instance->model(),
+                                                    instance->settings());
+    if (!make_room_for(bytes)) {
+      throw std::runtime_error(
+          "Embeddings context does not fit the model memory budget.");
+    }
+  }
+  auto& context = instance->embeddings();
+  {
+    // Ek modelin bütçedeki boyutu embeddings context'ini de içersin.
+    std::lock_guard<std::mutex> lock(instance_mutex_);
+    auto it = residents_.find(instance->settings().profile_name);
+    if (it != residents_.end() && it->second.instance == instance) {
+      it->second.bytes = instance_bytes(*instance);
+    }
   }
-  lora_cache_.clear();
-  lora_lru_list_.clear();
+  const auto* vocab = llama_model_get_vocab(instance->model());
+
+  prompt_tokens = 0;
+  std::vector<std::vector<llama_token>> tokenized(inputs.size());
+  for (size_t i = 0; i < inputs.size(); ++i) {
+    const std::string& text = inputs[i];
+    auto& tokens = tokenized[i];
+    tokens.resize(text.length() + 8);
+    int n = llama_tokenize(vocab, text.c_str(), text.length(), tokens.data(),
+                           tokens.size(), true, false);
+    if (n < 0) {
+      tokens.resize(-n);
+      n = llama_tokenize(vocab, text.c_str(), text.length(), tokens.data(),
+                         tokens.size(), true, false);
+    }
+    tokens.resize(std::max(n, 0));
+    if (tokens.empty()) {
+      throw std::invalid_argument("Input " + std::to_string(i) +
+                                  " is empty.");
+    }
+    if (tokens.size() > context.max_input_tokens()) {
+      throw std::invalid_argument(
+          "Input " + std::to_string(i) + " has " +
+          std::to_string(tokens.size()) + " tokens; the limit is " +
+          std::to_string(context.max_input_tokens()) + ".");
+    }
+    prompt_tokens += tokens.size();
+  }
+  return context.embed(tokenized);
 }
 
 // --- REQUEST PROCESSING ---
 
 void LLMEngine::process_single_request(
     std::shared_ptr<BatchedRequest> batched_request) {
-  if (batcher_) {
-    batcher_->add_request(batched_request);
+  // Çağıran istek mesajının sahibidir; mesaj işlem bitene kadar yaşamalı.
+  if (DynamicBatcher* batcher = batcher_.load()) {
+    batcher->add_request(batched_request).wait();
   } else {
-    execute_single_request(batched_request);
+    process_request(batched_request);
   }
 }
 
-void LLMEngine::process_batch(
-    std::vector<std::shared_ptr<BatchedRequest>>& batch) {
-  if (batch.empty()) return;
-  std::shared_lock<std::shared_mutex> lock(model_mutex_);
-  if (!model_loaded_) return;
+void LLMEngine::process_request(std::shared_ptr<BatchedRequest> req_ptr) {
+  if (aborting_) {
+    req_ptr->finish_reason = "aborted";
+    return;
+  }
+  // İstek boyunca bu örnek yaşar; model değişimi onu etkilemez.
+  ProfileState state;
+  std::shared_ptr<ModelInstance> instance =
+      get_instance_for(req_ptr->model_profile, &state);
+  if (!instance) {
+    if (state == ProfileState::kLoading) {
+      // Kabul ile işleme arasında profil bellekten atılmış olabilir.
+      req_ptr->finish_reason = "model_loading";
+    } else {
+      // Varsayılan model de olmayabilir (ör. başarısız soğuk değişim);
+      // boş bir "stop" yanıtı dönmemeli.
+      SUTS_ERROR("MODEL_UNAVAILABLE", req_ptr->trace_id, req_ptr->span_id,
+                 req_ptr->tenant_id, "Model profile '{}' is not available.",
+                 req_ptr->model_profile.empty() ? "default"
+                                                : req_ptr->model_profile);
+      req_ptr->finish_reason = "model_unavailable";
+    }
+    return;
+  }
 
-  std::vector<std::future<void>> futures;
-  for (auto& req_ptr : batch) {
-    futures.push_back(std::async(std::launch::async, [this, req_ptr]() {
-      try {
-        this->execute_single_request(req_ptr);
-      } catch (const std::exception& e) {
-        spdlog::error("🔥 Critical thread failure: {}", e.what());
-        req_ptr->finish_reason = "internal_error";
-      }
-    }));
+  try {
+    execute_single_request(*instance, req_ptr);
+  } catch (const std::exception& e) {
+    spdlog::error("🔥 Critical worker failure: {}", e.what());
+    req_ptr->finish_reason = "internal_error";
   }
-  for (auto& f : futures) f.get();
 }
 
 std::vector<llama_token> LLMEngine::tokenize_and_truncate(
-    std::shared_ptr<BatchedRequest> req_ptr,
+    ModelInstance& instance, std::shared_ptr<BatchedRequest> req_ptr,
     const std::string& formatted_prompt) {
-  const auto* vocab = llama_model_get_vocab(model_);
+  const auto* vocab = llama_model_get_vocab(instance.model());
   bool add_special = true;  // Essential for Gemma 3 and Llama 3
 
   std::vector<llama_token> tokens(formatted_prompt.length() + 64);
@@ -290,7 +947,7 @@ std::vector<llama_token> LLMEngine::tokenize_and_truncate(
   }
   tokens.resize(n_tokens);
 
-  uint32_t max_context = settings_.context_size;
+  uint32_t max_context = instance.settings().context_size;
   uint32_t buffer = 128;  // Increased buffer for safety
   if (tokens.size() > (max_context - buffer)) {
     // Hard truncation from start
@@ -309,7 +966,7 @@ bool LLMEngine::decode_prompt(llama_context* ctx, ContextGuard& guard,
                               const std::vector<llama_token>& prompt_tokens,
                               std::shared_ptr<BatchedRequest> req_ptr) {
   size_t matched_len = guard.get_matched_tokens();
-  llama_memory_seq_rm(llama_get_memory(ctx), -1, matched_len, -1);
+  guard.clear_kv(matched_len);
 
   size_t tokens_to_process = prompt_tokens.size() - matched_len;
   if (tokens_to_process > 0) {
@@ -322,12 +979,12 @@ bool LLMEngine::decode_prompt(llama_context* ctx, ContextGuard& guard,
 
       for (int j = 0; j < n_eval; ++j) {
         common_batch_add(batch_scope.batch, prompt_tokens[matched_len + i + j],
-                         matched_len + i + j, {0}, false);
+                         matched_len + i + j, {guard.get_seq_id()}, false);
       }
       if (i + n_eval == tokens_to_process)
         batch_scope.batch.logits[n_eval - 1] = true;
 
-      if (llama_decode(ctx, batch_scope.batch) != 0) {
+      if (guard.decode(batch_scope.batch) != 0) {
         req_ptr->finish_reason = "length_error";
         return false;
       }
@@ -336,50 +993,120 @@ bool LLMEngine::decode_prompt(llama_context* ctx, ContextGuard& guard,
   return true;
 }
 
-void LLMEngine::generate_response(llama_context* ctx,
-                                  const std::vector<llama_token>& prompt_tokens,
-                                  std::shared_ptr<BatchedRequest> req_ptr) {
-  const auto* vocab = llama_model_get_vocab(model_);
-  const auto& params = req_ptr->request.params();
+bool LLMEngine::emit_token(BatchedRequest& req, llama_token id,
+                           std::string_view piece, uint32_t choice) {
+  // Birikim varsa yeni token ona eklenir; sıra korunur ve tek kayıt olarak
+  // yazılır.
+  if (!req.overflow_text.empty()) {
+    req.overflow_text.append(piece);
+    piece = req.overflow_text;
+  }
+  // Birikim tek seçeneğe ait olabilir; n > 1'de Coalesce, Pause gibi davranır.
+  OverflowPolicy policy = req.n_choices > 1 &&
+                                  req.overflow_policy ==
+                                      OverflowPolicy::Coalesce
+                              ? OverflowPolicy::Pause
+                              : req.overflow_policy;
+  if (!req.tokens.try_push(id, piece, choice)) {
+    switch (policy) {
+      case OverflowPolicy::Coalesce:
+        if (piece.size() < req.tokens.byte_capacity() / 2) {
+          if (req.overflow_text.empty()) req.overflow_text.assign(piece);
+          req.overflow_id = id;
+          return true;
+        }
+        // Birikim çok büyüdü: istemci hiç okumuyor, beklenir.
+        if (!push_blocking(req, id, piece)) return false;
+        break;
+      case OverflowPolicy::Abort:
+        req.finish_reason = "overflow";
+        spdlog::warn("⚠️ Stream buffer overflow, request aborted (trace: {})",
+                     req.trace_id);
+        return false;
+      case OverflowPolicy::Pause:
+        if (!push_blocking(req, id, piece, choice)) return false;
+        break;
+    }
+  }
+  req.overflow_text.clear();
+  if (req.on_tokens_ready) req.on_tokens_ready();
+  return true;
+}
 
-  LlamaSamplerGuard sampler_guard(llama_sampler_chain_default_params());
-  llama_sampler* chain = sampler_guard.sampler;
+bool LLMEngine::push_blocking(BatchedRequest& req, llama_token id,
+                              std::string_view text, uint32_t choice) {
+  // Tüketici yer açana kadar üretim durur (KV ve context korunur); istemci
+  // koptuysa, drain süresi dolduysa veya istemci hiç okumuyorsa vazgeçilir.
+  auto stalled_since = std::chrono::steady_clock::now();
+  while (!req.tokens.try_push(id, text, choice)) {
+    if (aborting_) {
+      req.finish_reason = "aborted";
+      return false;
+    }
+    if (req.should_stop_callback && req.should_stop_callback()) {
+      req.finish_reason = "cancelled";
+      return false;
+    }
+    if (req.stall_timeout.count() > 0 &&
+        std::chrono::steady_clock::now() - stalled_since > req.stall_timeout) {
+      req.finish_reason = "overflow";
+      spdlog::warn("⚠️ Client stopped reading for {} ms, request aborted "
+                   "(trace: {})",
+                   req.stall_timeout.count(), req.trace_id);
+      return false;
+    }
+    req.tokens.wait_for_space(std::chrono::milliseconds(50));
+  }
+  return true;
+}
 
-  if (!req_ptr->grammar.empty()) {
-    llama_sampler* g =
-        llama_sampler_init_grammar(vocab, req_ptr->grammar.c_str(), "root");
-    if (g) llama_sampler_chain_add(chain, g);
+void LLMEngine::flush_overflow(BatchedRequest& req) {
+  if (req.overflow_text.empty()) return;
+  if (push_blocking(req, req.overflow_id, req.overflow_text) &&
+      req.on_tokens_ready) {
+    req.on_tokens_ready();
   }
+  req.overflow_text.clear();
+}
 
-  float repeat_penalty = params.has_repetition_penalty()
-                             ? params.repetition_penalty()
-                             : settings_.default_repeat_penalty;
-  llama_sampler_chain_add(
-      chain, llama_sampler_init_penalties(64, repeat_penalty, 0.0f, 0.0f));
-  llama_sampler_chain_add(
-      chain,
-      llama_sampler_init_top_k(params.has_top_k() ? params.top_k()
-                                                  : settings_.default_top_k));
-  llama_sampler_chain_add(
-      chain, llama_sampler_init_temp(params.has_temperature()
-                                         ? params.temperature()
-                                         : settings_.default_temperature));
-  llama_sampler_chain_add(chain, llama_sampler_init_dist(time(NULL)));
+void LLMEngine::generate_response(ModelInstance& instance, ContextGuard& guard,
+                                  const std::vector<llama_token>& prompt_tokens,
+                                  std::shared_ptr<BatchedRequest> req_ptr,
+                                  uint32_t choice) {
+  const auto& settings = instance.settings();
+  const auto* vocab = llama_model_get_vocab(instance.model());
+  const auto& params = req_ptr->request->params();
+
+  LlamaSamplerGuard sampler_guard(llama_sampler_chain_default_params());
+  llama_sampler* chain = sampler_guard.sampler;
+  // Sıralı seçenekler aynı saniyede başlar; tohumlar ayrışmalı.
+  add_samplers(chain, vocab, settings, *req_ptr, time(NULL) + choice);
 
   uint32_t req_max_gen = params.has_max_new_tokens()
                              ? params.max_new_tokens()
-                             : settings_.default_max_tokens;
+                             : settings.default_max_tokens;
   int n_decoded = 0;
   llama_pos n_past = prompt_tokens.size();
   LlamaBatchScope token_batch(1, 0, 1);
+  // Boş kalırsa üretim sınıra ulaşmıştır ("length").
+  req_ptr->finish_reason.clear();
 
   while (n_decoded < (int)req_max_gen) {
     if (req_ptr->should_stop_callback && req_ptr->should_stop_callback()) {
       req_ptr->finish_reason = "cancelled";
       break;
     }
+    if (aborting_) {
+      req_ptr->finish_reason = "aborted";
+      break;
+    }
+    if (req_ptr->background && batcher_.load() &&
+        batcher_.load()->try_preempt()) {
+      req_ptr->finish_reason = "preempted";
+      break;
+    }
 
-    llama_token id = llama_sampler_sample(chain, ctx, -1);
+    llama_token id = guard.sample(chain);
     llama_sampler_accept(chain, id);
 
     if (llama_vocab_is_eog(vocab, id)) {
@@ -389,45 +1116,207 @@ void LLMEngine::generate_response(llama_context* ctx,
 
     char buf[256];
     int n = llama_token_to_piece(vocab, id, buf, sizeof(buf), 0, true);
-    std::string piece(buf, n);
+    std::string_view piece(buf, std::max(n, 0));
 
-    if (req_ptr->on_token_callback) req_ptr->on_token_callback(piece);
-    req_ptr->token_queue.push(piece);
+    if (req_ptr->on_token_callback) {
+      req_ptr->on_token_callback(std::string(piece));
+    } else if (!emit_token(*req_ptr, id, piece, choice)) {
+      break;
+    }
 
     token_batch.clear();
-    common_batch_add(token_batch.batch, id, n_past, {0}, true);
-    if (llama_decode(ctx, token_batch.batch) != 0) {
+    common_batch_add(token_batch.batch, id, n_past, {guard.get_seq_id()},
+                     true);
+    if (guard.decode(token_batch.batch) != 0) {
       req_ptr->finish_reason = "context_full";
       break;
     }
     n_past++;
     n_decoded++;
   }
-  req_ptr->completion_tokens = n_decoded;
+  flush_overflow(*req_ptr);
+  req_ptr->completion_tokens += n_decoded;
   if (req_ptr->finish_reason.empty()) req_ptr->finish_reason = "length";
 }
 
+void LLMEngine::generate_choices(ModelInstance& instance, ContextGuard& guard,
+                                 const std::vector<llama_token>& prompt_tokens,
+                                 std::shared_ptr<BatchedRequest> req_ptr) {
+  const auto& settings = instance.settings();
+  const auto* vocab = llama_model_get_vocab(instance.model());
+  const auto& params = req_ptr->request->params();
+  const uint32_t n = req_ptr->n_choices;
+  llama_context* ctx = guard.get();
+
+  // Prompt seq 0'da bir kez işlendi; diğer seçenekler KV'sini paylaşır.
+  guard.fork_sequences(n);
+
+  std::vector<std::unique_ptr<LlamaSamplerGuard>> chains;
+  uint32_t seed = time(NULL);
+  for (uint32_t i = 0; i < n; ++i) {
+    chains.push_back(std::make_unique<LlamaSamplerGuard>(
+        llama_sampler_chain_default_params()));
+    add_samplers(chains.back()->sampler, vocab, settings, *req_ptr, seed + i);
+  }
+
+  uint32_t req_max_gen = params.has_max_new_tokens()
+                             ? params.max_new_tokens()
+                             : settings.default_max_tokens;
+  // Seçenek başına: bitiş nedeni (boş = sürüyor), üretilen token ve son
+  // batch'teki logit satırı. İlk adımda hepsi prompt'un son logit'inden
+  // (-1) örnekler.
+  std::vector<std::string> reasons(n);
+  std::vector<uint32_t> decoded(n, 0);
+  std::vector<int32_t> logits_row(n, -1);
+  llama_pos n_past = prompt_tokens.size();
+  LlamaBatchScope step_batch(n, 0, 1);
+  req_ptr->finish_reason.clear();
+
+  // Tüm açık seçenekler her adımda tek token ilerler; aynı pozisyondadırlar
+  // ve tek llama_decode çağrısında işlenirler.
+  auto finish_open = [&reasons](const std::string& reason) {
+    for (auto& r : reasons) {
+      if (r.empty()) r = reason;
+    }
+  };
+  while (true) {
+    if (req_ptr->should_stop_callback && req_ptr->should_stop_callback()) {
+      req_ptr->finish_reason = "cancelled";
+      break;
+    }
+    if (aborting_) {
+      req_ptr->finish_reason = "aborted";
+      break;
+    }
+    if (req_ptr->background && batcher_.load() &&
+        batcher_.load()->try_preempt()) {
+      req_ptr->finish_reason = "preempted";
+      break;
+    }
+
+    step_batch.clear();
+    bool stopped = false;
+    for (uint32_t i = 0; i < n; ++i) {
+      if (!reasons[i].empty()) continue;
+      if (decoded[i] >= req_max_gen) {
+        reasons[i] = "length";
+        continue;
+      }
+      llama_token id =
+          llama_sampler_sample(chains[i]->sampler, ctx, logits_row[i]);
+      if (llama_vocab_is_eog(vocab, id)) {
+        reasons[i] = "stop";
+        continue;
+      }
+
+      char buf[256];
+      int len = llama_token_to_piece(vocab, id, buf, sizeof(buf), 0, true);
+      std::string_view piece(buf, std::max(len, 0));
+      if (req_ptr->on_token_callback) {
+        req_ptr->on_token_callback(std::string(piece));
+      } else if (!emit_token(*req_ptr, id, piece, i)) {
+        stopped = true;
+        break;
+      }
+
+      logits_row[i] = step_batch.batch.n_tokens;
+      common_batch_add(step_batch.batch, id, n_past, {(llama_seq_id)i}, true);
+      decoded[i]++;
+    }
+    if (stopped || step_batch.batch.n_tokens == 0) break;
+
+    if (guard.decode(step_batch.batch) != 0) {
+      finish_open("context_full");
+      break;
+    }
+    n_past++;
+  }
+  // İptal/taşma tüm seçenekleri keser.
+  finish_open(req_ptr->finish_reason);
+
+  guard.drop_forks(n);
+  req_ptr->choice_finish_reasons = std::move(reasons);
+  for (uint32_t count : decoded) req_ptr->completion_tokens += count;
+  if (req_ptr->finish_reason.empty()) {
+    req_ptr->finish_reason = req_ptr->choice_finish_reasons[0];
+  }
+}
+
+bool LLMEngine::rewind_to_prompt(ContextGuard& guard,
+                                 const std::vector<llama_token>& prompt_tokens,
+                                 std::shared_ptr<BatchedRequest> req_ptr) {
+  // Önceki seçeneğin token'ları silinir; son prompt token'ı logit'leri için
+  // yeniden işlenir.
+  llama_pos last = prompt_tokens.size() - 1;
+  guard.clear_kv(last);
+  LlamaBatchScope batch_scope(1, 0, 1);
+  common_batch_add(batch_scope.batch, prompt_tokens[last], last,
+                   {guard.get_seq_id()}, true);
+  if (guard.decode(batch_scope.batch) != 0) {
+    req_ptr->finish_reason = "context_full";
+    return false;
+  }
+  return true;
+}
+
 void LLMEngine::execute_single_request(
-    std::shared_ptr<BatchedRequest> req_ptr) {
+    ModelInstance& instance, std::shared_ptr<BatchedRequest> req_ptr) {
   try {
-    std::string prompt = formatter_->format(req_ptr->request, settings_);
-    auto tokens = tokenize_and_truncate(req_ptr, prompt);
+    const auto& settings = instance.settings();
+    auto& pool = instance.context_pool();
+    std::string prompt =
+        instance.formatter().format(*req_ptr->request, settings);
+    auto tokens = tokenize_and_truncate(instance, req_ptr, prompt);
+    auto fingerprint =
+        pool.prefix_hasher().fingerprint(tokens, req_ptr->tenant_id);
+    if (fingerprint.tokens > 0) {
+      req_ptr->cache_fingerprint = PrefixHasher::format(fingerprint.hash);
+      req_ptr->cache_prefix_tokens = fingerprint.tokens;
+    }
 
-    auto guard = context_pool_->acquire(tokens);
+    // Unified KV modunda kabul, prompt + üretim üst sınırı kadar hücreye göre.
+    const auto& params = req_ptr->request->params();
+    size_t max_gen = params.has_max_new_tokens() ? params.max_new_tokens()
+                                                 : settings.default_max_tokens;
+    auto guard = pool.acquire(tokens, tokens.size() + max_gen);
     auto* ctx = guard.get();
 
     bool lora_active = false;
-    if (req_ptr->request.has_lora_adapter_id()) {
-      lora_active =
-          apply_lora_to_context(ctx, req_ptr->request.lora_adapter_id());
+    if (req_ptr->request->has_lora_adapter_id() && pool.is_unified()) {
+      // Adaptör context genelinde uygulanır; diğer sequence'leri etkilerdi.
+      SUTS_WARN("LORA_SKIPPED_UNIFIED", req_ptr->trace_id, req_ptr->span_id,
+                req_ptr->tenant_id,
+                "⚠️ LoRA '{}' ignored: not supported in unified KV mode.",
+                req_ptr->request->lora_adapter_id());
+    } else if (req_ptr->request->has_lora_adapter_id()) {
+      lora_active = instance.apply_lora_to_context(
+          ctx, req_ptr->request->lora_adapter_id());
     }
 
-    if (decode_prompt(ctx, guard, tokens, req_ptr)) {
-      generate_response(ctx, tokens, req_ptr);
+    if (!decode_prompt(ctx, guard, tokens, req_ptr)) {
+      // Prompt işlenemedi; üretim yok.
+    } else if (req_ptr->n_choices > 1 &&
+               guard.fork_capacity() >= req_ptr->n_choices &&
+               tokens.size() + req_ptr->n_choices * max_gen <=
+                   settings.context_size) {
+      // Çatallar prompt + n x max_gen hücreye sığıyorsa; sığmıyorsa
+      // seçenekler aşağıda sırayla (prompt + max_gen hücrede) üretilir.
+      generate_choices(instance, guard, tokens, req_ptr);
+    } else {
+      // Tek seçenek ya da unified KV (sequence'ler slotlara ait, çatal
+      // açılamaz): seçenekler sırayla, prompt KV'si yeniden kullanılarak
+      // üretilir.
+      for (uint32_t c = 0; c < req_ptr->n_choices; ++c) {
+        if (c > 0 && !rewind_to_prompt(guard, tokens, req_ptr)) break;
+        generate_response(instance, guard, tokens, req_ptr, c);
+        const auto& reason = req_ptr->finish_reason;
+        req_ptr->choice_finish_reasons.push_back(reason);
+        if (reason != "stop" && reason != "length") break;
+      }
     }
 
-    if (lora_active) clear_lora_from_context(ctx);
-    guard.release_early(tokens);
+    if (lora_active) instance.clear_lora_from_context(ctx);
+    guard.release_early(tokens, req_ptr->tenant_id);
 
   } catch (const std::exception& e) {
     spdlog::error("Execution error: {}", e.what());
@@ -3,83 +3,269 @@
 #include <prometheus/gauge.h>
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
 #include <functional>
-#include <list>
 #include <map>
 #include <memory>
-#include <shared_mutex>
+#include <mutex>
+#include <set>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include "config.h"
 #include "core/context_pool.h"
 #include "core/dynamic_batcher.h"
-#include "core/prompt_formatter.h"
+#include "core/instance_reaper.h"
+#include "core/model_instance.h"
 #include "llama.h"
 #include "sentiric/llm/v1/llama.pb.h"
 
+// Replika yaşam döngüsü. downloading/loading/warming yalnızca yayında model
+// yokken (açılış veya soğuk değişim) görünür; sıcak değişim boyunca replika
+// ready kalır. degraded: model hizmet veriyor ama son yükleme başarısız oldu.
+// unavailable: yükleme başarısız oldu ve yayında model yok (hizmet dışı).
+// draining geri dönüşsüzdür.
+enum class EngineState {
+  kDownloading,
+  kLoading,
+  kWarming,
+  kReady,
+  kDegraded,
+  kUnavailable,
+  kDraining
+};
+
+const char* engine_state_name(EngineState state);
+
 class LLMEngine {
  public:
+  // Model yüklemez; sunucular açıldıktan sonra start() çağrılmalıdır.
+  // in_flight_gauge verilirse kuyruktaki + işlenen istek sayısını izler.
   explicit LLMEngine(Settings& settings,
-                     prometheus::Gauge& active_contexts_gauge);
+                     prometheus::Gauge& active_contexts_gauge,
+                     prometheus::Gauge* in_flight_gauge = nullptr);
   ~LLMEngine();
   LLMEngine(const LLMEngine&) = delete;
   LLMEngine& operator=(const LLMEngine&) = delete;
 
+  // Varsayılan modeli ve ek modelleri indirir, yükler, ısıtır ve batcher'ı
+  // başlatır. Başarısızlıkta exception fırlatır.
+  void start();
+
   void process_single_request(std::shared_ptr<BatchedRequest> batched_request);
+
+  // Yeni modeli eskisinin yanında yükler, ısıtır ve atomik olarak yayına
+  // alır; eski örnek devam eden istekler bitince serbest bırakılır. Bellek
+  // yetmezse (veya hot_swap kapalıysa) soğuk değişime düşer.
   bool reload_model(const std::string& profile_name);
 
   bool update_hardware_config(int gpu_layers, int context_size,
-                              bool kv_offload);
+                              bool kv_offload, const std::string& cache_type_k,
+                              const std::string& cache_type_v,
+                              const std::string& flash_attn);
+
+  DynamicBatcher* get_batcher() const { return batcher_.load(); }
+  bool is_batching_enabled() const { return batcher_.load() != nullptr; }
+  bool is_model_loaded() const;
 
-  // LoRA adaptörünü Context seviyesinde uygular
-  bool apply_lora_to_context(llama_context* ctx,
-                             const std::string& lora_adapter_id);
+  // --- LIFECYCLE ---
+  EngineState get_state() const;
+  // Yeni istek kabul ediliyor mu? (ready/degraded ve yayında model var)
+  bool is_accepting() const;
+  // Her durum değişiminde çağrılır (ör. gRPC health servisi).
+  void set_state_listener(std::function<void(EngineState)> listener);
+  // Yeni istekleri reddetmeye başlar; kabul edilmiş olanlar bitirilir.
+  void begin_draining();
+  // Drain süresi aşıldığında: üretimdeki istekler bir sonraki token'da,
+  // kuyruktakiler başlamadan "aborted" ile sonlanır.
+  void abort_in_flight();
+  // Kapanış sinyali (signal handler'dan çağrılabilir). İndirme, yükleme ve
+  // ısınma aşamaları arasında kontrol edilir; açılış modeli yüklemeden
+  // döner, yarım kalan yükleme yayına alınmaz.
+  void request_stop() { stop_requested_ = true; }
+  // Kuyrukta bekleyen + işlenmekte olan istek sayısı.
+  size_t get_in_flight() const;
 
-  // Context üzerindeki tüm adaptörleri temizler
-  void clear_lora_from_context(llama_context* ctx);
+  // Yayındaki model örneği; yükleme sırasında nullptr olabilir. Çağıran
+  // kopyayı tuttuğu sürece örnek (ve havuzu) geçerli kalır.
+  std::shared_ptr<ModelInstance> get_instance() const;
 
-  DynamicBatcher* get_batcher() const { return batcher_.get(); }
-  bool is_batching_enabled() const { return batcher_ != nullptr; }
-  bool is_model_loaded() const;
-  LlamaContextPool& get_context_pool() { return *context_pool_; }
-  const Settings& get_settings() const { return settings_; }
+  // Aktif ayarların kopyası (model değişimiyle eşzamanlı okunabilir).
+  Settings get_settings() const;
+
+  // Ayarlardaki akış tamponu boyutu ve taşma politikasıyla yeni bir istek.
+  std::shared_ptr<BatchedRequest> new_request() const;
+
+  // /v1/embeddings: girdi başına L2-normalize vektör (boş profil =
+  // varsayılan model). prompt_tokens girdilerin toplam token sayısıdır.
+  // Geçersiz girdide std::invalid_argument, model yüklenemezse
+  // std::runtime_error.
+  std::vector<std::vector<float>> embed(const std::string& profile,
+                                        const std::vector<std::string>& inputs,
+                                        int32_t& prompt_tokens);
+
+  // /v1/cache/probe: parmak izinin kapsadığı önekten bu replikada önbellekte
+  // kaç token olduğu (yoksa 0). Parmak izi isteğin kiracısıyla üretildiği
+  // için yalnızca aynı kiracının öneki eşleşir. Model yüklemeyi tetiklemez;
+  // profil bellekte değilse 0 döner.
+  size_t probe_prefix_cache(const std::string& profile,
+                            const std::string& tenant,
+                            uint64_t fingerprint) const;
+
+  // Varsayılan model yüklenirken ağırlık ön okumasının ilerlemesi (0..1);
+  // yükleme yoksa -1.
+  double get_load_progress() const { return load_progress_; }
+
+  // --- MULTI-MODEL ---
+  // kLoading: profil loader thread'inde indiriliyor/yükleniyor; istek
+  // 503 + Retry-After ile reddedilir. kUnavailable: son yükleme kısa süre
+  // önce başarısız oldu.
+  enum class ProfileState { kReady, kLoading, kUnavailable };
+
+  // İsimli profilin örneği. Bellekte değilse yükleme loader thread'ine
+  // verilir (gerekirse bütçe için en uzun süredir boşta olan ek model
+  // bırakılır) ve nullptr döner; worker hiçbir zaman yüklemeyi beklemez.
+  std::shared_ptr<ModelInstance> get_instance_for(
+      const std::string& profile, ProfileState* state = nullptr);
+  // get_instance_for gibi yüklemeyi başlatır, yalnızca durumu döndürür.
+  ProfileState prepare_profile(const std::string& profile);
+  // n seçeneğin üretim üst sınırı (max_tokens <= 0: profil varsayılanı)
+  // profilin context'ine sığıyor mu? Çatallar aynı n_ctx hücresini paylaşır.
+  bool choices_fit(const std::string& profile, uint32_t n,
+                   int64_t max_tokens) const;
+  // Bellekteki örnek (boş profil = varsayılan); yükleme tetiklemez.
+  std::shared_ptr<ModelInstance> find_instance(
+      const std::string& profile) const;
+  // Profil yüklü mü ya da profiles.json'da tanımlı mı?
+  bool has_profile(const std::string& profile) const;
+  // OpenAI 'model' alanı için: model_id'si eşleşen yüklü profil, yoksa "".
+  std::string find_profile_by_model_id(const std::string& model_id) const;
+
+  struct ResidentInfo {
+    std::string profile;
+    std::string model_id;
+    bool is_default;
+    size_t bytes;
+    size_t active_contexts;
+    size_t total_contexts;
+    double idle_seconds;
+  };
+  std::vector<ResidentInfo> get_resident_models() const;
 
  private:
-  void process_batch(std::vector<std::shared_ptr<BatchedRequest>>& batch);
-  void execute_single_request(std::shared_ptr<BatchedRequest> req_ptr);
-  bool internal_reload_model();
+  static constexpr std::chrono::seconds kDrainTimeout{60};
+
+  void process_request(std::shared_ptr<BatchedRequest> req_ptr);
+  void execute_single_request(ModelInstance& instance,
+                              std::shared_ptr<BatchedRequest> req_ptr);
+  bool swap_instance(const Settings& new_settings);
+  void set_state(EngineState state);
+  // Yükleme aşamasını yalnızca yayında model yokken duruma yansıtır.
+  void report_phase(EngineState phase);
+  // Başarısız yükleme: model yayındaysa degraded, değilse unavailable.
+  void report_load_failure();
+  // Soğuk değişim başarısız olunca önceki modeli geri yükler.
+  bool restore_instance(const Settings& previous);
+  // Ek modeli indirir ve yükler (bloklar); açılışta ve loader thread'inde.
+  std::shared_ptr<ModelInstance> load_resident(const std::string& profile);
+  void loader_loop();
+  // Yeni bir model için yer açar; boşta olan ek modelleri LRU sırasıyla
+  // bırakır. Bütçe yine yetmiyorsa false.
+  bool make_room_for(size_t incoming_bytes);
+  // Örneği yayından bırakır; son kullanıcı bitirince reaper thread'inde
+  // silinir. wait: soğuk değişimde belleğin iadesini bekle (kDrainTimeout).
+  void release_instance(std::shared_ptr<ModelInstance> instance,
+                        bool wait = false);
+  void ensure_backend_initialized();
 
   std::vector<llama_token> tokenize_and_truncate(
-      std::shared_ptr<BatchedRequest> req_ptr,
+      ModelInstance& instance, std::shared_ptr<BatchedRequest> req_ptr,
       const std::string& formatted_prompt);
   bool decode_prompt(llama_context* ctx, ContextGuard& guard,
                      const std::vector<llama_token>& prompt_tokens,
                      std::shared_ptr<BatchedRequest> req_ptr);
-  void generate_response(llama_context* ctx,
+  // Token'ı isteğin kanalına taşma politikasına göre yazar. İstek durduysa
+  // finish_reason'ı ayarlar ve false döner.
+  // choice: n > 1 isteklerde token'ın seçeneği.
+  bool emit_token(BatchedRequest& req, llama_token id, std::string_view piece,
+                  uint32_t choice = 0);
+  // Yer açılana kadar bekleyerek yazar (Pause).
+  bool push_blocking(BatchedRequest& req, llama_token id,
+                     std::string_view text, uint32_t choice = 0);
+  // Coalesce birikimini üretim sonunda kanala yazar.
+  void flush_overflow(BatchedRequest& req);
+  void generate_response(ModelInstance& instance, ContextGuard& guard,
                          const std::vector<llama_token>& prompt_tokens,
-                         std::shared_ptr<BatchedRequest> req_ptr);
-
-  // LoRA Adapter Cache Yönetimi (Hardened with capacity limit)
-  struct llama_adapter_lora* get_or_load_adapter(const std::string& lora_id);
-  void clear_adapter_cache();
-  void evict_oldest_lora();
+                         std::shared_ptr<BatchedRequest> req_ptr,
+                         uint32_t choice = 0);
+  // n > 1: seçenekler çatal sequence'lerde, adım başına tek batch'te üretilir.
+  void generate_choices(ModelInstance& instance, ContextGuard& guard,
+                        const std::vector<llama_token>& prompt_tokens,
+                        std::shared_ptr<BatchedRequest> req_ptr);
+  // KV'yi prompt sonuna geri sarar (sıralı seçenekler için).
+  bool rewind_to_prompt(ContextGuard& guard,
+                        const std::vector<llama_token>& prompt_tokens,
+                        std::shared_ptr<BatchedRequest> req_ptr);
 
   Settings settings_;
-  llama_model* model_ = nullptr;
-  std::atomic<bool> model_loaded_{false};
+  mutable std::mutex settings_mutex_;
+
+  // Tüm örnekler reaper üzerinden oluşturulur ve silinir.
+  std::shared_ptr<InstanceReaper> reaper_ = InstanceReaper::create();
+  std::shared_ptr<ModelInstance> instance_;
+  mutable std::mutex instance_mutex_;
+
+  // Varsayılan profil dışında bellekte tutulan modeller (instance_mutex_).
+  struct ResidentModel {
+    std::shared_ptr<ModelInstance> instance;
+    std::chrono::steady_clock::time_point last_used;
+    size_t bytes = 0;
+  };
+  std::map<std::string, ResidentModel> residents_;
+  // Ek model yüklemelerini sıralar (aynı profil iki kez yüklenmesin).
+  std::mutex resident_load_mutex_;
+
+  // Çalışırken istenen ek modeller tek loader thread'inde yüklenir.
+  static constexpr std::chrono::seconds kLoadRetryAfter{30};
+  std::mutex loader_mutex_;
+  std::condition_variable loader_cv_;
+  std::deque<std::string> load_queue_;
+  std::set<std::string> loading_;  // Kuyrukta veya yükleniyor
+  std::map<std::string, std::chrono::steady_clock::time_point> load_failed_;
+  bool loader_stopping_ = false;
+  std::thread loader_;
+  // has_profile için profiles.json'daki isimler. Dosya en fazla
+  // kProfileRecheck'te bir stat edilir; yolu veya mtime'ı değişince ya da
+  // model değişiminde yeniden okunur.
+  bool profile_defined(const Settings& s, const std::string& name) const;
+  void invalidate_profile_cache();
+  static constexpr std::chrono::seconds kProfileRecheck{1};
+  mutable std::mutex profile_cache_mutex_;
+  mutable std::set<std::string> profile_names_;
+  mutable std::filesystem::path profile_file_;
+  mutable std::filesystem::file_time_type profile_mtime_{};
+  mutable std::chrono::steady_clock::time_point profile_checked_{};
+  mutable bool profile_cache_valid_ = false;
+  // Aynı anda tek model değişimi.
+  std::mutex reload_mutex_;
+  std::atomic<double> load_progress_{-1.0};
 
-  // LoRA Cache (ID -> Pointer + LRU Tracker)
-  std::map<std::string, struct llama_adapter_lora*> lora_cache_;
-  std::list<std::string> lora_lru_list_;
-  const size_t MAX_LORA_CACHE_SIZE =
-      8;  // Max 8 unique LoRA at the same time to save VRAM
-  std::mutex lora_mutex_;
+  EngineState state_ = EngineState::kLoading;
+  std::atomic<bool> aborting_{false};
+  std::atomic<bool> stop_requested_{false};
+  std::function<void(EngineState)> state_listener_;
+  mutable std::mutex state_mutex_;
 
-  std::unique_ptr<LlamaContextPool> context_pool_;
-  std::unique_ptr<PromptFormatter> formatter_;
-  std::unique_ptr<DynamicBatcher> batcher_;
+  // start() batcher'ı kurduktan sonra yayınlar; HTTP/gRPC thread'leri
+  // batcher_ üzerinden okur.
+  std::unique_ptr<DynamicBatcher> owned_batcher_;
+  std::atomic<DynamicBatcher*> batcher_{nullptr};
 
   prometheus::Gauge& active_contexts_gauge_;
-  mutable std::shared_mutex model_mutex_;
-};
\ No newline at end of file
+  prometheus::Gauge* in_flight_gauge_;
+};
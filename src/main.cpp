@@ -9,6 +9,8 @@
 #include <spdlog/sinks/stdout_sinks.h>  // Renksiz (JSON uyumlu)
 #include <spdlog/spdlog.h>
 
+#include <atomic>
+#include <chrono>
 #include <csignal>
 #include <fstream>
 #include <future>
@@ -17,7 +19,6 @@
 #include <thread>
 
 #include "config.h"
-#include "core/model_warmup.h"
 #include "grpc_server.h"
 #include "http_server.h"
 #include "llama.h"
@@ -30,6 +31,11 @@
 
 namespace {
 std::promise<void> shutdown_promise;
+// Sinyal geldiğinde süren indirme/yükleme bir sonraki aşamada durur.
+std::atomic<LLMEngine*> signal_engine{nullptr};
+// Drain süresi dolduktan sonra kesilen üretimlerin çıkması için ek süre.
+constexpr std::chrono::seconds kAbortGrace{5};
+constexpr std::chrono::seconds kDrainReportInterval{5};
 }
 
 void llama_log_callback(ggml_log_level level, const char* text,
@@ -65,6 +71,7 @@ void llama_log_callback(ggml_log_level level, const char* text,
 void signal_handler(int signal) {
   SUTS_WARN("SERVICE_SHUTDOWN", "", "", "",
             "🛑 Signal {} received. Initiating graceful shutdown...", signal);
+  if (LLMEngine* engine = signal_engine.load()) engine->request_stop();
   try {
     shutdown_promise.set_value();
   } catch (const std::future_error&) {
@@ -139,39 +146,48 @@ int main() {
           .Help("Current number of active llama_context instances")
           .Register(*registry);
 
+  auto& in_flight_family =
+      prometheus::BuildGauge()
+          .Name("llm_in_flight_requests")
+          .Help("Requests queued or being generated by the batcher")
+          .Register(*registry);
+
+  auto& draining_family = prometheus::BuildGauge()
+                              .Name("llm_draining")
+                              .Help("1 while the replica drains for shutdown")
+                              .Register(*registry);
+
   AppMetrics metrics = {
       requests_total_family.Add({}),
       request_latency_family.Add(
           {}, prometheus::Histogram::BucketBoundaries{0.001, 0.005, 0.01, 0.05,
                                                       0.1, 0.5, 1.0, 5.0}),
-      tokens_generated_total_family.Add({}), active_contexts_family.Add({})};
+      tokens_generated_total_family.Add({}),
+      active_contexts_family.Add({}),
+      in_flight_family.Add({}),
+      draining_family.Add({})};
 
   std::unique_ptr<grpc::Server> grpc_server_ptr;
   std::shared_ptr<HttpServer> http_server;
   std::shared_ptr<MetricsServer> metrics_server;
+  std::shared_ptr<HealthServer> health_server;
   std::thread http_thread;
   std::thread grpc_thread;
   std::thread metrics_thread;
+  std::thread health_thread;
 
   try {
     grpc::EnableDefaultHealthCheckService(true);
 
-    auto engine =
-        std::make_shared<LLMEngine>(settings, metrics.active_contexts);
-
-    if (!engine->is_model_loaded()) {
-      SUTS_ERROR("MODEL_LOAD_FAIL", "", "", "",
-                 "🔥 LLM Engine failed to initialize with a valid model. "
-                 "Shutting down.");
-      return 1;
-    }
-
-    if (settings.enable_warm_up) {
-      SUTS_INFO("MODEL_WARMUP_START", "", "", "",
-                "🌡️ Starting model warm-up...");
-      ModelWarmup::fast_warmup(engine->get_context_pool(), settings.n_threads);
-      SUTS_INFO("MODEL_WARMUP_END", "", "", "", "✅ Model warm-up completed");
-    }
+    // Model sunucular açıldıktan sonra yüklenir; bu sürede /health ve gRPC
+    // health servisi indirme/yükleme/ısınma aşamalarını raporlar.
+    auto engine = std::make_shared<LLMEngine>(
+        settings, metrics.active_contexts, &metrics.in_flight_requests);
+    // engine'den sonra kurulur, ondan önce yıkılır.
+    struct SignalEngineScope {
+      explicit SignalEngineScope(LLMEngine* engine) { signal_engine = engine; }
+      ~SignalEngineScope() { signal_engine = nullptr; }
+    } signal_engine_scope(engine.get());
 
     std::string grpc_address =
         settings.host + ":" + std::to_string(settings.grpc_port);
@@ -224,43 +240,106 @@ int main() {
 
     auto health_service = grpc_server_ptr->GetHealthCheckService();
     if (health_service) {
-      health_service->SetServingStatus("sentiric.llm.v1.LlamaService", true);
-      health_service->SetServingStatus("", true);
+      engine->set_state_listener([health_service](EngineState state) {
+        bool serving =
+            state == EngineState::kReady || state == EngineState::kDegraded;
+        health_service->SetServingStatus("sentiric.llm.v1.LlamaService",
+                                         serving);
+        health_service->SetServingStatus("", serving);
+      });
     }
 
     SUTS_INFO("GRPC_SERVER_READY", "", "", "", "📡 gRPC server listening on {}",
               grpc_address);
 
     http_server = std::make_shared<HttpServer>(
-        engine, settings.host, settings.http_port, settings.http_threads);
+        engine, settings.host, settings.http_port, settings.http_threads,
+        settings.http_max_threads);
     metrics_server = std::make_shared<MetricsServer>(
         settings.host, settings.metrics_port, *registry);
+    health_server = std::make_shared<HealthServer>(engine, settings.host,
+                                                   settings.health_port);
 
     grpc_thread = std::thread(&grpc::Server::Wait, grpc_server_ptr.get());
     http_thread = std::thread(&HttpServer::run, http_server);
     metrics_thread = std::thread(&MetricsServer::run, metrics_server);
+    health_thread = std::thread(&HealthServer::run, health_server);
 
     SUTS_INFO("ALL_SERVERS_READY", "", "", "",
-              "✅ All servers started successfully");
+              "✅ All servers started successfully. Loading model...");
+
+    try {
+      engine->start();
+    } catch (const std::exception& e) {
+      SUTS_ERROR("MODEL_LOAD_FAIL", "", "", "",
+                 "🔥 LLM Engine failed to initialize with a valid model: {}. "
+                 "Shutting down.",
+                 e.what());
+      throw;
+    }
 
     auto shutdown_future = shutdown_promise.get_future();
     shutdown_future.wait();
 
-    if (health_service) health_service->SetServingStatus("", false);
+    // Draining: health NOT_SERVING olur, batcher yeni iş almaz ve yeni
+    // istekler 503 / UNAVAILABLE alır. Kabul edilmiş istekler ve açık SSE
+    // yanıtları bitene kadar sunucular açık kalır.
+    engine->begin_draining();
+    metrics.draining.Set(1);
+    auto busy = [&]() {
+      return engine->get_in_flight() + http_server->get_open_streams();
+    };
+    auto wait_until_idle = [&](std::chrono::steady_clock::time_point until) {
+      auto next_report = std::chrono::steady_clock::now();
+      while (busy() > 0 && std::chrono::steady_clock::now() < until) {
+        if (std::chrono::steady_clock::now() >= next_report) {
+          SUTS_INFO("DRAIN_PROGRESS", "", "", "",
+                    "⏳ Draining: {} request(s), {} open stream(s)",
+                    engine->get_in_flight(), http_server->get_open_streams());
+          next_report += kDrainReportInterval;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+      return busy() == 0;
+    };
+
+    auto drain_start = std::chrono::steady_clock::now();
+    if (wait_until_idle(drain_start +
+                        std::chrono::seconds(settings.drain_timeout_s))) {
+      std::chrono::duration<double> took =
+          std::chrono::steady_clock::now() - drain_start;
+      SUTS_INFO("DRAIN_COMPLETE", "", "", "", "✅ Drain complete in {:.1f}s",
+                took.count());
+    } else {
+      SUTS_WARN("DRAIN_TIMEOUT", "", "", "",
+                "⏳ Drain timeout ({}s) reached; aborting {} request(s).",
+                settings.drain_timeout_s, engine->get_in_flight());
+      engine->abort_in_flight();
+      wait_until_idle(std::chrono::steady_clock::now() + kAbortGrace);
+    }
+    engine->set_state_listener(nullptr);
+
     http_server->stop();
     metrics_server->stop();
+    health_server->stop();
     grpc_server_ptr->Shutdown(std::chrono::system_clock::now() +
                               std::chrono::seconds(5));
 
     if (http_thread.joinable()) http_thread.join();
     if (metrics_thread.joinable()) metrics_thread.join();
+    if (health_thread.joinable()) health_thread.join();
     if (grpc_thread.joinable()) grpc_thread.join();
 
   } catch (const std::exception& e) {
     SUTS_ERROR("SERVICE_CRASH", "", "", "", "🔥 Fatal error: {}", e.what());
     if (http_server) http_server->stop();
     if (metrics_server) metrics_server->stop();
+    if (health_server) health_server->stop();
     if (grpc_server_ptr) grpc_server_ptr->Shutdown();
+    if (http_thread.joinable()) http_thread.join();
+    if (metrics_thread.joinable()) metrics_thread.join();
+    if (health_thread.joinable()) health_thread.join();
+    if (grpc_thread.joinable()) grpc_thread.join();
     return 1;
   }
 
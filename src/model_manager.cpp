@@ -1,17 +1,65 @@
 #include "model_manager.h"
 
 #include <curl/curl.h>
+#include <fcntl.h>
 #include <fmt/core.h>
+#include <openssl/evp.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
 #include <cstdio>
 #include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
+#include "nlohmann/json.hpp"
 #include "spdlog/spdlog.h"
 
 namespace fs = std::filesystem;
+using json = nlohmann::json;
 
 namespace ModelManager {
 
+// Segmentler bundan küçük bölünmez; küçük dosyalarda bağlantı açmak kazanç
+// sağlamaz.
+static constexpr long long kMinSegmentBytes = 8LL * 1024 * 1024;
+// Bu kadar veri yazıldıkça segment durumu diske kaydedilir.
+static constexpr long long kStateFlushBytes = 32LL * 1024 * 1024;
+static constexpr int kSegmentRetries = 3;
+
+static std::string to_lower(std::string value) {
+  std::transform(value.begin(), value.end(), value.begin(),
+                 [](unsigned char c) { return std::tolower(c); });
+  return value;
+}
+
+static std::string trim(const std::string& value) {
+  size_t begin = value.find_first_not_of(" \t\r\n");
+  if (begin == std::string::npos) return "";
+  size_t end = value.find_last_not_of(" \t\r\n");
+  return value.substr(begin, end - begin + 1);
+}
+
+// "\"<64 hex>\"" veya W/"..." biçimindeki ETag'den SHA-256'yı çıkarır.
+// SHA-256 gibi görünmeyen (ör. md5) değerler için boş döner.
+static std::string normalize_sha256(std::string value) {
+  value = trim(value);
+  if (value.rfind("W/", 0) == 0) value = value.substr(2);
+  value.erase(std::remove(value.begin(), value.end(), '"'), value.end());
+  value = to_lower(value);
+  if (value.size() != 64) return "";
+  for (char c : value) {
+    if (!std::isxdigit(static_cast<unsigned char>(c))) return "";
+  }
+  return value;
+}
+
 static size_t write_data(void* ptr, size_t size, size_t nmemb, FILE* stream) {
   size_t written = fwrite(ptr, size, nmemb, stream);
   return written;
@@ -29,88 +77,339 @@ static int progress_callback(void* clientp, curl_off_t dltotal,
   return 0;
 }
 
-long long get_remote_file_size(const std::string& url) {
+static size_t collect_header(char* buffer, size_t size, size_t nitems,
+                             void* userdata) {
+  auto* info = static_cast<RemoteFileInfo*>(userdata);
+  std::string line(buffer, size * nitems);
+  size_t colon = line.find(':');
+  if (colon == std::string::npos) return size * nitems;
+
+  std::string key = to_lower(trim(line.substr(0, colon)));
+  std::string value = trim(line.substr(colon + 1));
+  if (key == "x-linked-etag") {
+    // Hugging Face: LFS dosyasının oid'i (içeriğin SHA-256'sı).
+    std::string hash = normalize_sha256(value);
+    if (!hash.empty()) info->sha256 = hash;
+  } else if (key == "etag" && info->sha256.empty()) {
+    info->sha256 = normalize_sha256(value);
+  } else if (key == "accept-ranges") {
+    info->accepts_ranges = to_lower(value) == "bytes";
+  }
+  return size * nitems;
+}
+
+RemoteFileInfo probe_remote_file(const std::string& url) {
+  RemoteFileInfo info;
   CURL* curl = curl_easy_init();
-  double file_size = -1.0;
-  if (curl) {
+  if (!curl) return info;
+
+  curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+  curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+  curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+  curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+  curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+  curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, collect_header);
+  curl_easy_setopt(curl, CURLOPT_HEADERDATA, &info);
+
+  if (curl_easy_perform(curl) == CURLE_OK) {
+    curl_off_t length = -1;
+    curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+    info.size = static_cast<long long>(length);
+  }
+  curl_easy_cleanup(curl);
+  return info;
+}
+
+long long get_remote_file_size(const std::string& url) {
+  return probe_remote_file(url).size;
+}
+
+std::string sha256_file(const std::string& path) {
+  FILE* fp = fopen(path.c_str(), "rb");
+  if (!fp) throw std::runtime_error("Cannot open file for hashing: " + path);
+
+  std::unique_ptr<EVP_MD_CTX, decltype(&EVP_MD_CTX_free)> ctx(
+      EVP_MD_CTX_new(), EVP_MD_CTX_free);
+  EVP_DigestInit_ex(ctx.get(), EVP_sha256(), nullptr);
+
+  std::vector<unsigned char> buffer(1 << 20);
+  size_t n;
+  while ((n = fread(buffer.data(), 1, buffer.size(), fp)) > 0) {
+    EVP_DigestUpdate(ctx.get(), buffer.data(), n);
+  }
+  bool read_error = ferror(fp);
+  fclose(fp);
+  if (read_error) throw std::runtime_error("Read error while hashing: " + path);
+
+  unsigned char digest[EVP_MAX_MD_SIZE];
+  unsigned int digest_len = 0;
+  EVP_DigestFinal_ex(ctx.get(), digest, &digest_len);
+
+  std::string hex;
+  hex.reserve(digest_len * 2);
+  for (unsigned int i = 0; i < digest_len; ++i) {
+    hex += fmt::format("{:02x}", digest[i]);
+  }
+  return hex;
+}
+
+// --- SEGMENTED DOWNLOAD ---
+
+struct Segment {
+  long long begin = 0;
+  long long end = 0;   // Hariç
+  long long next = 0;  // Sıradaki yazılacak bayt
+};
+
+// <tmp>.parts: süreç yeniden başladığında her segment kaldığı yerden devam
+// eder. 'next' sadece veri dosyaya yazıldıktan sonra ilerletilir.
+struct DownloadState {
+  long long size = 0;
+  std::string sha256;
+  std::vector<Segment> segments;
+
+  void save(const fs::path& path) const {
+    json j = {{"size", size}, {"sha256", sha256}, {"segments", json::array()}};
+    for (const auto& s : segments) {
+      j["segments"].push_back({s.begin, s.end, s.next});
+    }
+    fs::path tmp = path.string() + ".new";
+    {
+      std::ofstream f(tmp, std::ios::trunc);
+      f << j.dump();
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+  }
+
+  bool load(const fs::path& path) {
+    try {
+      std::ifstream f(path);
+      if (!f.is_open()) return false;
+      json j = json::parse(f);
+      size = j.at("size").get<long long>();
+      sha256 = j.at("sha256").get<std::string>();
+      segments.clear();
+      for (const auto& s : j.at("segments")) {
+        Segment seg;
+        seg.begin = s.at(0).get<long long>();
+        seg.end = s.at(1).get<long long>();
+        seg.next = s.at(2).get<long long>();
+        if (seg.next < seg.begin || seg.next > seg.end) return false;
+        segments.push_back(seg);
+      }
+      return !segments.empty();
+    } catch (const std::exception&) {
+      return false;
+    }
+  }
+
+  long long downloaded() const {
+    long long total = 0;
+    for (const auto& s : segments) total += s.next - s.begin;
+    return total;
+  }
+};
+
+struct SegmentWriter {
+  CURL* curl;
+  int fd;
+  Segment* segment;
+  DownloadState* state;
+  const fs::path* state_path;
+  std::mutex* mutex;
+  long long* unflushed;
+  bool checked_status = false;
+};
+
+static size_t write_segment(void* ptr, size_t size, size_t nmemb,
+                            void* userdata) {
+  auto* w = static_cast<SegmentWriter*>(userdata);
+  size_t len = size * nmemb;
+
+  if (!w->checked_status) {
+    // 200 dönen sunucu Range'i yok saymıştır; tüm dosyayı bu segmentin
+    // ofsetine yazmamak için aktarımı kes.
+    long http_code = 0;
+    curl_easy_getinfo(w->curl, CURLINFO_RESPONSE_CODE, &http_code);
+    if (http_code != 206) return 0;
+    w->checked_status = true;
+  }
+
+  long long offset;
+  {
+    std::lock_guard<std::mutex> lock(*w->mutex);
+    offset = w->segment->next;
+    if (offset + static_cast<long long>(len) > w->segment->end) return 0;
+  }
+
+  const char* data = static_cast<const char*>(ptr);
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = pwrite(w->fd, data + done, len - done, offset + done);
+    if (n <= 0) return 0;
+    done += static_cast<size_t>(n);
+  }
+
+  std::lock_guard<std::mutex> lock(*w->mutex);
+  w->segment->next += len;
+  *w->unflushed += len;
+  if (*w->unflushed >= kStateFlushBytes) {
+    w->state->save(*w->state_path);
+    *w->unflushed = 0;
+  }
+  return len;
+}
+
+static bool fetch_segment(const std::string& url, int fd, Segment& segment,
+                          DownloadState& state, const fs::path& state_path,
+                          std::mutex& mutex, long long& unflushed) {
+  for (int attempt = 1; attempt <= kSegmentRetries; ++attempt) {
+    long long from;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (segment.next >= segment.end) return true;
+      from = segment.next;
+    }
+
+    CURL* curl = curl_easy_init();
+    if (!curl) return false;
+
+    SegmentWriter writer{curl, fd, &segment, &state, &state_path, &mutex,
+                         &unflushed};
+    std::string range = fmt::format("{}-{}", from, segment.end - 1);
     curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_segment);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &writer);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
     curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 30L);
 
-    if (curl_easy_perform(curl) == CURLE_OK) {
-      curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD, &file_size);
-    }
+    CURLcode res = curl_easy_perform(curl);
     curl_easy_cleanup(curl);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (segment.next >= segment.end) return true;
+    }
+    spdlog::warn("⚠️ Segment {}-{} interrupted ({}). Retry {}/{}.",
+                 segment.begin, segment.end, curl_easy_strerror(res), attempt,
+                 kSegmentRetries);
+    if (attempt < kSegmentRetries) {
+      std::this_thread::sleep_for(std::chrono::seconds(attempt));
+    }
   }
-  return static_cast<long long>(file_size);
+  return false;
 }
 
-std::string ensure_model_is_ready(const Settings& settings,
-                                  ProgressCallback progress_cb) {
-  if (settings.model_id.empty()) {
-    spdlog::warn(
-        "LLM_LLAMA_SERVICE_MODEL_ID not set. Checking legacy path: '{}'",
-        settings.legacy_model_path);
-    if (!fs::exists(settings.legacy_model_path)) {
-      throw std::runtime_error(
-          fmt::format("Model not found at: {}", settings.legacy_model_path));
+static void download_segmented(const std::string& url, const fs::path& temp,
+                               const fs::path& state_path,
+                               const RemoteFileInfo& remote, int connections,
+                               ProgressCallback progress_cb) {
+  DownloadState state;
+  bool resumed = state.load(state_path) && state.size == remote.size &&
+                 state.sha256 == remote.sha256 && fs::exists(temp) &&
+                 static_cast<long long>(fs::file_size(temp)) == remote.size;
+
+  int fd = -1;
+  if (resumed) {
+    fd = open(temp.c_str(), O_RDWR);
+    spdlog::info("🔄 Resuming segmented download: {:.1f}% already on disk.",
+                 100.0 * state.downloaded() / state.size);
+  } else {
+    state = DownloadState{};
+    state.size = remote.size;
+    state.sha256 = remote.sha256;
+    long long max_segments =
+        std::max(1LL, (remote.size + kMinSegmentBytes - 1) / kMinSegmentBytes);
+    long long n = std::min<long long>(connections, max_segments);
+    long long chunk = (remote.size + n - 1) / n;
+    for (long long begin = 0; begin < remote.size; begin += chunk) {
+      Segment seg;
+      seg.begin = begin;
+      seg.end = std::min(remote.size, begin + chunk);
+      seg.next = begin;
+      state.segments.push_back(seg);
     }
-    return settings.legacy_model_path;
-  }
 
-  fs::path target_dir(settings.model_dir);
-  if (!fs::exists(target_dir)) {
-    fs::create_directories(target_dir);
+    // Seyrek dosya: segmentler kendi ofsetlerine doğrudan yazar.
+    fd = open(temp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0 && ftruncate(fd, remote.size) != 0) {
+      close(fd);
+      fd = -1;
+    }
+    state.save(state_path);
   }
+  if (fd < 0) throw std::runtime_error("Failed to open temp file for writing.");
 
-  fs::path target_filepath = target_dir / settings.model_filename;
-  fs::path temp_filepath = target_filepath.string() + ".tmp";
+  spdlog::info("⬇️ Downloading {} MB over {} connection(s).",
+               remote.size / (1024 * 1024), state.segments.size());
 
-  // [DEĞİŞİKLİK] URL şablonu kullanılıyor.
-  std::string url = settings.model_url_template;
+  std::mutex mutex;
+  long long unflushed = 0;
+  std::atomic<size_t> finished{0};
+  std::vector<char> ok(state.segments.size(), 0);
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < state.segments.size(); ++i) {
+    workers.emplace_back([&, i]() {
+      ok[i] = fetch_segment(url, fd, state.segments[i], state, state_path,
+                            mutex, unflushed);
+      finished++;
+    });
+  }
 
-  // Basit string replace (fmt kütüphanesi named argument desteği C++17'de
-  // sınırlı olabilir, manual replace daha güvenli)
-  auto replace_all = [](std::string& str, const std::string& from,
-                        const std::string& to) {
-    size_t start_pos = 0;
-    while ((start_pos = str.find(from, start_pos)) != std::string::npos) {
-      str.replace(start_pos, from.length(), to);
-      start_pos += to.length();
+  // İlerleme ana thread'den bildirilir; callback thread-safe olmak zorunda
+  // değil.
+  auto started = std::chrono::steady_clock::now();
+  auto last_log = started;
+  while (finished < workers.size()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    long long done;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      done = state.downloaded();
     }
-  };
+    if (progress_cb) progress_cb((double)state.size, (double)done);
 
-  replace_all(url, "{model_id}", settings.model_id);
-  replace_all(url, "{filename}", settings.model_filename);
-
-  if (fs::exists(target_filepath)) {
-    if (fs::file_size(target_filepath) > 1024 * 1024) {
-      spdlog::info("✅ Model '{}' exists and is valid. Skipping download.",
-                   settings.model_filename);
-      return target_filepath.string();
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_log >= std::chrono::seconds(5)) {
+      std::chrono::duration<double> elapsed = now - started;
+      spdlog::info("⬇️ {:.1f}% ({} / {} MB, {:.1f} MB/s)",
+                   100.0 * done / state.size, done / (1024 * 1024),
+                   state.size / (1024 * 1024),
+                   done / (1024.0 * 1024.0) / elapsed.count());
+      last_log = now;
     }
-    spdlog::warn("⚠️ Existing model file is corrupt/small. Redownloading.");
-    fs::remove(target_filepath);
   }
+  for (auto& t : workers) t.join();
 
-  spdlog::info("⬇️ Starting secure native download for '{}'",
-               settings.model_filename);
-  spdlog::info("🔗 URL: {}", url);
+  state.save(state_path);
+  bool synced = fsync(fd) == 0;
+  close(fd);
+
+  bool all_ok = synced && std::all_of(ok.begin(), ok.end(),
+                                      [](char v) { return v != 0; });
+  if (!all_ok) {
+    throw std::runtime_error(fmt::format(
+        "Download incomplete ({:.1f}%). It will resume on the next attempt.",
+        100.0 * state.downloaded() / state.size));
+  }
+}
 
+// Range desteklemeyen sunucular için tek akışlı indirme (devam ettirilemez).
+static void download_stream(const std::string& url, const fs::path& temp,
+                            ProgressCallback progress_cb) {
   CURL* curl = curl_easy_init();
   if (!curl) {
     throw std::runtime_error("Failed to initialize libcurl.");
   }
 
-  long long resume_byte_pos = 0;
-  if (fs::exists(temp_filepath)) {
-    resume_byte_pos = fs::file_size(temp_filepath);
-    spdlog::info("🔄 Resuming download from byte {}", resume_byte_pos);
-  }
-
-  FILE* fp =
-      fopen(temp_filepath.string().c_str(), resume_byte_pos > 0 ? "ab" : "wb");
+  FILE* fp = fopen(temp.string().c_str(), "wb");
   if (!fp) {
     curl_easy_cleanup(curl);
     throw std::runtime_error("Failed to open temp file for writing.");
@@ -126,11 +425,6 @@ std::string ensure_model_is_ready(const Settings& settings,
   curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 60L);
   curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 30L);
 
-  if (resume_byte_pos > 0) {
-    curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE,
-                     (curl_off_t)resume_byte_pos);
-  }
-
   if (progress_cb) {
     curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress_callback);
     curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &progress_cb);
@@ -144,27 +438,196 @@ std::string ensure_model_is_ready(const Settings& settings,
   fclose(fp);
   curl_easy_cleanup(curl);
 
-  if (res == CURLE_OK) {
-    if (http_code >= 200 && http_code < 300) {
-      spdlog::info("✅ Download completed successfully.");
-      fs::rename(temp_filepath, target_filepath);
-      return target_filepath.string();
-    } else {
-      spdlog::error("❌ HTTP Error: {}", http_code);
-      throw std::runtime_error(
-          fmt::format("Download failed with HTTP {}", http_code));
+  if (res != CURLE_OK) {
+    spdlog::error("❌ Curl Error: {}", curl_easy_strerror(res));
+    throw std::runtime_error(
+        fmt::format("Download failed: {}", curl_easy_strerror(res)));
+  }
+  if (http_code < 200 || http_code >= 300) {
+    spdlog::error("❌ HTTP Error: {}", http_code);
+    throw std::runtime_error(
+        fmt::format("Download failed with HTTP {}", http_code));
+  }
+}
+
+// <model>.verified: indirme (ve varsa hash) doğrulaması tamamlandı; her
+// açılışta GB'larca veriyi yeniden hash'lememek için.
+static fs::path marker_path(const fs::path& target) {
+  return target.string() + ".verified";
+}
+
+static void write_marker(const fs::path& target, const std::string& sha256) {
+  std::ofstream f(marker_path(target), std::ios::trunc);
+  f << json({{"size", fs::file_size(target)}, {"sha256", sha256}}).dump();
+}
+
+static bool has_valid_marker(const fs::path& target,
+                             const std::string& expected_sha256) {
+  try {
+    std::ifstream f(marker_path(target));
+    if (!f.is_open()) return false;
+    json j = json::parse(f);
+    if (j.at("size").get<uintmax_t>() != fs::file_size(target)) return false;
+    return expected_sha256.empty() ||
+           j.at("sha256").get<std::string>() == expected_sha256;
+  } catch (const std::exception&) {
+    return false;
+  }
+}
+
+static bool has_gguf_magic(const fs::path& path) {
+  std::ifstream f(path, std::ios::binary);
+  char magic[4] = {};
+  f.read(magic, sizeof(magic));
+  return f.gcount() == 4 && std::string(magic, 4) == "GGUF";
+}
+
+void download_file(const std::string& url, const std::string& target_path,
+                   const DownloadOptions& options,
+                   ProgressCallback progress_cb) {
+  fs::path target(target_path);
+  fs::path temp = target_path + ".tmp";
+  fs::path state_path = target_path + ".tmp.parts";
+
+  RemoteFileInfo remote = probe_remote_file(url);
+  std::string expected = options.expected_sha256.empty()
+                             ? remote.sha256
+                             : normalize_sha256(options.expected_sha256);
+  if (!options.expected_sha256.empty() && expected.empty()) {
+    throw std::runtime_error("Invalid expected SHA-256: " +
+                             options.expected_sha256);
+  }
+
+  if (remote.size > 0 && remote.accepts_ranges) {
+    download_segmented(url, temp, state_path, remote,
+                       std::max(1, options.connections), progress_cb);
+  } else {
+    spdlog::warn(
+        "⚠️ Server does not advertise ranged downloads. Using a single "
+        "stream (no resume).");
+    std::error_code ec;
+    fs::remove(state_path, ec);
+    download_stream(url, temp, progress_cb);
+  }
+
+  auto discard = [&]() {
+    std::error_code ec;
+    fs::remove(temp, ec);
+    fs::remove(state_path, ec);
+  };
+
+  long long actual_size = static_cast<long long>(fs::file_size(temp));
+  if (remote.size > 0 && actual_size != remote.size) {
+    discard();
+    throw std::runtime_error(fmt::format(
+        "Size mismatch: expected {} bytes, got {}.", remote.size, actual_size));
+  }
+
+  if (!expected.empty()) {
+    spdlog::info("🔐 Verifying SHA-256...");
+    std::string actual = sha256_file(temp.string());
+    if (actual != expected) {
+      discard();
+      throw std::runtime_error(fmt::format(
+          "SHA-256 mismatch: expected {}, got {}.", expected, actual));
     }
+    spdlog::info("✅ SHA-256 verified: {}", actual);
   } else {
-    spdlog::error("❌ Curl Error: {}", curl_easy_strerror(res));
-    if (res == CURLE_RANGE_ERROR) {
+    spdlog::warn("⚠️ No checksum published for this file; size verified only.");
+  }
+
+  std::error_code ec;
+  fs::remove(state_path, ec);
+  fs::rename(temp, target);
+  write_marker(target, expected);
+}
+
+std::string ensure_model_is_ready(const Settings& settings,
+                                  ProgressCallback progress_cb) {
+  if (settings.model_id.empty()) {
+    spdlog::warn(
+        "LLM_LLAMA_SERVICE_MODEL_ID not set. Checking legacy path: '{}'",
+        settings.legacy_model_path);
+    if (!fs::exists(settings.legacy_model_path)) {
+      throw std::runtime_error(
+          fmt::format("Model not found at: {}", settings.legacy_model_path));
+    }
+    return settings.legacy_model_path;
+  }
+
+  fs::path target_dir(settings.model_dir);
+  if (!fs::exists(target_dir)) {
+    fs::create_directories(target_dir);
+  }
+
+  fs::path target_filepath = target_dir / settings.model_filename;
+
+  // [DEĞİŞİKLİK] URL şablonu kullanılıyor.
+  std::string url = settings.model_url_template;
+
+  // Basit string replace (fmt kütüphanesi named argument desteği C++17'de
+  // sınırlı olabilir, manual replace daha güvenli)
+  auto replace_all = [](std::string& str, const std::string& from,
+                        const std::string& to) {
+    size_t start_pos = 0;
+    while ((start_pos = str.find(from, start_pos)) != std::string::npos) {
+      str.replace(start_pos, from.length(), to);
+      start_pos += to.length();
+    }
+  };
+
+  replace_all(url, "{model_id}", settings.model_id);
+  replace_all(url, "{filename}", settings.model_filename);
+
+  std::string pinned = normalize_sha256(settings.model_sha256);
+  if (!settings.model_sha256.empty() && pinned.empty()) {
+    // Hatalı sabitlenmiş hash sessizce ETag'e düşmemeli.
+    spdlog::error("❌ Invalid model_sha256 for '{}': expected 64 hex digits.",
+                  settings.model_filename);
+    throw std::runtime_error("Invalid model_sha256: " + settings.model_sha256);
+  }
+  if (fs::exists(target_filepath)) {
+    if (has_valid_marker(target_filepath, pinned)) {
+      spdlog::info("✅ Model '{}' exists and is verified. Skipping download.",
+                   settings.model_filename);
+      return target_filepath.string();
+    }
+
+    // Önceki sürümlerin indirdiği (işaretsiz) dosya: hash biliniyorsa doğrula.
+    std::string expected = pinned.empty() ? probe_remote_file(url).sha256
+                                          : pinned;
+    if (!expected.empty()) {
+      spdlog::info("🔐 Verifying existing model '{}'...",
+                   settings.model_filename);
+      if (sha256_file(target_filepath.string()) == expected) {
+        write_marker(target_filepath, expected);
+        return target_filepath.string();
+      }
+      spdlog::warn(
+          "⚠️ Existing model file fails SHA-256 check. Redownloading.");
+    } else if (has_gguf_magic(target_filepath)) {
       spdlog::warn(
-          "⚠️ Range error detected. Assuming file is already complete.");
-      fs::rename(temp_filepath, target_filepath);
+          "⚠️ Model '{}' could not be verified (no checksum available). "
+          "Using it as is.",
+          settings.model_filename);
       return target_filepath.string();
+    } else {
+      spdlog::warn("⚠️ Existing model file is corrupt. Redownloading.");
     }
-    throw std::runtime_error(
-        fmt::format("Download failed: {}", curl_easy_strerror(res)));
+    fs::remove(target_filepath);
   }
+
+  spdlog::info("⬇️ Starting secure native download for '{}'",
+               settings.model_filename);
+  spdlog::info("🔗 URL: {}", url);
+
+  DownloadOptions options;
+  options.connections = settings.download_connections;
+  options.expected_sha256 = pinned;
+  download_file(url, target_filepath.string(), options, progress_cb);
+
+  spdlog::info("✅ Download completed successfully.");
+  return target_filepath.string();
 }
 
-}  // namespace ModelManager
\ No newline at end of file
+}  // namespace ModelManager
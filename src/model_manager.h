@@ -12,11 +12,37 @@ using ProgressCallback = std::function<void(double total, double now)>;
 
 // Verilen ayarlara göre modelin hazır olduğundan emin olur.
 // Native libcurl kullanarak güvenli indirme yapar.
-// Resume (kaldığı yerden devam) ve Timeout özelliklerine sahiptir.
+// Paralel segmentli indirme, segment bazında resume ve SHA-256 doğrulaması
+// (profil 'sha256' alanı veya Hugging Face X-Linked-Etag) içerir.
 std::string ensure_model_is_ready(const Settings& settings,
                                   ProgressCallback progress_cb = nullptr);
 
+struct DownloadOptions {
+  int connections = 4;
+  // Boşsa sunucunun bildirdiği hash (X-Linked-Etag / ETag) kullanılır;
+  // o da yoksa sadece boyut kontrol edilir.
+  std::string expected_sha256;
+};
+
+// URL'yi target_path'e indirir. Yarım kalan indirme aynı yoldan devam eder.
+// Hash veya boyut tutmazsa dosya silinir ve exception fırlatılır.
+void download_file(const std::string& url, const std::string& target_path,
+                   const DownloadOptions& options,
+                   ProgressCallback progress_cb = nullptr);
+
+struct RemoteFileInfo {
+  long long size = -1;
+  bool accepts_ranges = false;
+  std::string sha256;  // LFS oid (küçük harf hex), bilinmiyorsa boş
+};
+
+// HEAD isteği ile boyut, Range desteği ve içerik hash'ini öğrenir.
+RemoteFileInfo probe_remote_file(const std::string& url);
+
 // Yardımcı: URL'den dosya boyutunu öğrenme (HEAD request)
 long long get_remote_file_size(const std::string& url);
 
-}  // namespace ModelManager
\ No newline at end of file
+// Dosyanın SHA-256 özetini küçük harf hex olarak döndürür.
+std::string sha256_file(const std::string& path);
+
+}  // namespace ModelManager
@@ -38,7 +38,7 @@ export async function checkHealthAPI() {
         const res = await fetch('/health', { headers: getHeaders() });
         if (!res.ok) return { healthy: false };
         const data = await res.json();
-        return { healthy: data.status === 'healthy' };
+        return { healthy: data.status === 'ready' || data.status === 'degraded' };
     } catch {
         return { healthy: false };
     }
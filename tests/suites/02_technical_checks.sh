@@ -57,4 +57,181 @@ if [ -n "$RES" ]; then
     log_pass "LoRA adaptörlü istek başarıyla yanıtlandı (Cevap alındı)."
 else
     log_fail "LoRA adaptörlü istek başarısız oldu veya boş yanıt döndü."
-fi
\ No newline at end of file
+fi
+# --- TEST 4: Multi-Model Routing (Bilinmeyen Profil) ---
+log_info "Test: Tanımsız profil isteği 404 ile reddedilmeli"
+STATUS=$(curl -s -o /dev/null -w "%{http_code}" -X POST "$API_URL/v1/chat/completions" \
+    -H "Content-Type: application/json" \
+    -H "x-tenant-id: test-tenant" \
+    -d '{"profile": "no_such_profile", "messages": [{"role": "user", "content": "Selam"}], "max_tokens": 5}')
+if [ "$STATUS" == "404" ]; then
+    log_pass "Bilinmeyen profil reddedildi (HTTP $STATUS)."
+else
+    log_fail "Bilinmeyen profil için 404 bekleniyordu, gelen: $STATUS"
+fi
+
+MODELS=$(curl -s "$API_URL/health" | jq -r '.models | length')
+if [ "$MODELS" -ge 1 ] 2>/dev/null; then
+    log_pass "/health yüklü modelleri listeliyor ($MODELS)."
+else
+    log_fail "/health 'models' alanı eksik."
+fi
+
+# --- TEST 5: Cümle Modunda Akış (TTS) ---
+log_info "Test: stream_options.chunking=sentence ile cümle başına SSE çerçevesi"
+FRAMES=$(curl -s -N -X POST "$API_URL/v1/chat/completions" \
+    -H "Content-Type: application/json" \
+    -H "x-tenant-id: test-tenant" \
+    -d '{"messages": [{"role": "user", "content": "İstanbul hakkında üç kısa cümle yaz."}], "stream": true, "stream_options": {"chunking": "sentence"}, "max_tokens": 120}' \
+    | grep '^data: {' | sed 's/^data: //')
+FINALS=$(echo "$FRAMES" | jq -r '.final' | grep -c true)
+LAST_FINAL=$(echo "$FRAMES" | tail -n 1 | jq -r '.final')
+echo "$FRAMES" | jq -r '.choices[0].delta.content' | sed 's/^/   ▸ /'
+if [ "$FINALS" == "1" ] && [ "$LAST_FINAL" == "true" ]; then
+    log_pass "Cümle modu: $(echo "$FRAMES" | wc -l) çerçeve, yalnızca sonuncusu final."
+else
+    log_fail "Cümle modunda final bayrağı hatalı (final sayısı: $FINALS)."
+fi
+
+# --- TEST 6: Çoklu Seçenek (n) ---
+log_info "Test: n=2 ile iki seçenek, seçenek başına finish_reason"
+RES=$(curl -s -X POST "$API_URL/v1/chat/completions" \
+    -H "Content-Type: application/json" \
+    -H "x-tenant-id: test-tenant" \
+    -d '{"messages": [{"role": "user", "content": "Bana bir renk söyle."}], "n": 2, "max_tokens": 20}')
+# n > 1 isteğe bağlıdır (LLM_LLAMA_SERVICE_MAX_CHOICES, varsayılan 1).
+if echo "$RES" | jq -e '.error.message == "n must be between 1 and 1"' > /dev/null; then
+    log_pass "MAX_CHOICES=1: n=2 reddedildi (çoklu seçenek kapalı)."
+    RES=$(curl -s -X POST "$API_URL/v1/chat/completions" \
+        -H "Content-Type: application/json" \
+        -H "x-tenant-id: test-tenant" \
+        -d '{"messages": [{"role": "user", "content": "Bana bir renk söyle."}], "n": 1, "max_tokens": 20}')
+    if [ "$(echo "$RES" | jq -r '.choices | length')" == "1" ]; then
+        log_pass "n=1 tek seçenek döndü."
+    else
+        log_fail "n=1 yanıtı hatalı: $RES"
+    fi
+else
+    CHOICES=$(echo "$RES" | jq -r '.choices | length')
+    INDEXES=$(echo "$RES" | jq -r '[.choices[].index] | join(",")')
+    REASONS=$(echo "$RES" | jq -r '[.choices[].finish_reason | select(. == "stop" or . == "length")] | length')
+    if [ "$CHOICES" == "2" ] && [ "$INDEXES" == "0,1" ] && [ "$REASONS" == "2" ]; then
+        log_pass "n=2: iki seçenek döndü ($(echo "$RES" | jq -c '[.choices[].finish_reason]'))."
+    else
+        log_fail "n=2 yanıtı hatalı: $RES"
+    fi
+
+    STATUS=$(curl -s -o /dev/null -w "%{http_code}" -X POST "$API_URL/v1/chat/completions" \
+        -H "Content-Type: application/json" \
+        -H "x-tenant-id: test-tenant" \
+        -d '{"messages": [{"role": "user", "content": "Selam"}], "n": 2, "max_tokens": 1000000}')
+    if [ "$STATUS" == "400" ]; then
+        log_pass "Context'e sığmayan n x max_tokens reddedildi (HTTP $STATUS)."
+    else
+        log_fail "n x max_tokens için 400 bekleniyordu, gelen: $STATUS"
+    fi
+fi
+
+STATUS=$(curl -s -o /dev/null -w "%{http_code}" -X POST "$API_URL/v1/chat/completions" \
+    -H "Content-Type: application/json" \
+    -H "x-tenant-id: test-tenant" \
+    -d '{"messages": [{"role": "user", "content": "Selam"}], "n": 1000, "max_tokens": 5}')
+if [ "$STATUS" == "400" ]; then
+    log_pass "Sınırı aşan n reddedildi (HTTP $STATUS)."
+else
+    log_fail "Sınırı aşan n için 400 bekleniyordu, gelen: $STATUS"
+fi
+
+# --- TEST 7: Batch İşi (/v1/batches) ---
+log_info "Test: JSONL batch işi kuyruğa alınıp tamamlanmalı"
+BATCH_ID=$(printf '%s\n' \
+    '{"custom_id": "a", "body": {"messages": [{"role": "system", "content": "Kısa yanıt ver."}, {"role": "user", "content": "Merhaba"}], "max_tokens": 10}}' \
+    '{"custom_id": "b", "body": {"messages": [{"role": "system", "content": "Kısa yanıt ver."}, {"role": "user", "content": "Nasılsın?"}], "max_tokens": 10}}' \
+    | curl -s -X POST "$API_URL/v1/batches" \
+        -H "Content-Type: application/jsonl" \
+        -H "x-tenant-id: test-tenant" \
+        --data-binary @- | jq -r '.id')
+STATUS=""
+for _ in $(seq 1 60); do
+    STATUS=$(curl -s "$API_URL/v1/batches/$BATCH_ID" -H "x-tenant-id: test-tenant" | jq -r '.status')
+    [ "$STATUS" == "completed" ] && break
+    sleep 1
+done
+RESULTS=$(curl -s "$API_URL/v1/batches/$BATCH_ID/results" -H "x-tenant-id: test-tenant")
+OK=$(echo "$RESULTS" | jq -s '[.[] | select(.response.status_code == 200)] | length')
+if [ "$STATUS" == "completed" ] && [ "$OK" == "2" ]; then
+    log_pass "Batch $BATCH_ID tamamlandı: $(echo "$RESULTS" | jq -r '.custom_id' | tr '\n' ' ')"
+else
+    log_fail "Batch tamamlanmadı (durum: $STATUS, başarılı: $OK)."
+fi
+
+OTHER=$(curl -s -o /dev/null -w "%{http_code}" "$API_URL/v1/batches/$BATCH_ID" -H "x-tenant-id: other-tenant")
+if [ "$OTHER" == "404" ]; then
+    log_pass "Başka kiracı batch'i göremiyor (HTTP $OTHER)."
+else
+    log_fail "Başka kiracı için 404 bekleniyordu, gelen: $OTHER"
+fi
+
+# --- TEST 8: Embeddings ---
+log_info "Test: /v1/embeddings çoklu girdi ve normalize vektör"
+RES=$(curl -s -X POST "$API_URL/v1/embeddings" \
+    -H "Content-Type: application/json" \
+    -H "x-tenant-id: test-tenant" \
+    -d '{"input": ["Merhaba dünya", "Randevu almak istiyorum"]}')
+COUNT=$(echo "$RES" | jq -r '.data | length')
+NORM=$(echo "$RES" | jq -r '[.data[0].embedding[] | . * .] | add | sqrt * 1000 | round')
+if [ "$COUNT" == "2" ] && [ "$NORM" == "1000" ]; then
+    log_pass "İki vektör döndü (boyut: $(echo "$RES" | jq -r '.data[0].embedding | length'), norm 1)."
+else
+    log_fail "Embeddings yanıtı hatalı (adet: $COUNT, norm*1000: $NORM)."
+fi
+
+B64=$(curl -s -X POST "$API_URL/v1/embeddings" \
+    -H "Content-Type: application/json" \
+    -H "x-tenant-id: test-tenant" \
+    -d '{"input": "Merhaba dünya", "encoding_format": "base64"}' | jq -r '.data[0].embedding | type')
+if [ "$B64" == "string" ]; then
+    log_pass "encoding_format=base64 metin olarak döndü."
+else
+    log_fail "base64 kodlama beklenirken gelen tip: $B64"
+fi
+
+# --- TEST 9: Önek Parmak İzi ve Önbellek Sorgusu ---
+log_info "Test: Yanıttaki cache.fingerprint bu replikada sorgulanabilmeli"
+LONG_SYSTEM=$(printf 'Sen bir çağrı merkezi asistanısın ve kısa yanıt verirsin. %.0s' $(seq 1 20))
+RES=$(curl -s -X POST "$API_URL/v1/chat/completions" \
+    -H "Content-Type: application/json" \
+    -H "x-tenant-id: test-tenant" \
+    -d "$(jq -n --arg s "$LONG_SYSTEM" '{messages: [{role: "system", content: $s}, {role: "user", content: "Merhaba"}], max_tokens: 4}')")
+FP=$(echo "$RES" | jq -r '.cache.fingerprint // empty')
+PREFIX=$(curl -s "$API_URL/v1/cache/probe?fingerprint=$FP" -H "x-tenant-id: test-tenant" | jq -r '.prefix_tokens')
+if [ -n "$FP" ] && [ "$PREFIX" -gt 0 ] 2>/dev/null; then
+    log_pass "Parmak izi $FP için önbellekte $PREFIX token önek var."
+else
+    log_fail "Önek sorgusu başarısız (parmak izi: '$FP', token: $PREFIX)."
+fi
+
+# Ayrı health dinleyicisi aynı sorguyu ve /health'i sunar.
+HEALTH_URL="http://localhost:16073"
+SIDE=$(curl -s "$HEALTH_URL/v1/cache/probe?fingerprint=$FP" -H "x-tenant-id: test-tenant" | jq -r '.prefix_tokens')
+SIDE_STATUS=$(curl -s "$HEALTH_URL/health" | jq -r '.status')
+if [ "$SIDE" == "$PREFIX" ] && [ -n "$SIDE_STATUS" ] && [ "$SIDE_STATUS" != "null" ]; then
+    log_pass "Health portu ($SIDE_STATUS) aynı önek sonucunu döndürdü."
+else
+    log_fail "Health portu yanıtı beklenenden farklı (önek: $SIDE, durum: $SIDE_STATUS)"
+fi
+
+OTHER=$(curl -s "$API_URL/v1/cache/probe?fingerprint=$FP" -H "x-tenant-id: other-tenant" | jq -r '.prefix_tokens')
+if [ "$OTHER" == "0" ]; then
+    log_pass "Başka kiracı aynı parmak iziyle önbelleği göremiyor."
+else
+    log_fail "Başka kiracı için 0 bekleniyordu, gelen: $OTHER"
+fi
+
+BAD=$(curl -s -o /dev/null -w "%{http_code}" "$API_URL/v1/cache/probe?fingerprint=xyz" -H "x-tenant-id: test-tenant")
+NO_TENANT=$(curl -s -o /dev/null -w "%{http_code}" "$API_URL/v1/cache/probe?fingerprint=$FP")
+if [ "$BAD" == "400" ] && [ "$NO_TENANT" == "400" ]; then
+    log_pass "Geçersiz parmak izi ve kiracısız sorgu 400 ile reddedildi."
+else
+    log_fail "400 bekleniyordu (geçersiz: $BAD, kiracısız: $NO_TENANT)"
+fi
@@ -21,4 +21,12 @@ if echo "$OUTPUT" | grep -q "Token/Saniye"; then
     log_pass "Stress testi tamamlandı. TPS: $TPS"
 else
     log_fail "Stress testi çöktü veya rapor alınamadı."
-fi
\ No newline at end of file
+fi
+# Yük altında büyüyen havuz dahil her context serbest bırakılmış olmalı.
+METRICS_URL="http://localhost:16072/metrics"
+ACTIVE=$(curl -s "$METRICS_URL" | awk '/^llm_active_contexts/ {s += $2} END {print s + 0}')
+if [ "$ACTIVE" == "0" ]; then
+    log_pass "Yük sonrası llm_active_contexts sıfıra döndü."
+else
+    log_fail "Yük sonrası llm_active_contexts 0 bekleniyordu, gelen: $ACTIVE"
+fi
@@ -0,0 +1,92 @@
+#!/bin/bash
+source tests/lib/common.sh
+
+log_header "SENARYO: Paralel ve Doğrulanmış Model İndirme"
+
+# Servise ihtiyaç yok: llm_cli'nin indirme katmanı, Range destekleyen ve
+# Hugging Face gibi X-Linked-Etag (SHA-256) bildiren sahte bir sunucuya karşı
+# çalıştırılır.
+LLM_CLI=${LLM_CLI:-./build/llm_cli}
+WORK_DIR=$(mktemp -d)
+PORT=${FAKE_HF_PORT:-18990}
+trap 'kill $SERVER_PID 2>/dev/null; rm -rf "$WORK_DIR"' EXIT
+
+cat > "$WORK_DIR/fake_hf.py" <<'PY'
+import hashlib, http.server, re, sys
+path, port, mode = sys.argv[1], int(sys.argv[2]), sys.argv[3]
+data = open(path, "rb").read()
+digest = "0" * 64 if mode == "bad-etag" else hashlib.sha256(data).hexdigest()
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    def log_message(self, *args): pass
+    def common_headers(self, length):
+        self.send_header("Content-Length", str(length))
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("X-Linked-Etag", '"%s"' % digest)
+    def do_HEAD(self):
+        self.send_response(200); self.common_headers(len(data)); self.end_headers()
+    def do_GET(self):
+        m = re.match(r"bytes=(\d+)-(\d*)", self.headers.get("Range", ""))
+        if not m:
+            self.send_response(200); self.common_headers(len(data)); self.end_headers()
+            self.wfile.write(data); return
+        a = int(m.group(1)); b = int(m.group(2)) if m.group(2) else len(data) - 1
+        chunk = data[a:b + 1]
+        self.send_response(206); self.common_headers(len(chunk))
+        self.send_header("Content-Range", "bytes %d-%d/%d" % (a, b, len(data)))
+        self.end_headers()
+        if mode == "truncate":  # Her segmentin yarısını gönderip bağlantıyı kopar
+            self.wfile.write(chunk[:len(chunk) // 2]); self.wfile.flush()
+            self.connection.shutdown(2); return
+        self.wfile.write(chunk)
+
+http.server.ThreadingHTTPServer(("127.0.0.1", port), Handler).serve_forever()
+PY
+
+start_server() {
+    kill $SERVER_PID 2>/dev/null; wait $SERVER_PID 2>/dev/null
+    python3 "$WORK_DIR/fake_hf.py" "$WORK_DIR/source.gguf" "$PORT" "$1" &
+    SERVER_PID=$!
+    sleep 1
+}
+
+head -c 40000000 /dev/urandom > "$WORK_DIR/source.gguf"
+EXPECTED=$(sha256sum "$WORK_DIR/source.gguf" | cut -d' ' -f1)
+URL="http://127.0.0.1:$PORT/model.gguf"
+
+# --- TEST 1: Paralel indirme + hash doğrulama ---
+log_info "Test: 4 bağlantı ile indirme"
+start_server ok
+if "$LLM_CLI" download "$URL" "$WORK_DIR/a.gguf" --connections 4 >/dev/null 2>&1 &&
+   [ "$(sha256sum "$WORK_DIR/a.gguf" | cut -d' ' -f1)" == "$EXPECTED" ]; then
+    log_pass "Dosya eksiksiz indirildi ve doğrulandı."
+else
+    log_fail "Paralel indirme başarısız."
+fi
+
+# --- TEST 2: Kesilen indirmenin segmentlerden devam etmesi ---
+log_info "Test: Yarıda kesilen indirme devam ettirilmeli"
+start_server truncate
+"$LLM_CLI" download "$URL" "$WORK_DIR/b.gguf" --connections 4 >/dev/null 2>&1
+if [ -f "$WORK_DIR/b.gguf" ] || [ ! -f "$WORK_DIR/b.gguf.tmp.parts" ]; then
+    log_fail "Eksik indirme tamamlanmış sayıldı veya durum dosyası yazılmadı."
+fi
+start_server ok
+OUT=$("$LLM_CLI" download "$URL" "$WORK_DIR/b.gguf" --connections 4 2>&1)
+if echo "$OUT" | grep -q "Resuming" &&
+   [ "$(sha256sum "$WORK_DIR/b.gguf" | cut -d' ' -f1)" == "$EXPECTED" ]; then
+    log_pass "İndirme kaldığı yerden devam etti."
+else
+    log_fail "Resume çalışmadı: $OUT"
+fi
+
+# --- TEST 3: Bozuk içerik reddedilmeli ---
+log_info "Test: ETag ile uyuşmayan dosya reddedilmeli"
+start_server bad-etag
+if "$LLM_CLI" download "$URL" "$WORK_DIR/c.gguf" >/dev/null 2>&1; then
+    log_fail "Hash uyuşmazlığı fark edilmedi."
+elif [ -f "$WORK_DIR/c.gguf" ] || [ -f "$WORK_DIR/c.gguf.tmp" ]; then
+    log_fail "Doğrulanamayan dosya diskte bırakıldı."
+else
+    log_pass "Hash uyuşmazlığında dosya silindi."
+fi